@@ -0,0 +1,453 @@
+/*
+ * =============================================================================
+ * Fichier     : bench.c
+ * Description : Micro-benchmarks des primitives de synchronisation et de
+ *               communication
+ *
+ * Mesure le cout d'une paire prise/liberation :
+ *   - Semaphore System V (semop P puis V) : deux appels systeme
+ *   - Verrou futex en memoire partagee (verrou_prendre / verrou_rendre)
+ *
+ * Deux scenarios : sans contention (un seul processus) et avec contention
+ * (plusieurs processus sur le meme verrou).
+ *
+ * Mesure aussi le cout d'un aller (envoi + reception) d'une requete :
+ *   - File de messages System V (msgsnd + msgrcv)
+ *   - Anneau MPSC en memoire partagee (anneau_deposer + anneau_retirer)
+ *
+ * Mesure enfin la recherche du vendeur le moins charge et la mise a jour
+ * d'une file, dans l'ancienne disposition (un tableau de fiches contenant
+ * chacune sa longueur de file) et dans la nouvelle (fiches alignees sur
+ * une ligne de cache, longueurs dans un tableau contigu lu par
+ * indice_minimum), sans puis avec des processus qui modifient les files
+ * pendant la recherche.
+ *
+ * Le benchmark utilise ses propres objets (IPC_PRIVATE, mmap anonyme) et
+ * peut donc tourner pendant une simulation sans la perturber.
+ *
+ * Usage : ./bench [iterations]
+ * =============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "ipc.h"
+
+/* Nombre de processus pour le scenario avec contention */
+#define NB_PROCESSUS_CONTENTION 4
+
+/* Compteur protege par le verrou (verifie la correction en contention) */
+typedef struct {
+    verrou_t verrou;
+    long compteur;
+} zone_bench_t;
+
+/* Ancienne fiche vendeur : longueur de file au milieu de la fiche, fiches
+   contigues (plusieurs vendeurs par ligne de cache) */
+typedef struct {
+    verrou_t verrou;
+    int rayon;
+    int file_attente;
+    int occupe;
+    pid_t pid;
+    int clients_queue[MAX_QUEUE];
+} ancien_vendeur_t;
+
+/* Nombre de vendeurs de la comparaison des dispositions (ancienne borne
+   MAX_VENDEURS, taille d'un grand magasin) */
+#define NB_VENDEURS_SELECTION   50
+
+/* Vendeurs des deux dispositions, partages avec les processus ecrivains */
+typedef struct {
+    int termines;                   /* Ecrivains ayant termine */
+    ancien_vendeur_t ancien[NB_VENDEURS_SELECTION];
+    vendeur_info_t fiches[NB_VENDEURS_SELECTION];
+    int attente[NB_VENDEURS_SELECTION] __attribute__((aligned(TAILLE_LIGNE_CACHE)));
+} zone_selection_t;
+
+/* Nombre de vendeurs pour comparer parcours et index a grande echelle */
+#define NB_VENDEURS_INDEX   4096
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : maintenant_ns
+ * Description : Horloge monotone en nanosecondes
+ * -----------------------------------------------------------------------------
+ */
+static long long maintenant_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : boucle_semaphore / boucle_verrou
+ * Description : Executent n paires prise/liberation
+ * -----------------------------------------------------------------------------
+ */
+static void boucle_semaphore(int sem, long n, long *compteur) {
+    struct sembuf p = {0, -1, 0};
+    struct sembuf v = {0, 1, 0};
+    long i;
+
+    for (i = 0; i < n; i++) {
+        semop(sem, &p, 1);
+        (*compteur)++;
+        semop(sem, &v, 1);
+    }
+}
+
+static void boucle_verrou(zone_bench_t *zone, long n) {
+    long i;
+
+    for (i = 0; i < n; i++) {
+        verrou_prendre(&zone->verrou);
+        zone->compteur++;
+        verrou_rendre(&zone->verrou);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : contention
+ * Description : Lance NB_PROCESSUS_CONTENTION processus sur la meme primitive
+ * Retour      : Duree totale en nanosecondes
+ * -----------------------------------------------------------------------------
+ */
+static long long contention(int sem, zone_bench_t *zone, long n) {
+    long long debut = maintenant_ns();
+    int i;
+
+    for (i = 0; i < NB_PROCESSUS_CONTENTION; i++) {
+        if (fork() == 0) {
+            if (sem != -1) {
+                boucle_semaphore(sem, n, &zone->compteur);
+            } else {
+                boucle_verrou(zone, n);
+            }
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    while (wait(NULL) > 0);
+
+    return maintenant_ns() - debut;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : bench_transport
+ * Description : Cout d'un envoi + reception de requete vendeur
+ * -----------------------------------------------------------------------------
+ */
+static void bench_transport(long n) {
+    msg_client_vendeur_t msg, recu;
+    anneau_t *anneau;
+    long long t;
+    long i;
+    int file;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.mtype = 1;
+
+    file = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+    if (file == -1) {
+        perror("[ERREUR] msgget");
+        return;
+    }
+    t = maintenant_ns();
+    for (i = 0; i < n; i++) {
+        msgsnd(file, &msg, sizeof(msg) - sizeof(long), 0);
+        msgrcv(file, &recu, sizeof(recu) - sizeof(long), 1, 0);
+    }
+    t = maintenant_ns() - t;
+    printf("File System V (msgsnd + msgrcv)     : %8.1f ns\n", (double)t / n);
+    msgctl(file, IPC_RMID, NULL);
+
+    anneau = malloc(sizeof(anneau_t));
+    anneau_init(anneau);
+    t = maintenant_ns();
+    for (i = 0; i < n; i++) {
+        anneau_deposer(anneau, &msg, sizeof(msg));
+        anneau_retirer(anneau, &recu, sizeof(recu));
+    }
+    t = maintenant_ns() - t;
+    printf("Anneau MPSC (deposer + retirer)     : %8.1f ns\n", (double)t / n);
+    free(anneau);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : scan_ancien / scan_scalaire
+ * Description : Recherche lineaire du minimum, une lecture atomique par
+ *               vendeur (ancienne disposition, ou tableau contigu)
+ * -----------------------------------------------------------------------------
+ */
+static int scan_ancien(ancien_vendeur_t *v, int n) {
+    int idx = 0;
+    int min_file = __atomic_load_n(&v[0].file_attente, __ATOMIC_RELAXED);
+    int i;
+
+    for (i = 1; i < n; i++) {
+        int f = __atomic_load_n(&v[i].file_attente, __ATOMIC_RELAXED);
+        if (f < min_file) {
+            min_file = f;
+            idx = i;
+        }
+    }
+    return idx;
+}
+
+static int scan_scalaire(const int *attente, int n) {
+    int idx = 0;
+    int min_file = __atomic_load_n(&attente[0], __ATOMIC_RELAXED);
+    int i;
+
+    for (i = 1; i < n; i++) {
+        int f = __atomic_load_n(&attente[i], __ATOMIC_RELAXED);
+        if (f < min_file) {
+            min_file = f;
+            idx = i;
+        }
+    }
+    return idx;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : passage_client
+ * Description : Mises a jour d'un passage de client chez le vendeur i :
+ *               entree en file, vendeur occupe puis libre, sortie de file
+ *               (chacune sous le verrou du vendeur, comme client.c et
+ *               vendeur.c)
+ * Parametres  : zone, nouveau (0 : ancienne disposition), i
+ * -----------------------------------------------------------------------------
+ */
+static void passage_client(zone_selection_t *zone, int nouveau, int i) {
+    verrou_t *verrou = nouveau ? &zone->fiches[i].verrou : &zone->ancien[i].verrou;
+    int *file = nouveau ? &zone->attente[i] : &zone->ancien[i].file_attente;
+    int *occupe = nouveau ? &zone->fiches[i].occupe : &zone->ancien[i].occupe;
+
+    verrou_prendre(verrou);
+    __atomic_store_n(file, *file + 1, __ATOMIC_RELAXED);
+    verrou_rendre(verrou);
+    verrou_prendre(verrou);
+    *occupe = 1;
+    verrou_rendre(verrou);
+    verrou_prendre(verrou);
+    *occupe = 0;
+    __atomic_store_n(file, *file - 1, __ATOMIC_RELAXED);
+    verrou_rendre(verrou);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : bench_index
+ * Description : Recherche par index_moins_charge (plus l'entree et la
+ *               sortie d'un client dans l'index) contre le parcours
+ *               vectoriel, pour NB_VENDEURS_SELECTION puis NB_VENDEURS_INDEX acteurs
+ * -----------------------------------------------------------------------------
+ */
+static void bench_index(long n) {
+    static const int tailles[2] = {NB_VENDEURS_SELECTION, NB_VENDEURS_INDEX};
+    index_charge_t *ix;
+    int *attente;
+    volatile int puits = 0;
+    long long t;
+    long i;
+    int k, nb, j;
+
+    for (k = 0; k < 2; k++) {
+        nb = tailles[k];
+        ix = aligned_alloc(TAILLE_LIGNE_CACHE,
+                           (taille_index(nb) + TAILLE_LIGNE_CACHE - 1) & ~(size_t)(TAILLE_LIGNE_CACHE - 1));
+        attente = calloc(nb, sizeof(int));
+        index_init(ix, nb);
+
+        /* Files de 1 a 5 clients, un seul acteur au minimum (le dernier) */
+        for (j = 0; j < nb; j++) {
+            attente[j] = (j == nb - 1) ? 1 : 2 + j % 4;
+            index_deplacer(ix, j, 0, attente[j]);
+        }
+
+        t = maintenant_ns();
+        for (i = 0; i < n / 10; i++) {
+            puits += indice_minimum(attente, nb);
+        }
+        t = maintenant_ns() - t;
+        printf("Recherche, %4d acteurs, parcours   : %8.1f ns\n", nb, (double)t / (n / 10));
+
+        t = maintenant_ns();
+        for (i = 0; i < n / 10; i++) {
+            j = index_moins_charge(ix, attente);
+            index_deplacer(ix, j, attente[j], attente[j] + 1);
+            index_deplacer(ix, j, attente[j] + 1, attente[j]);
+            puits += j;
+        }
+        t = maintenant_ns() - t;
+        printf("Recherche, %4d acteurs, index      : %8.1f ns\n", nb, (double)t / (n / 10));
+
+        free(attente);
+        free(ix);
+    }
+    (void)puits;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : bench_selection
+ * Description : Cout de la recherche du moins charge (n_vendeurs vendeurs)
+ *               et d'un passage de client, pour les deux dispositions ;
+ *               avec contention, NB_PROCESSUS_CONTENTION processus font
+ *               passer des clients chez les vendeurs 0, 1, ... (voisins en
+ *               memoire) pendant que ce processus cherche
+ * -----------------------------------------------------------------------------
+ */
+static void bench_selection(long n) {
+    static const char *noms[2] = {"Ancienne disposition", "Nouvelle disposition"};
+    zone_selection_t *zone;
+    volatile int puits = 0;
+    long long t;
+    long i, scans;
+    int nouveau, p;
+
+    zone = mmap(NULL, sizeof(zone_selection_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (zone == MAP_FAILED) {
+        perror("[ERREUR] mmap");
+        return;
+    }
+    for (i = 0; i < NB_VENDEURS_SELECTION; i++) {
+        zone->ancien[i].file_attente = zone->attente[i] = (int)((i * 7) % 5) + 1;
+    }
+
+    /* ----- Sans contention ----- */
+    t = maintenant_ns();
+    for (i = 0; i < n; i++) {
+        puits += scan_ancien(zone->ancien, NB_VENDEURS_SELECTION);
+    }
+    t = maintenant_ns() - t;
+    printf("Recherche, ancienne disposition     : %8.1f ns\n", (double)t / n);
+
+    t = maintenant_ns();
+    for (i = 0; i < n; i++) {
+        puits += scan_scalaire(zone->attente, NB_VENDEURS_SELECTION);
+    }
+    t = maintenant_ns() - t;
+    printf("Recherche, tableau contigu          : %8.1f ns\n", (double)t / n);
+
+    t = maintenant_ns();
+    for (i = 0; i < n; i++) {
+        puits += indice_minimum(zone->attente, NB_VENDEURS_SELECTION);
+    }
+    t = maintenant_ns() - t;
+    printf("Recherche, contigu + vectoriel      : %8.1f ns\n", (double)t / n);
+
+    bench_index(n);
+
+    for (nouveau = 0; nouveau < 2; nouveau++) {
+        t = maintenant_ns();
+        for (i = 0; i < n; i++) {
+            passage_client(zone, nouveau, 0);
+        }
+        t = maintenant_ns() - t;
+        printf("Passage client, %-20s: %8.1f ns\n", noms[nouveau], (double)t / n);
+    }
+
+    /* ----- Avec contention ----- */
+    for (nouveau = 0; nouveau < 2; nouveau++) {
+        long long t_ecriture = maintenant_ns();
+
+        zone->termines = 0;
+        for (p = 0; p < NB_PROCESSUS_CONTENTION; p++) {
+            if (fork() == 0) {
+                for (i = 0; i < n; i++) {
+                    passage_client(zone, nouveau, p);
+                }
+                __atomic_fetch_add(&zone->termines, 1, __ATOMIC_RELEASE);
+                _exit(EXIT_SUCCESS);
+            }
+        }
+        scans = 0;
+        t = maintenant_ns();
+        while (__atomic_load_n(&zone->termines, __ATOMIC_ACQUIRE) < NB_PROCESSUS_CONTENTION) {
+            puits += nouveau ? indice_minimum(zone->attente, NB_VENDEURS_SELECTION)
+                             : scan_ancien(zone->ancien, NB_VENDEURS_SELECTION);
+            scans++;
+        }
+        t = maintenant_ns() - t;
+        t_ecriture = maintenant_ns() - t_ecriture;
+        while (wait(NULL) > 0);
+        printf("%s, %d ecrivains : recherche %8.1f ns, passage %8.1f ns\n",
+               noms[nouveau], NB_PROCESSUS_CONTENTION, (double)t / scans,
+               (double)t_ecriture / n);
+    }
+
+    (void)puits;
+    munmap(zone, sizeof(zone_selection_t));
+}
+
+int main(int argc, char *argv[]) {
+    long n = (argc > 1) ? atol(argv[1]) : 1000000;
+    long total = n * NB_PROCESSUS_CONTENTION;
+    long long t;
+    zone_bench_t *zone;
+    int sem;
+
+    /* Zone partagee entre les processus du benchmark */
+    zone = mmap(NULL, sizeof(zone_bench_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (zone == MAP_FAILED) {
+        perror("[ERREUR] mmap");
+        return EXIT_FAILURE;
+    }
+
+    sem = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+    if (sem == -1) {
+        perror("[ERREUR] semget");
+        return EXIT_FAILURE;
+    }
+    semctl(sem, 0, SETVAL, 1);
+
+    printf("=== Cout d'une paire prise/liberation (%ld iterations) ===\n", n);
+
+    /* ----- Sans contention ----- */
+    zone->compteur = 0;
+    t = maintenant_ns();
+    boucle_semaphore(sem, n, &zone->compteur);
+    t = maintenant_ns() - t;
+    printf("Semaphore System V, sans contention : %8.1f ns\n", (double)t / n);
+
+    zone->compteur = 0;
+    t = maintenant_ns();
+    boucle_verrou(zone, n);
+    t = maintenant_ns() - t;
+    printf("Verrou futex,       sans contention : %8.1f ns\n", (double)t / n);
+
+    /* ----- Avec contention ----- */
+    zone->compteur = 0;
+    t = contention(sem, zone, n);
+    printf("Semaphore System V, %d processus    : %8.1f ns (compteur %ld/%ld)\n",
+           NB_PROCESSUS_CONTENTION, (double)t / total, zone->compteur, total);
+
+    zone->compteur = 0;
+    t = contention(-1, zone, n);
+    printf("Verrou futex,       %d processus    : %8.1f ns (compteur %ld/%ld)\n",
+           NB_PROCESSUS_CONTENTION, (double)t / total, zone->compteur, total);
+
+    printf("\n=== Cout d'un envoi + reception de requete ===\n");
+    bench_transport(n);
+
+    printf("\n=== Recherche du vendeur le moins charge (%d vendeurs) ===\n", NB_VENDEURS_SELECTION);
+    bench_selection(n);
+
+    semctl(sem, 0, IPC_RMID);
+    munmap(zone, sizeof(zone_bench_t));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/*
+ * =============================================================================
+ * Fichier     : boite.c
+ * Description : Implementation des boites aux lettres du mode threads
+ *
+ * Une boite est une liste chainee de messages protegee par un mutex.
+ * Le retrait parcourt la liste pour trouver le premier message du type
+ * demande (comme msgrcv) et dort sur la variable condition sinon.
+ *
+ * =============================================================================
+ */
+
+#include "boite.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : boite_init
+ * Description : Initialise une boite vide
+ * Parametre   : b - boite a initialiser
+ * -----------------------------------------------------------------------------
+ */
+void boite_init(boite_t *b) {
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_cond_init(&b->cond, NULL);
+    b->tete = NULL;
+    b->queue = NULL;
+    b->fermee = 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : boite_detruire
+ * Description : Libere les messages non lus et les objets pthread
+ * Parametre   : b - boite a detruire
+ * -----------------------------------------------------------------------------
+ */
+void boite_detruire(boite_t *b) {
+    message_boite_t *m = b->tete;
+
+    while (m != NULL) {
+        message_boite_t *suivant = m->suivant;
+        free(m);
+        m = suivant;
+    }
+    b->tete = NULL;
+    b->queue = NULL;
+    pthread_cond_destroy(&b->cond);
+    pthread_mutex_destroy(&b->mutex);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : boite_deposer
+ * Description : Ajoute une copie du message en fin de boite
+ *               broadcast : plusieurs threads peuvent attendre des types
+ *               differents dans la meme boite (reponses et decision)
+ * Parametres  :
+ *   - b      : boite destinataire
+ *   - msg    : message, commencant par son long mtype
+ *   - taille : taille du message, mtype inclus
+ * Retour      : 0 si succes, -1 si erreur d'allocation
+ * -----------------------------------------------------------------------------
+ */
+int boite_deposer(boite_t *b, const void *msg, size_t taille) {
+    message_boite_t *m = malloc(sizeof(message_boite_t) + taille);
+
+    if (m == NULL) {
+        return -1;
+    }
+    m->suivant = NULL;
+    m->mtype = *(const long *)msg;
+    m->taille = taille;
+    memcpy(m->donnees, msg, taille);
+
+    pthread_mutex_lock(&b->mutex);
+    if (b->queue != NULL) {
+        b->queue->suivant = m;
+    } else {
+        b->tete = m;
+    }
+    b->queue = m;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->mutex);
+
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : boite_retirer
+ * Description : Retire le premier message de type mtype (tout type si 0)
+ *               et dort sur la condition tant qu'aucun ne correspond
+ * Parametres  :
+ *   - b      : boite
+ *   - msg    : buffer de sortie (mtype inclus)
+ *   - taille : taille du buffer
+ *   - mtype  : type attendu, 0 pour le premier message
+ * Retour      : 0 si succes, -1 (errno = EIDRM, comme msgrcv sur une file
+ *               detruite) si la boite est fermee sans message de ce type
+ * -----------------------------------------------------------------------------
+ */
+int boite_retirer(boite_t *b, void *msg, size_t taille, long mtype) {
+    message_boite_t *precedent, *m;
+
+    pthread_mutex_lock(&b->mutex);
+    for (;;) {
+        precedent = NULL;
+        for (m = b->tete; m != NULL; precedent = m, m = m->suivant) {
+            if (mtype == 0 || m->mtype == mtype) {
+                break;
+            }
+        }
+        if (m != NULL) {
+            break;
+        }
+        if (b->fermee) {
+            pthread_mutex_unlock(&b->mutex);
+            errno = EIDRM;
+            return -1;
+        }
+        pthread_cond_wait(&b->cond, &b->mutex);
+    }
+
+    /* Decrocher le message de la liste */
+    if (precedent != NULL) {
+        precedent->suivant = m->suivant;
+    } else {
+        b->tete = m->suivant;
+    }
+    if (b->queue == m) {
+        b->queue = precedent;
+    }
+    pthread_mutex_unlock(&b->mutex);
+
+    memcpy(msg, m->donnees, (m->taille < taille) ? m->taille : taille);
+    free(m);
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : boite_fermer
+ * Description : Ferme la boite : les threads qui y attendent sont reveilles
+ *               et les retraits sans message correspondant echouent
+ *               desormais au lieu d'attendre. Les messages deja deposes
+ *               restent lisibles.
+ * Parametre   : b - boite a fermer
+ * -----------------------------------------------------------------------------
+ */
+void boite_fermer(boite_t *b) {
+    pthread_mutex_lock(&b->mutex);
+    b->fermee = 1;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->mutex);
+}
@@ -0,0 +1,84 @@
+/*
+ * =============================================================================
+ * Fichier     : boite.h
+ * Description : Boites aux lettres en memoire du processus (mode threads)
+ *
+ * Equivalent "dans le processus" d'une file de messages System V :
+ *   - depot d'un message (commencant par un long mtype) en fin de file
+ *   - retrait bloquant du premier message d'un type donne (0 = le premier)
+ *
+ * Utilise par le mode threads (./main -T) a la place des files System V :
+ * une boite par vendeur, par caissier et par client.
+ *
+ * =============================================================================
+ */
+
+#ifndef BOITE_H
+#define BOITE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * Structure : message_boite_t
+ * Description : Message chaine dans une boite (copie du message depose)
+ */
+typedef struct message_boite {
+    struct message_boite *suivant;  /* Message suivant dans la boite */
+    long mtype;                     /* Type du message (copie du 1er champ) */
+    size_t taille;                  /* Taille du message, mtype inclus */
+    char donnees[];                 /* Message complet */
+} message_boite_t;
+
+/*
+ * Structure : boite_t
+ * Description : File de messages protegee par un mutex, avec une variable
+ *               condition pour reveiller les threads en attente
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    message_boite_t *tete;          /* Plus ancien message */
+    message_boite_t *queue;         /* Plus recent message */
+    int fermee;                     /* 1 : plus d'attente (boite_fermer) */
+} boite_t;
+
+/*
+ * Fonction : boite_init
+ * Description : Initialise une boite vide
+ */
+void boite_init(boite_t *b);
+
+/*
+ * Fonction : boite_detruire
+ * Description : Libere les messages restants et les objets pthread
+ */
+void boite_detruire(boite_t *b);
+
+/*
+ * Fonction : boite_deposer
+ * Description : Copie un message en fin de boite et reveille les threads
+ *               en attente
+ * Parametres : b, msg (commence par long mtype), taille (mtype inclus)
+ * Retour : 0 si succes, -1 si erreur d'allocation
+ */
+int boite_deposer(boite_t *b, const void *msg, size_t taille);
+
+/*
+ * Fonction : boite_retirer
+ * Description : Retire le premier message de type mtype (0 : le premier
+ *               message), en attendant s'il n'y en a pas
+ * Parametres : b, msg (buffer de sortie), taille, mtype
+ * Retour : 0 si succes, -1 (errno = EIDRM) si la boite est fermee et
+ *          sans message de ce type
+ */
+int boite_retirer(boite_t *b, void *msg, size_t taille, long mtype);
+
+/*
+ * Fonction : boite_fermer
+ * Description : Reveille les threads en attente et fait echouer les
+ *               retraits suivants sans message (arret du mode threads)
+ */
+void boite_fermer(boite_t *b);
+
+#endif /* BOITE_H */
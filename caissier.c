@@ -12,8 +12,11 @@
  * 
  * Fonctions :
  *   - gestionnaireSignal() : Gestionnaire pour arret propre
- *   - main()               : Boucle principale du caissier
+ *   - executer_caissier()  : Boucle principale du caissier
+ *   - main()               : Processus caissier (fork + exec)
  * 
+ * Compile avec -DROLE_SANS_MAIN, ce fichier fournit executer_caissier() au
+ * processus initial (mode threads : un thread par caissier).
  * =============================================================================
  */
 
@@ -23,16 +26,19 @@
 #include <signal.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 #include "config.h"
 #include "ipc.h"
 #include "log.h"
 #include "utils.h"
+#include "roles.h"
 
 /* ============== VARIABLES GLOBALES ============== */
 
-int caissier_id;    /* ID de ce caissier */
-int continuer = 1;  /* Flag pour la boucle principale */
+static __thread int caissier_id;        /* ID de ce caissier */
+static __thread int continuer = 1;      /* Flag pour la boucle principale */
 
+#ifndef ROLE_SANS_MAIN
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : gestionnaireSignal
@@ -40,135 +46,160 @@ int continuer = 1;  /* Flag pour la boucle principale */
  * Parametre   : sig - numero du signal (ignore)
  * -----------------------------------------------------------------------------
  */
- 
-void gestionnaireSignal(int sig) {
+static void gestionnaireSignal(int sig) {
     (void)sig;
     continuer = 0;
 }
+#endif
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : main
- * Description : Point d'entree du processus caissier
- *               1. Attache les IPC
- *               2. Boucle principale : encaissement des clients
- *               3. Termine proprement sur signal
- * Parametre   : argv[1] = ID du caissier
+ * Fonction    : executer_caissier
+ * Description : Boucle principale du caissier (IPC et log deja prets)
+ *               Encaisse les clients jusqu'a l'arret de la simulation
+ *               (message d'arret ou signal)
+ * Parametre   : id - ID du caissier
  * Retour      : EXIT_SUCCESS
  * -----------------------------------------------------------------------------
  */
-int main(int argc, char *argv[]) {
+int executer_caissier(int id) {
     msg_client_caissier_t msg_client;
     msg_caissier_client_t msg_reponse;
     char auteur[32];
-    int i, j;
     
-    /* Verifier les arguments */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <id>\n", argv[0]);
-        exit(EXIT_FAILURE);
-    }
-    
-    caissier_id = atoi(argv[1]);
+    caissier_id = id;
+    log_producteur(ROLE_CAISSIER, id);
     snprintf(auteur, sizeof(auteur), "CAISSIER %d", caissier_id);
     
     /* Initialiser le generateur aleatoire */
-    srand(time(NULL) + caissier_id + 100);
-    log_init();
-    
-    /* Attacher les IPC */
-    if (attacher_ipc() == -1) {
-        log_erreur(auteur, "Impossible d'attacher les IPC");
-        exit(EXIT_FAILURE);
-    }
+    init_random(caissier_id + 100);
     
-    /* Installer les gestionnaires de signaux */
-    for (i = 1; i < 20; i++) {
-        signal(i, gestionnaireSignal);
-    }
-    
-    log_message(auteur, "Caisse ouverte");
+    caissier_info_t *moi = &shm_caissiers[caissier_id];
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_CAISSES, TRACE_CAISSE_OUVERTE, -1, -1, -1, 0);
     
     /* ===== BOUCLE PRINCIPALE ===== */
     while (continuer && shm->simulation_active) {
         
-        /* Attendre un client (non bloquant) */
-        ssize_t ret = msgrcv(msg_caissier_id, &msg_client,
-                            sizeof(msg_client) - sizeof(long),
-                            caissier_id + 1, IPC_NOWAIT);
+        /* Attendre un client (bloquant) */
+        if (recevoir_requete_caissier(caissier_id, &msg_client) == -1) {
+            /* Signal recu (on reverifie continuer) ou file detruite */
+            if (errno != EINTR) {
+                break;
+            }
+            continue;
+        }
         
-        if (ret == -1) {
-            /* Pas de client, attendre un peu */
-            usleep(100000);
+        /* Message d'arret envoye par le processus initial */
+        if (msg_client.client_id < 0) {
             continue;
         }
         
         /* Client recu */
         int client_id = msg_client.client_id;
-        log_message(auteur, "Client %d arrive", client_id);
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CAISSES, TRACE_ARRIVEE_CAISSE, client_id, -1, -1, 0);
         
         /* Marquer le caissier comme occupe */
-        sem_P(SEM_MUTEX_SHM);
-        shm->caissiers[caissier_id].occupe = 1;
-        sem_V(SEM_MUTEX_SHM);
+        verrou_prendre(&moi->verrou);
+        sequence_ouvrir(&moi->sequence);
+        moi->occupe = 1;
+        sequence_fermer(&moi->sequence);
+        verrou_rendre(&moi->verrou);
         
-        /* Recuperer le montant de l'achat en memoire partagee */
-        sem_P(SEM_MUTEX_SHM);
+        /* Recuperer le montant de l'achat en memoire partagee
+           (valide remis a 0 de facon atomique : achat traite) */
         int montant = 0;
-        if (shm->achats[client_id].valide) {
-            montant = shm->achats[client_id].montant;
-            shm->achats[client_id].valide = 0;  /* Marquer comme traite */
+        if (__atomic_exchange_n(&shm_achats[client_id].valide, 0, __ATOMIC_ACQUIRE)) {
+            montant = shm_achats[client_id].montant;
         }
-        sem_V(SEM_MUTEX_SHM);
         
         /* Si montant invalide, utiliser un montant par defaut */
         if (montant == 0) {
             montant = MONTANT_ACHAT_MIN;
         }
         
-        log_message(auteur, "Client %d doit payer %d euros", client_id, montant);
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CAISSES, TRACE_A_PAYER, client_id, -1, -1, montant);
         
-        /* Envoyer le montant au client */
-        msg_reponse.mtype = client_id + 2000;
+        /* Protocole 1 : annoncer le montant au client avant le paiement */
         msg_reponse.montant = montant;
         msg_reponse.paiement_termine = 0;
-        msgsnd(msg_caissier_id, &msg_reponse, 
-               sizeof(msg_reponse) - sizeof(long), 0);
+        if (shm->protocole == PROTOCOLE_V1) {
+            envoyer_reponse_caissier(client_id, &msg_reponse);
+        }
         
         /* Simuler le temps de paiement */
         int temps = tirage_aleatoire(TEMPS_PAIEMENT_MIN, TEMPS_PAIEMENT_MAX);
         sleep(temps);
         
-        /* Signaler la fin du paiement */
+        /* Signaler la fin du paiement (avec le montant en protocole 2) */
         msg_reponse.paiement_termine = 1;
-        msgsnd(msg_caissier_id, &msg_reponse, 
-               sizeof(msg_reponse) - sizeof(long), 0);
+        envoyer_reponse_caissier(client_id, &msg_reponse);
         
-        log_message(auteur, "Client %d a paye %d euros", client_id, montant);
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CAISSES, TRACE_ENCAISSE, client_id, -1, -1, montant);
         
-        /* Retirer le client de la file d'attente et mettre a jour le CA */
-        sem_P(SEM_MUTEX_SHM);
-        shm->chiffre_affaires += montant;
-        int n = shm->caissiers[caissier_id].file_attente;
-        for (i = 0; i < n; i++) {
-            if (shm->caissiers[caissier_id].clients_queue[i] == client_id) {
-                /* Decaler les clients suivants */
-                for (j = i; j < n - 1; j++) {
-                    shm->caissiers[caissier_id].clients_queue[j] = 
-                        shm->caissiers[caissier_id].clients_queue[j + 1];
-                }
-                shm->caissiers[caissier_id].file_attente--;
-                break;
-            }
-        }
-        shm->caissiers[caissier_id].occupe = 0;
-        sem_V(SEM_MUTEX_SHM);
+        /* Retirer le client de la file, liberer la caisse et compter le
+           paiement (une seule modification de la fiche), puis le CA */
+        terminer_paiement(caissier_id, client_id, montant);
     }
     
     /* ===== TERMINAISON ===== */
-    log_message(auteur, "Caisse fermee");
-    shmdt(shm);
+    long reveils, evites;
+    double cpu_ms;
+    bilan_attente(100000, &reveils, &evites, &cpu_ms);
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_CAISSES, auteur,
+                "Attente bloquante: %ld reveils, %ld reveils evites, CPU %.1f ms",
+                reveils, evites, cpu_ms);
+    LOG_EVENEMENT(NIVEAU_BILAN, LOG_CAISSES, TRACE_CAISSE_FERMEE, -1, -1, -1, 0);
+    
+    return EXIT_SUCCESS;
+}
+
+#ifndef ROLE_SANS_MAIN
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : main
+ * Description : Point d'entree du processus caissier
+ *               1. Attache les IPC
+ *               2. Boucle principale : encaissement des clients
+ *               3. Termine proprement sur signal
+ * Parametre   : argv[1] = ID du caissier
+ * Retour      : EXIT_SUCCESS
+ * -----------------------------------------------------------------------------
+ */
+int main(int argc, char *argv[]) {
+    struct sigaction sa;
+    char auteur[32];
+    int i;
+    
+    /* Verifier les arguments */
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <id>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    
+    snprintf(auteur, sizeof(auteur), "CAISSIER %s", argv[1]);
+    log_init();
+    
+    /* Attacher les IPC */
+    if (attacher_ipc() == -1) {
+        log_erreur(auteur, "Impossible d'attacher les IPC");
+        exit(EXIT_FAILURE);
+    }
+    
+    /* Installer les gestionnaires de signaux (sans SA_RESTART : un signal
+       doit interrompre l'attente d'une requete, msgrcv ou futex) */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = gestionnaireSignal;
+    sigemptyset(&sa.sa_mask);
+    for (i = 1; i < 20; i++) {
+        sigaction(i, &sa, NULL);
+    }
+    
+    executer_caissier(atoi(argv[1]));
+    
+    bilan_memoire(ROLE_CAISSIER);
+    detacher_ipc();
     log_close();
     
     return EXIT_SUCCESS;
 }
+#endif /* ROLE_SANS_MAIN */
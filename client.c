@@ -5,7 +5,9 @@
  * 
  * Chaque client :
  *   1. Choisit un rayon aleatoirement
- *   2. Va vers le vendeur le moins charge
+ *   2. Va vers le vendeur le moins charge (ou, selon la politique de
+ *      routage, directement vers un vendeur competent) ; le choix et
+ *      l'entree dans la file se font en une operation (reserver_vendeur)
  *   3. Est redirige si le vendeur n'est pas competent
  *   4. Discute avec un vendeur competent
  *   5. Decide d'acheter ou non (probabilite 65%)
@@ -14,10 +16,12 @@
  * 
  * Fonctions :
  *   - gestionnaireSignal()     : Gestionnaire pour arret propre
- *   - ajouter_queue_vendeur()  : Ajoute le client dans une queue vendeur
- *   - retirer_queue_vendeur()  : Retire le client d'une queue vendeur
  *   - contacter_vendeur()      : Gere l'interaction avec un vendeur
- *   - main()                   : Parcours complet du client
+ *   - executer_client()        : Parcours complet du client
+ *   - main()                   : Processus client (fork + exec)
+ * 
+ * Compile avec -DROLE_SANS_MAIN, ce fichier fournit executer_client() au
+ * processus initial (mode zygote : fork sans exec ; mode threads).
  * =============================================================================
  */
 
@@ -27,18 +31,19 @@
 #include <signal.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 #include "config.h"
 #include "ipc.h"
 #include "log.h"
 #include "utils.h"
-
-/* Declaration des noms de rayons */
-DECLARE_NOMS_RAYONS;
+#include "roles.h"
 
 /* ============== VARIABLES GLOBALES ============== */
 
-int client_id;  /* ID de ce client */
+static __thread int client_id;  /* ID de ce client (un par thread en mode threads) */
+static __thread long long entree_ns;    /* Entree dans le magasin (horloge_ns) */
 
+#ifndef ROLE_SANS_MAIN
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : gestionnaireSignal
@@ -46,118 +51,81 @@ int client_id;  /* ID de ce client */
  * Parametre   : sig - numero du signal (ignore)
  * -----------------------------------------------------------------------------
  */
-void gestionnaireSignal(int sig) {
+static void gestionnaireSignal(int sig) {
     (void)sig;
-    shmdt(shm);
+    detacher_ipc();
     exit(EXIT_SUCCESS);
 }
-
-/*
- * -----------------------------------------------------------------------------
- * Fonction    : ajouter_queue_vendeur
- * Description : Ajoute ce client dans la file d'attente d'un vendeur
- * Parametre   : vendeur_idx - index du vendeur
- * -----------------------------------------------------------------------------
- */
-void ajouter_queue_vendeur(int vendeur_idx) {
-    sem_P(SEM_MUTEX_SHM);
-    int n = shm->vendeurs[vendeur_idx].file_attente;
-    if (n < MAX_QUEUE) {
-        shm->vendeurs[vendeur_idx].clients_queue[n] = client_id;
-        shm->vendeurs[vendeur_idx].file_attente++;
-    }
-    sem_V(SEM_MUTEX_SHM);
-}
-
-/*
- * -----------------------------------------------------------------------------
- * Fonction    : retirer_queue_vendeur
- * Description : Retire ce client de la file d'attente d'un vendeur
- * Parametre   : vendeur_idx - index du vendeur
- * -----------------------------------------------------------------------------
- */
-void retirer_queue_vendeur(int vendeur_idx) {
-    int i, j;
-    
-    sem_P(SEM_MUTEX_SHM);
-    int n = shm->vendeurs[vendeur_idx].file_attente;
-    
-    /* Chercher le client dans la queue */
-    for (i = 0; i < n; i++) {
-        if (shm->vendeurs[vendeur_idx].clients_queue[i] == client_id) {
-            /* Decaler les clients suivants */
-            for (j = i; j < n - 1; j++) {
-                shm->vendeurs[vendeur_idx].clients_queue[j] = 
-                    shm->vendeurs[vendeur_idx].clients_queue[j + 1];
-            }
-            shm->vendeurs[vendeur_idx].file_attente--;
-            break;
-        }
-    }
-    sem_V(SEM_MUTEX_SHM);
-}
+#endif
 
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : contacter_vendeur
  * Description : Gere l'interaction complete avec un vendeur
- *               - S'ajoute a la queue
+ *               (le client est deja dans sa file)
  *               - Envoie une demande
  *               - Attend la reponse
  *               - Gere la redirection si necessaire (appel recursif)
  * Parametres  :
  *   - vendeur_idx : index du vendeur a contacter
  *   - rayon_voulu : numero du rayon recherche
- *   - auteur      : chaine pour le logging
- * Retour      : Index du vendeur final (competent) ou -1 si erreur
+ * Retour      : Index du vendeur final (competent) ou -1 si erreur ou
+ *               file du vendeur recommande pleine
  * -----------------------------------------------------------------------------
  */
-int contacter_vendeur(int vendeur_idx, int rayon_voulu, char *auteur) {
+static int contacter_vendeur(int vendeur_idx, int rayon_voulu) {
     msg_client_vendeur_t msg;
     msg_vendeur_client_t reponse;
     
-    /* S'ajouter a la file d'attente du vendeur */
-    ajouter_queue_vendeur(vendeur_idx);
-    
-    log_message(auteur, "Va vers vendeur %d", vendeur_idx);
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_VA_VENDEUR,
+                  client_id, vendeur_idx, rayon_voulu, 0);
     
     /* Preparer et envoyer la demande */
-    msg.mtype = vendeur_idx + 1;
     msg.client_id = client_id;
     msg.vendeur_id = vendeur_idx;
     msg.rayon_voulu = rayon_voulu;
     msg.type_requete = 0;  /* Demande de rayon */
     msg.decision_achat = 0;
+    msg.entree_ns = entree_ns;
     
-    msgsnd(msg_vendeur_id, &msg, sizeof(msg) - sizeof(long), 0);
+    envoyer_requete_vendeur(&msg);
     
-    /* Attendre la reponse du vendeur */
+    /* Attendre la reponse du vendeur (bloquant) */
     while (shm->simulation_active) {
-        ssize_t ret = msgrcv(msg_vendeur_id, &reponse, sizeof(reponse) - sizeof(long), client_id + 1000, IPC_NOWAIT);
-                            
-        if (ret == -1) {
-            usleep(50000);
+        if (recevoir_reponse_vendeur(client_id, &reponse) == -1) {
+            if (errno != EINTR) {
+                break;
+            }
             continue;
         }
         
         if (!reponse.est_competent) {
             /* Vendeur pas competent : redirection */
-            retirer_queue_vendeur(vendeur_idx);
+            sortir_file_vendeur(vendeur_idx, client_id);
+            __atomic_fetch_add(&shm->redirections, 1, __ATOMIC_RELAXED);
             int nouveau = reponse.vendeur_recommande;
-            log_message(auteur, "Redirection vers vendeur %d", nouveau);
+            if (entrer_file_vendeur(nouveau, client_id) == FILE_PLEINE) {
+                LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_FILE_PLEINE,
+                              client_id, nouveau, rayon_voulu, 0);
+                return -1;
+            }
+            LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_REDIRECTION,
+                          client_id, nouveau, rayon_voulu, 0);
             
             /* Appel recursif vers le nouveau vendeur */
-            return contacter_vendeur(nouveau, rayon_voulu, auteur);
+            return contacter_vendeur(nouveau, rayon_voulu);
         }
         
         if (!reponse.vente_terminee) {
             /* Discussion en cours */
-            log_message(auteur, "Discussion en cours...");
+            LOG_EVENEMENT(NIVEAU_DETAIL, LOG_CLIENTS, TRACE_DISCUSSION,
+                          client_id, vendeur_idx, rayon_voulu, 0);
             continue;
         }
         
         /* Discussion terminee avec un vendeur competent */
-        log_message(auteur, "Discussion terminee");
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_DISCUSSION_FIN,
+                      client_id, vendeur_idx, rayon_voulu, 0);
         return vendeur_idx;
     }
     
@@ -166,61 +134,47 @@ int contacter_vendeur(int vendeur_idx, int rayon_voulu, char *auteur) {
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : main
- * Description : Point d'entree du processus client
- *               Simule le parcours complet du client dans le magasin
- * Parametre   : argv[1] = ID du client
+ * Fonction    : executer_client
+ * Description : Simule le parcours complet d'un client dans le magasin
+ *               Les IPC et le log doivent deja etre initialises ; la fonction
+ *               peut etre appelee plusieurs fois par le meme processus
+ *               (travailleur recycle du mode zygote)
+ * Parametre   : id - ID du client
  * Retour      : EXIT_SUCCESS
  * -----------------------------------------------------------------------------
  */
- 
-int main(int argc, char *argv[]) {
-    char auteur[32];
+int executer_client(int id) {
     int rayon_voulu;
-    int i;
     
-    /* Verifier les arguments */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <id>\n", argv[0]);
-        exit(EXIT_FAILURE);
-    }
-    
-    client_id = atoi(argv[1]);
-    snprintf(auteur, sizeof(auteur), "CLIENT %d", client_id);
+    client_id = id;
+    log_producteur(ROLE_CLIENT, id);
+    entree_ns = horloge_ns();
     
     /* Initialiser le generateur aleatoire */
-    srand(time(NULL) + client_id + 200);
-    log_init();
-    
-    /* Attacher les IPC */
-    if (attacher_ipc() == -1) {
-        log_erreur(auteur, "Impossible d'attacher les IPC");
-        exit(EXIT_FAILURE);
-    }
-    
-    /* Installer les gestionnaires de signaux */
-    for (i = 1; i < 20; i++) {
-        signal(i, gestionnaireSignal);
-    }
+    init_random(client_id + 200);
     
     /* ===== ETAPE 1 : CHOIX DU RAYON ===== */
-    rayon_voulu = rand() % NB_RAYONS;
-    log_message(auteur, "Entre, cherche rayon: %s", NOMS_RAYONS[rayon_voulu]);
+    rayon_voulu = aleatoire() % NB_RAYONS;
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_ENTREE, client_id, -1, rayon_voulu, 0);
     
     /* ===== ETAPE 2 : CHOIX DU VENDEUR ===== */
-    sem_P(SEM_MUTEX_SHM);
-    int vendeur = trouver_vendeur_moins_charge();
-    sem_V(SEM_MUTEX_SHM);
+    /* Selon la politique de routage (defaut : le moins charge), choix et
+       entree dans la file en une seule operation */
+    int vendeur = reserver_vendeur(rayon_voulu, client_id);
+    if (vendeur == FILE_PLEINE) {
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_VENDEURS_PLEINS,
+                      client_id, -1, rayon_voulu, 0);
+        return EXIT_SUCCESS;
+    }
     
-    log_message(auteur, "Choisit vendeur %d", vendeur);
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_CHOIX_VENDEUR,
+                  client_id, vendeur, rayon_voulu, 0);
     
     /* ===== ETAPE 3 : INTERACTION AVEC LE VENDEUR ===== */
-    int vendeur_final = contacter_vendeur(vendeur, rayon_voulu, auteur);
+    int vendeur_final = contacter_vendeur(vendeur, rayon_voulu);
     
     if (vendeur_final < 0 || !shm->simulation_active) {
-        log_message(auteur, "Quitte le magasin");
-        shmdt(shm);
-        log_close();
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_QUITTE, client_id, -1, rayon_voulu, 0);
         return EXIT_SUCCESS;
     }
     
@@ -230,88 +184,144 @@ int main(int argc, char *argv[]) {
     
     /* Envoyer la decision au vendeur */
     msg_client_vendeur_t msg_decision;
-    msg_decision.mtype = vendeur_final + 1;
     msg_decision.client_id = client_id;
     msg_decision.vendeur_id = vendeur_final;
     msg_decision.rayon_voulu = rayon_voulu;
     msg_decision.type_requete = 1;  /* Decision de vente */
     msg_decision.decision_achat = decision;
+    msg_decision.entree_ns = entree_ns;
     
-    msgsnd(msg_vendeur_id, &msg_decision, sizeof(msg_decision) - sizeof(long), 0);
+    envoyer_decision(&msg_decision);
     
     if (!decision) {
         /* Pas d'achat : quitter le magasin */
-        retirer_queue_vendeur(vendeur_final);
-        log_message(auteur, "N'achete pas, quitte le magasin");
-        shmdt(shm);
-        log_close();
+        sortir_file_vendeur(vendeur_final, client_id);
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_SANS_ACHAT,
+                      client_id, vendeur_final, rayon_voulu, 0);
         return EXIT_SUCCESS;
     }
     
-    log_message(auteur, "Decide d'acheter!");
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_ACHAT, client_id, vendeur_final, rayon_voulu, 0);
     
     /* Quitter la queue du vendeur */
-    retirer_queue_vendeur(vendeur_final);
+    sortir_file_vendeur(vendeur_final, client_id);
     
     /* ===== ETAPE 5 : PASSAGE EN CAISSE ===== */
-    sleep(1);  /* Temps pour aller a la caisse */
-    
-    /* Choisir le caissier le moins charge */
-    sem_P(SEM_MUTEX_SHM);
-    int caissier = trouver_caissier_moins_charge();
-    int nc = shm->caissiers[caissier].file_attente;
-    if (nc < MAX_QUEUE) {
-        shm->caissiers[caissier].clients_queue[nc] = client_id;
-        shm->caissiers[caissier].file_attente++;
+    sleep(TEMPS_MARCHE_CAISSE);  /* Temps pour aller a la caisse */
+    
+    /* Choisir le caissier le moins charge et s'ajouter a sa file */
+    int caissier = reserver_caissier(client_id);
+    if (caissier == FILE_PLEINE) {
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_CAISSES_PLEINES,
+                      client_id, -1, rayon_voulu, 0);
+        return EXIT_SUCCESS;
     }
-    sem_V(SEM_MUTEX_SHM);
     
-    log_message(auteur, "Va vers caissier %d", caissier);
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_VA_CAISSIER, client_id, caissier, rayon_voulu, 0);
     
     /* Envoyer une demande au caissier */
     msg_client_caissier_t msg_caisse;
-    msg_caisse.mtype = caissier + 1;
     msg_caisse.client_id = client_id;
     msg_caisse.caissier_id = caissier;
     
-    msgsnd(msg_caissier_id, &msg_caisse, sizeof(msg_caisse) - sizeof(long), 0);
+    envoyer_requete_caissier(&msg_caisse);
     
     /* ===== ETAPE 6 : PAIEMENT ===== */
     msg_caissier_client_t reponse_caisse;
     int montant = 0;
     
     while (shm->simulation_active) {
-        ssize_t ret = msgrcv(msg_caissier_id, &reponse_caisse,
-                            sizeof(reponse_caisse) - sizeof(long),
-                            client_id + 2000, IPC_NOWAIT);
-                            
-        if (ret == -1) {
-            usleep(50000);
+        if (recevoir_reponse_caissier(client_id, &reponse_caisse) == -1) {
+            if (errno != EINTR) {
+                break;
+            }
             continue;
         }
         
         if (!reponse_caisse.paiement_termine) {
             /* Le caissier annonce le prix */
             montant = reponse_caisse.montant;
-            log_message(auteur, "Doit payer %d euros", montant);
+            LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_DOIT_PAYER,
+                          client_id, caissier, rayon_voulu, montant);
             continue;
         }
         
-        /* Paiement termine */
-        log_message(auteur, "Paiement effectue!");
+        /* Paiement termine (protocole 2 : le montant arrive ici) */
+        if (montant == 0) {
+            montant = reponse_caisse.montant;
+            LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_PAYE,
+                          client_id, caissier, rayon_voulu, montant);
+        }
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_PAIEMENT,
+                      client_id, caissier, rayon_voulu, montant);
         break;
     }
     
     /* ===== ETAPE 7 : SORTIE DU MAGASIN ===== */
-    log_message(auteur, "Quitte avec ses achats. Au revoir!");
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_CLIENTS, TRACE_SORTIE,
+                  client_id, caissier, rayon_voulu, montant);
     
     /* Incrementer le compteur de clients termines */
-    sem_P(SEM_MUTEX_SHM);
-    shm->clients_termines++;
-    sem_V(SEM_MUTEX_SHM);
+    __atomic_fetch_add(&shm->clients_termines, 1, __ATOMIC_RELAXED);
+    
+    /* Cumuler les reveils evites (ancien polling : 50 ms) */
+    long reveils, evites;
+    double cpu_ms;
+    bilan_attente(50000, &reveils, &evites, &cpu_ms);
+    
+    return EXIT_SUCCESS;
+}
+
+#ifndef ROLE_SANS_MAIN
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : main
+ * Description : Point d'entree du processus client (lance par fork + exec)
+ *               Mesure la latence de lancement (depuis l'instant du fork
+ *               passe en argv[2]) et le temps de preparation (log + IPC)
+ * Parametres  : argv[1] = ID du client, argv[2] = instant du fork (ns)
+ * Retour      : EXIT_SUCCESS
+ * -----------------------------------------------------------------------------
+ */
+int main(int argc, char *argv[]) {
+    long long t_entree = horloge_ns();
+    long long t_fork = 0;
+    char auteur[32];
+    int i;
+    
+    /* Verifier les arguments */
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Usage: %s <id> [instant_fork_ns]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (argc == 3) {
+        t_fork = atoll(argv[2]);
+    }
+    
+    snprintf(auteur, sizeof(auteur), "CLIENT %s", argv[1]);
+    log_init();
+    
+    /* Attacher les IPC */
+    if (attacher_ipc() == -1) {
+        log_erreur(auteur, "Impossible d'attacher les IPC");
+        exit(EXIT_FAILURE);
+    }
+    
+    if (t_fork > 0) {
+        compter_lancement(t_entree - t_fork, horloge_ns() - t_entree);
+    }
+    
+    /* Installer les gestionnaires de signaux */
+    for (i = 1; i < 20; i++) {
+        signal(i, gestionnaireSignal);
+    }
+    
+    executer_client(atoi(argv[1]));
     
-    shmdt(shm);
+    bilan_memoire(ROLE_CLIENT);
+    detacher_ipc();
     log_close();
     
     return EXIT_SUCCESS;
 }
+#endif /* ROLE_SANS_MAIN */
@@ -5,7 +5,7 @@
  * 
  * Ce fichier centralise tous les parametres modifiables de la simulation :
  *   - Nombre et noms des rayons
- *   - Limites maximales (vendeurs, caissiers, clients)
+ *   - Limites maximales (vendeurs, caissiers, file d'attente)
  *   - Temps d'attente (discussion, paiement)
  *   - Montants des achats
  *   - Probabilites (vente reussie)
@@ -41,9 +41,13 @@
 
 /* ============== LIMITES MAXIMALES ============== */
 
-#define MAX_VENDEURS    50      /* Nombre max de vendeurs */
-#define MAX_CAISSIERS   20      /* Nombre max de caissiers */
-#define MAX_CLIENTS     500     /* Nombre max de clients */
+/* La memoire partagee est dimensionnee au lancement d'apres les nombres
+   reels d'acteurs : le nombre de clients n'a pas de limite de compilation.
+   Les bornes vendeurs / caissiers sont celles de leurs types de messages,
+   qui doivent rester sous MTYPE_BASE_CLIENT = 1000 (verifie dans ipc.h) ;
+   elles sont verifiees par le processus initial. */
+#define MAX_VENDEURS    999     /* Nombre max de vendeurs */
+#define MAX_CAISSIERS   999     /* Nombre max de caissiers */
 #define MAX_QUEUE       20      /* Taille max d'une file d'attente */
 
 /* ============== TEMPS D'ATTENTE (en secondes) ============== */
@@ -56,6 +60,9 @@
 #define TEMPS_PAIEMENT_MIN      1
 #define TEMPS_PAIEMENT_MAX      2
 
+/* Trajet d'un acheteur du vendeur jusqu'aux caisses */
+#define TEMPS_MARCHE_CAISSE     1
+
 /* Delai entre les actions (pour lisibilite des logs) */
 #define DELAI_ACTION_MIN        1
 #define DELAI_ACTION_MAX        2
@@ -73,6 +80,18 @@
 /* ============== FICHIER DE LOG ============== */
 
 #define FICHIER_LOG             "magasin.log"
+#define FICHIER_EVENEMENTS      "magasin.evt"   /* Evenements binaires (logdump) */
+
+/* Processus journal : periode de releve des journaux, et retard avant
+   ecriture (une trace plus recente peut encore etre devancee par une
+   trace plus ancienne, pas encore publiee) ; c'est aussi le delai apres
+   lequel une cellule reservee mais non publiee peut etre abandonnee, si
+   le processus qui l'a reservee est mort */
+#define PERIODE_JOURNAL_US      10000
+#define RETARD_JOURNAL_NS       20000000LL
+
+/* Tampon d'ecriture du processus journal (une ecriture par releve) */
+#define TAMPON_JOURNAL          65536
 
 /* ============== CLES IPC ============== */
 
@@ -0,0 +1,670 @@
+/*
+ * =============================================================================
+ * Fichier     : evenements.c
+ * Description : Implementation du moteur a evenements discrets
+ *
+ * Modele (memes regles que vendeur.c, caissier.c et client.c) :
+ *   - un client choisit un rayon au hasard et va vers le vendeur le moins
+ *     charge (file d'attente + client en cours)
+ *   - un vendeur sert ses clients dans l'ordre d'arrivee ; s'il n'est pas
+ *     competent, il redirige aussitot vers le vendeur du rayon le moins
+ *     charge
+ *   - discussion de TEMPS_DISCUSSION_MIN a _MAX secondes, puis decision
+ *     d'achat avec la probabilite PROBA_VENTE_REUSSIE
+ *   - un acheteur marche TEMPS_MARCHE_CAISSE secondes, rejoint le caissier
+ *     le moins charge, paie en TEMPS_PAIEMENT_MIN a _MAX secondes
+ *   - une file compte au plus MAX_QUEUE clients, client servi compris : un
+ *     client qui la trouve pleine quitte le magasin (refus, comme
+ *     FILE_PLEINE)
+ *
+ * Le temps est compte en millisecondes virtuelles. Les evenements sont
+ * ranges dans un tas binaire (plus petit instant en tete, ordre de creation
+ * en cas d'egalite). La memoire est proportionnelle aux clients presents
+ * dans le magasin, pas au nombre total de clients.
+ *
+ * =============================================================================
+ */
+
+#include "evenements.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "config.h"
+#include "ipc.h"
+#include "log.h"
+#include "utils.h"
+
+/* Types d'evenements */
+#define EV_ARRIVEE          0   /* Un client entre dans le magasin */
+#define EV_FIN_DISCUSSION   1   /* Un vendeur termine une discussion */
+#define EV_ARRIVEE_CAISSE   2   /* Un acheteur arrive aux caisses */
+#define EV_FIN_PAIEMENT     3   /* Un caissier termine un encaissement */
+
+/*
+ * Structure : evenement_t
+ * Description : Evenement date dans la file de priorite
+ */
+typedef struct {
+    long long instant;              /* Temps virtuel (ms) */
+    long sequence;                  /* Ordre de creation (egalites) */
+    int type;                       /* EV_* */
+    int acteur;                     /* Vendeur ou caissier concerne ;
+                                       montant de l'achat (EV_ARRIVEE_CAISSE) */
+} evenement_t;
+
+/*
+ * Structure : tas_t
+ * Description : Tas binaire d'evenements (minimum en tete)
+ */
+typedef struct {
+    evenement_t *elements;
+    long nb;
+    long capacite;
+    long prochaine_sequence;
+} tas_t;
+
+/*
+ * Structure : attente_t
+ * Description : Client en attente chez un vendeur ou un caissier
+ */
+typedef struct {
+    long long entree;               /* Instant d'entree dans la file */
+    long long arrivee;              /* Instant d'entree dans le magasin */
+    int rayon;                      /* Rayon recherche */
+    int montant;                    /* Achat a payer (caisse) */
+} attente_t;
+
+/* Retour de entrer_file : file pleine, le client quitte le magasin */
+#define REFUSE              1
+
+/*
+ * Structure : file_clients_t
+ * Description : File circulaire de MAX_QUEUE places (le client servi n'y
+ *               est plus, mais compte dans la limite : voir entrer_file)
+ */
+typedef struct {
+    attente_t cellules[MAX_QUEUE];
+    int tete;
+    int nb;
+} file_clients_t;
+
+/*
+ * Structure : guichet_t
+ * Description : Etat d'un vendeur ou d'un caissier
+ */
+typedef struct {
+    file_clients_t file;            /* Clients en attente */
+    int occupe;                     /* 1 si un client est servi */
+    attente_t en_cours;             /* Client servi */
+    int rayon;                      /* Rayon d'expertise (vendeurs) */
+    int service_ewma_ms;            /* Duree moyenne des discussions */
+    long long occupe_ms;            /* Temps de service cumule */
+} guichet_t;
+
+/* Etat de la simulation (propre a ce module) */
+static tas_t tas;
+static guichet_t *vendeurs;
+static guichet_t *caissiers;
+static int nb_v, nb_c;
+static int curseur_v, curseur_c;        /* Tourniquets de moins_charge */
+static int curseurs_rayon[NB_RAYONS];   /* Tourniquets de vendeur_pour_rayon */
+static int *specialistes;               /* Annuaire : [rayon * nb_v + k] */
+static int nb_specialistes[NB_RAYONS];
+static int protocole_sim;
+static int routage_sim;
+
+/* Statistiques */
+static equilibre_t equilibre[2];        /* ROLE_VENDEUR, ROLE_CAISSIER */
+static long messages;
+static long redirections;
+static long acheteurs;
+static long chiffre_affaires;
+static long long attente_vendeur_ms;    /* Cumul des attentes chez un vendeur */
+static long nb_attentes_vendeur;
+static long long attente_caisse_ms;
+static long nb_attentes_caisse;
+static long long premier_service_ms;    /* Cumul arrivee -> vendeur competent */
+static long nb_premiers_services;
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : tas_ajouter
+ * Description : Insere un evenement dans le tas (remontee)
+ * Parametres  : instant, type, acteur
+ * Retour      : 0 si succes, -1 si erreur d'allocation
+ * -----------------------------------------------------------------------------
+ */
+static int tas_ajouter(long long instant, int type, int acteur) {
+    evenement_t ev;
+    long i;
+
+    if (tas.nb == tas.capacite) {
+        long capacite = tas.capacite ? tas.capacite * 2 : 1024;
+        evenement_t *nouveau = realloc(tas.elements, capacite * sizeof(evenement_t));
+        if (nouveau == NULL) {
+            perror("[ERREUR] realloc tas");
+            return -1;
+        }
+        tas.elements = nouveau;
+        tas.capacite = capacite;
+    }
+
+    ev.instant = instant;
+    ev.sequence = tas.prochaine_sequence++;
+    ev.type = type;
+    ev.acteur = acteur;
+
+    i = tas.nb++;
+    while (i > 0) {
+        long parent = (i - 1) / 2;
+        evenement_t *p = &tas.elements[parent];
+        if (p->instant < ev.instant ||
+            (p->instant == ev.instant && p->sequence < ev.sequence)) {
+            break;
+        }
+        tas.elements[i] = *p;
+        i = parent;
+    }
+    tas.elements[i] = ev;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : tas_retirer
+ * Description : Retire l'evenement le plus ancien (descente)
+ * Parametre   : ev - evenement retire (sortie)
+ * Retour      : 0 si un evenement a ete retire, -1 si le tas est vide
+ * -----------------------------------------------------------------------------
+ */
+static int tas_retirer(evenement_t *ev) {
+    evenement_t dernier;
+    long i = 0;
+
+    if (tas.nb == 0) {
+        return -1;
+    }
+    *ev = tas.elements[0];
+    dernier = tas.elements[--tas.nb];
+
+    for (;;) {
+        long fils = 2 * i + 1;
+        if (fils >= tas.nb) {
+            break;
+        }
+        if (fils + 1 < tas.nb &&
+            (tas.elements[fils + 1].instant < tas.elements[fils].instant ||
+             (tas.elements[fils + 1].instant == tas.elements[fils].instant &&
+              tas.elements[fils + 1].sequence < tas.elements[fils].sequence))) {
+            fils++;
+        }
+        if (dernier.instant < tas.elements[fils].instant ||
+            (dernier.instant == tas.elements[fils].instant &&
+             dernier.sequence < tas.elements[fils].sequence)) {
+            break;
+        }
+        tas.elements[i] = tas.elements[fils];
+        i = fils;
+    }
+    tas.elements[i] = dernier;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : entrer_file
+ * Description : Ajoute un client a la file d'un guichet, sauf si la charge
+ *               (file + client servi) atteint deja MAX_QUEUE : refus
+ *               compte, comme inscrire en mode processus
+ * Parametres  : g, e (equilibre du groupe), a
+ * Retour      : 0, REFUSE si la file est pleine
+ * -----------------------------------------------------------------------------
+ */
+static int entrer_file(guichet_t *g, equilibre_t *e, attente_t a) {
+    file_clients_t *f = &g->file;
+
+    if (f->nb + g->occupe >= MAX_QUEUE) {
+        e->refus++;
+        return REFUSE;
+    }
+    f->cellules[(f->tete + f->nb) % MAX_QUEUE] = a;
+    f->nb++;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : file_retirer
+ * Description : Retire le client en tete de la file d'un guichet
+ * Retour      : 0 si succes, -1 si la file est vide
+ * -----------------------------------------------------------------------------
+ */
+static int file_retirer(file_clients_t *f, attente_t *a) {
+    if (f->nb == 0) {
+        return -1;
+    }
+    *a = f->cellules[f->tete];
+    f->tete = (f->tete + 1) % MAX_QUEUE;
+    f->nb--;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : noter_equilibre
+ * Description : Ecart entre la plus chargee et la moins chargee des files
+ *               d'un groupe apres une reservation (comme noter_equilibre
+ *               du mode processus ; aucun choix n'est jamais refait ici)
+ * Parametres  : e, g (guichets du groupe), n
+ * -----------------------------------------------------------------------------
+ */
+static void noter_equilibre(equilibre_t *e, const guichet_t *g, int n) {
+    int min = MAX_QUEUE, max = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        int charge = g[i].file.nb + g[i].occupe;
+        if (charge < min) {
+            min = charge;
+        }
+        if (charge > max) {
+            max = charge;
+        }
+    }
+    e->reservations++;
+    e->ecart_total += max - min;
+    if (max - min > e->ecart_max) {
+        e->ecart_max = max - min;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : moins_charge
+ * Description : Guichet avec la plus petite charge (file + client servi) ;
+ *               a egalite, le premier a partir du curseur, qui passe
+ *               ensuite au guichet suivant (tourniquet, comme
+ *               trouver_*_moins_charge)
+ * Parametres  : g - tableau de guichets, n - nombre de guichets,
+ *               curseur - position du tourniquet (mise a jour)
+ * Retour      : Index du guichet
+ * -----------------------------------------------------------------------------
+ */
+static int moins_charge(const guichet_t *g, int n, int *curseur) {
+    int idx = *curseur % n;
+    int min = g[idx].file.nb + g[idx].occupe;
+    int k;
+
+    for (k = 1; k < n; k++) {
+        int i = (*curseur + k) % n;
+        int charge = g[i].file.nb + g[i].occupe;
+        if (charge < min) {
+            min = charge;
+            idx = i;
+        }
+    }
+    *curseur = idx + 1;
+    return idx;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : cout_vendeur
+ * Description : Charge du vendeur (file + client servi), ou attente prevue
+ *               (charge x duree moyenne des discussions) si ewma
+ * -----------------------------------------------------------------------------
+ */
+static long cout_vendeur(int i, int ewma) {
+    long charge = vendeurs[i].file.nb + vendeurs[i].occupe;
+
+    return ewma ? charge * vendeurs[i].service_ewma_ms : charge;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : vendeur_pour_rayon
+ * Description : Vendeur du rayon de plus petit cout, a tour de role en cas
+ *               d'egalite (comme trouver_vendeur_pour_rayon et le routage
+ *               ewma de choisir_vendeur)
+ * Parametres  : rayon, ewma (voir cout_vendeur)
+ * -----------------------------------------------------------------------------
+ */
+static int vendeur_pour_rayon(int rayon, int ewma) {
+    const int *liste = &specialistes[rayon * nb_v];
+    int n = nb_specialistes[rayon];
+    int depart, meilleur, k;
+    long min;
+
+    if (n == 0) {
+        return 0;
+    }
+    depart = curseurs_rayon[rayon] % n;
+    meilleur = depart;
+    min = cout_vendeur(liste[depart], ewma);
+    for (k = 1; k < n; k++) {
+        int pos = (depart + k) % n;
+        long c = cout_vendeur(liste[pos], ewma);
+
+        if (c < min) {
+            min = c;
+            meilleur = pos;
+        }
+    }
+    curseurs_rayon[rayon] = meilleur + 1;
+    return liste[meilleur];
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : choisir_vendeur_sim
+ * Description : Premier vendeur d'un client selon la politique de routage
+ *               (memes regles que choisir_vendeur)
+ * -----------------------------------------------------------------------------
+ */
+static int choisir_vendeur_sim(int rayon) {
+    const int *liste = &specialistes[rayon * nb_v];
+    int n = nb_specialistes[rayon];
+    int a, b;
+
+    switch (routage_sim) {
+    case ROUTAGE_DIRECT:
+        return vendeur_pour_rayon(rayon, 0);
+    case ROUTAGE_EWMA:
+        return vendeur_pour_rayon(rayon, 1);
+    case ROUTAGE_DEUX_CHOIX:
+        if (n < 2) {
+            return (n == 1) ? liste[0] : 0;
+        }
+        a = aleatoire() % n;
+        b = aleatoire() % (n - 1);
+        if (b >= a) {
+            b++;
+        }
+        return (cout_vendeur(liste[b], 0) < cout_vendeur(liste[a], 0)) ? liste[b] : liste[a];
+    default:
+        return moins_charge(vendeurs, nb_v, &curseur_v);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : servir_vendeur
+ * Description : Si le vendeur est libre, prend le client suivant
+ *               Les redirections sont immediates (aucun temps de service) :
+ *               le client passe dans la file du vendeur competent et le
+ *               vendeur enchaine avec le client suivant
+ * Parametres  : v - index du vendeur, maintenant - temps virtuel
+ * Retour      : 0 si succes, -1 si erreur d'allocation
+ * -----------------------------------------------------------------------------
+ */
+static int servir_vendeur(int v, long long maintenant) {
+    guichet_t *g = &vendeurs[v];
+    attente_t a;
+
+    while (!g->occupe && file_retirer(&g->file, &a) == 0) {
+        attente_vendeur_ms += maintenant - a.entree;
+        nb_attentes_vendeur++;
+        messages++;                     /* Requete client -> vendeur */
+
+        if (a.rayon != g->rayon) {
+            /* Pas competent : reponse de redirection */
+            int autre = vendeur_pour_rayon(a.rayon, 0);
+            messages++;
+            redirections++;
+            a.entree = maintenant;
+            if (entrer_file(&vendeurs[autre], &equilibre[ROLE_VENDEUR], a) == REFUSE) {
+                continue;               /* File pleine : le client part */
+            }
+            if (autre != v && servir_vendeur(autre, maintenant) == -1) {
+                return -1;
+            }
+            continue;
+        }
+
+        /* Competent : discussion */
+        int duree = tirage_aleatoire(TEMPS_DISCUSSION_MIN, TEMPS_DISCUSSION_MAX) * 1000;
+        premier_service_ms += maintenant - a.arrivee;
+        nb_premiers_services++;
+        g->service_ewma_ms += (duree - g->service_ewma_ms) / (1 << EWMA_DECALAGE);
+        g->occupe = 1;
+        g->en_cours = a;
+        g->occupe_ms += duree;
+        messages += (protocole_sim == PROTOCOLE_V1) ? 2 : 1;
+        if (tas_ajouter(maintenant + duree, EV_FIN_DISCUSSION, v) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : servir_caissier
+ * Description : Si le caissier est libre, encaisse le client suivant
+ * Parametres  : c - index du caissier, maintenant - temps virtuel
+ * Retour      : 0 si succes, -1 si erreur d'allocation
+ * -----------------------------------------------------------------------------
+ */
+static int servir_caissier(int c, long long maintenant) {
+    guichet_t *g = &caissiers[c];
+    attente_t a;
+    int duree;
+
+    if (g->occupe || file_retirer(&g->file, &a) == -1) {
+        return 0;
+    }
+    attente_caisse_ms += maintenant - a.entree;
+    nb_attentes_caisse++;
+
+    duree = tirage_aleatoire(TEMPS_PAIEMENT_MIN, TEMPS_PAIEMENT_MAX) * 1000;
+    g->occupe = 1;
+    g->en_cours = a;
+    g->occupe_ms += duree;
+    messages += (protocole_sim == PROTOCOLE_V1) ? 3 : 2;   /* Requete + reponses */
+    return tas_ajouter(maintenant + duree, EV_FIN_PAIEMENT, c);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : liberer
+ * Description : Libere la memoire de la simulation
+ * -----------------------------------------------------------------------------
+ */
+static void liberer(void) {
+    free(vendeurs);
+    free(caissiers);
+    free(specialistes);
+    specialistes = NULL;
+    free(tas.elements);
+    vendeurs = NULL;
+    caissiers = NULL;
+    memset(&tas, 0, sizeof(tas));
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : prochaine_arrivee
+ * Description : Intervalle avant l'arrivee suivante (loi exponentielle de
+ *               moyenne inter_arrivee_ms, arrondie a la milliseconde)
+ * -----------------------------------------------------------------------------
+ */
+static long long prochaine_arrivee(long inter_arrivee_ms) {
+    double u = (aleatoire() + 1.0) / ((double)RAND_MAX + 2.0);
+
+    if (inter_arrivee_ms <= 0) {
+        return 0;
+    }
+    return (long long)(-log(u) * inter_arrivee_ms + 0.5);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : executer_evenements
+ * Description : Boucle principale du moteur : retire l'evenement le plus
+ *               ancien, avance l'horloge virtuelle et applique ses effets
+ * Parametres  : nb_vendeurs, nb_caissiers, nb_clients, protocole,
+ *               inter_arrivee_ms (voir evenements.h)
+ * Retour      : 0 si succes, -1 si erreur d'allocation
+ * -----------------------------------------------------------------------------
+ */
+int executer_evenements(int nb_vendeurs, int nb_caissiers, int nb_clients,
+                        int protocole, int routage, long inter_arrivee_ms) {
+    long long debut_reel = horloge_ns();
+    long long maintenant = 0;
+    long nb_evenements = 0;
+    int arrives = 0;
+    int erreur = 0;
+    evenement_t ev;
+    attente_t a;
+    int i;
+
+    nb_v = nb_vendeurs;
+    curseur_v = 0;
+    curseur_c = 0;
+    memset(curseurs_rayon, 0, sizeof(curseurs_rayon));
+    memset(equilibre, 0, sizeof(equilibre));
+    nb_c = nb_caissiers;
+    protocole_sim = protocole;
+    routage_sim = routage;
+    vendeurs = calloc(nb_vendeurs, sizeof(guichet_t));
+    caissiers = calloc(nb_caissiers, sizeof(guichet_t));
+    specialistes = malloc((size_t)NB_RAYONS * nb_vendeurs * sizeof(int));
+    if (vendeurs == NULL || caissiers == NULL || specialistes == NULL) {
+        perror("[ERREUR] calloc guichets");
+        liberer();
+        return -1;
+    }
+
+    /* Meme affectation des rayons que le processus initial */
+    memset(nb_specialistes, 0, sizeof(nb_specialistes));
+    for (i = 0; i < nb_vendeurs; i++) {
+        int r = (i < NB_RAYONS) ? i : (aleatoire() % NB_RAYONS);
+
+        vendeurs[i].rayon = r;
+        vendeurs[i].service_ewma_ms = (TEMPS_DISCUSSION_MIN + TEMPS_DISCUSSION_MAX) * 500;
+        specialistes[r * nb_vendeurs + nb_specialistes[r]++] = i;
+    }
+
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Moteur a evenements discrets (temps virtuel), "
+                "arrivees %s%ld ms", inter_arrivee_ms ? "toutes les ~" : "a t = ",
+                inter_arrivee_ms);
+
+    erreur = tas_ajouter(0, EV_ARRIVEE, -1);
+
+    /* ===== BOUCLE D'EVENEMENTS ===== */
+    while (!erreur && tas_retirer(&ev) == 0) {
+        maintenant = ev.instant;
+        nb_evenements++;
+
+        switch (ev.type) {
+        case EV_ARRIVEE:
+            /* Choix du rayon puis du vendeur (politique de routage) */
+            a.entree = maintenant;
+            a.arrivee = maintenant;
+            a.rayon = aleatoire() % NB_RAYONS;
+            a.montant = 0;
+            i = choisir_vendeur_sim(a.rayon);
+            if (entrer_file(&vendeurs[i], &equilibre[ROLE_VENDEUR], a) == 0) {
+                noter_equilibre(&equilibre[ROLE_VENDEUR], vendeurs, nb_v);
+                erreur = servir_vendeur(i, maintenant);
+            }
+            /* Le client suivant (une seule arrivee en attente dans le tas) */
+            if (!erreur && ++arrives < nb_clients) {
+                erreur = tas_ajouter(maintenant + prochaine_arrivee(inter_arrivee_ms),
+                                     EV_ARRIVEE, -1);
+            }
+            break;
+
+        case EV_FIN_DISCUSSION:
+            /* Decision du client, puis le vendeur est libere */
+            messages++;
+            vendeurs[ev.acteur].occupe = 0;
+            if (probabilite(PROBA_VENTE_REUSSIE)) {
+                acheteurs++;
+                erreur = tas_ajouter(maintenant + TEMPS_MARCHE_CAISSE * 1000, EV_ARRIVEE_CAISSE,
+                                     tirage_aleatoire(MONTANT_ACHAT_MIN, MONTANT_ACHAT_MAX));
+            }
+            if (!erreur) {
+                erreur = servir_vendeur(ev.acteur, maintenant);
+            }
+            break;
+
+        case EV_ARRIVEE_CAISSE:
+            a.entree = maintenant;
+            a.arrivee = maintenant;
+            a.rayon = -1;
+            a.montant = ev.acteur;
+            i = moins_charge(caissiers, nb_c, &curseur_c);
+            if (entrer_file(&caissiers[i], &equilibre[ROLE_CAISSIER], a) == 0) {
+                noter_equilibre(&equilibre[ROLE_CAISSIER], caissiers, nb_c);
+                erreur = servir_caissier(i, maintenant);
+            }
+            break;
+
+        case EV_FIN_PAIEMENT:
+            /* Le chiffre d'affaires est compte a l'encaissement */
+            chiffre_affaires += caissiers[ev.acteur].en_cours.montant;
+            caissiers[ev.acteur].occupe = 0;
+            erreur = servir_caissier(ev.acteur, maintenant);
+            break;
+        }
+    }
+
+    if (erreur) {
+        log_erreur("INITIAL", "Simulation a evenements interrompue (memoire)");
+        liberer();
+        return -1;
+    }
+
+    /* ===== BILAN (memes lignes que le mode processus) ===== */
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Duree de service des %d clients: %.3f s (temps virtuel)",
+                nb_clients, maintenant / 1000.0);
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Messages echanges: %ld (%.2f par client, protocole %d)",
+                messages, (double)messages / nb_clients, protocole);
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL", "Clients: %ld acheteurs, %ld redirections, "
+                "chiffre d'affaires %ld EUR", acheteurs, redirections, chiffre_affaires);
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Routage %s: %.2f redirections par client, premier service "
+                "apres %.3f s en moyenne", nom_routage(routage),
+                (double)redirections / nb_clients,
+                nb_premiers_services ? premier_service_ms / 1000.0 / nb_premiers_services : 0.0);
+    for (i = ROLE_VENDEUR; i <= ROLE_CAISSIER; i++) {
+        equilibre_t *e = &equilibre[i];
+
+        if (e->reservations > 0) {
+            LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                        "Equilibre des files (%s, %ld reservations): ecart max-min "
+                        "%.2f en moyenne, %d au pire, %ld choix refaits, %ld refus (file pleine)",
+                        i == ROLE_VENDEUR ? "vendeurs" : "caissiers", e->reservations,
+                        (double)e->ecart_total / e->reservations, e->ecart_max,
+                        e->reprises, e->refus);
+        }
+    }
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Attente moyenne: %.1f s chez un vendeur, %.1f s en caisse",
+                nb_attentes_vendeur ? attente_vendeur_ms / 1000.0 / nb_attentes_vendeur : 0.0,
+                nb_attentes_caisse ? attente_caisse_ms / 1000.0 / nb_attentes_caisse : 0.0);
+    if (maintenant > 0) {
+        long long occupe_v = 0, occupe_c = 0;
+        for (i = 0; i < nb_v; i++) {
+            occupe_v += vendeurs[i].occupe_ms;
+        }
+        for (i = 0; i < nb_c; i++) {
+            occupe_c += caissiers[i].occupe_ms;
+        }
+        LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                    "Occupation moyenne: vendeurs %.1f %%, caissiers %.1f %%",
+                    100.0 * occupe_v / ((double)maintenant * nb_v),
+                    100.0 * occupe_c / ((double)maintenant * nb_c));
+    }
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Moteur: %ld evenements traites en %.3f s (temps reel)",
+                nb_evenements, (horloge_ns() - debut_reel) / 1e9);
+
+    liberer();
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * =============================================================================
+ * Fichier     : evenements.h
+ * Description : Moteur de simulation a evenements discrets (temps virtuel)
+ *
+ * Rejoue le comportement des acteurs (choix du vendeur le moins charge,
+ * redirection vers un vendeur competent, discussion, decision d'achat,
+ * passage en caisse) avec les parametres de config.h, mais sans processus,
+ * sans IPC et sans sleep : une horloge virtuelle avance d'evenement en
+ * evenement (file de priorite). Lance par ./main -E.
+ *
+ * =============================================================================
+ */
+
+#ifndef EVENEMENTS_H
+#define EVENEMENTS_H
+
+/*
+ * Fonction : executer_evenements
+ * Description : Simule nb_clients clients en temps virtuel et affiche le
+ *               meme bilan que le mode processus (duree de service, messages
+ *               echanges), plus les attentes moyennes et le chiffre d'affaires
+ * Parametres :
+ *   - nb_vendeurs, nb_caissiers, nb_clients
+ *   - protocole        : PROTOCOLE_V1 ou PROTOCOLE_V2 (compte des messages)
+ *   - routage          : ROUTAGE_* (choix du premier vendeur)
+ *   - inter_arrivee_ms : intervalle moyen entre deux arrivees (loi
+ *                        exponentielle), 0 : tous les clients a l'ouverture
+ * Retour : 0 si succes, -1 si erreur d'allocation
+ */
+int executer_evenements(int nb_vendeurs, int nb_caissiers, int nb_clients,
+                        int protocole, int routage, long inter_arrivee_ms);
+
+#endif /* EVENEMENTS_H */
@@ -4,22 +4,34 @@
  * Description : Implementation des fonctions IPC pour la simulation
  * 
  * Ce fichier implemente toutes les fonctions de gestion des IPC System V :
- *   - Creation et destruction de la memoire partagee
+ *   - Creation et destruction de la memoire partagee (segment System V, ou
+ *     shm_open + mmap avec pages enormes et pre-chargement : choisir_instance)
  *   - Creation et destruction des semaphores
  *   - Creation et destruction des files de messages
  *   - Operations P et V sur les semaphores
+ *   - Boites en memoire du processus pour le mode threads (TRANSPORT_THREADS)
  *   - Fonctions utilitaires (recherche vendeur/caissier moins charge)
  * 
  * =============================================================================
  */
 
+#define _GNU_SOURCE     /* RUSAGE_THREAD */
 #include "ipc.h"
+#include "boite.h"
+#include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 /* ============== VARIABLES GLOBALES ============== */
 
@@ -27,8 +39,408 @@ int shm_id = -1;            /* ID de la memoire partagee */
 int sem_id = -1;            /* ID de l'ensemble de semaphores */
 int msg_vendeur_id = -1;    /* ID de la file de messages vendeurs */
 int msg_caissier_id = -1;   /* ID de la file de messages caissiers */
+int msg_reponse_vendeur_id = -1;    /* Reponses vendeur -> client */
+int msg_reponse_caissier_id = -1;   /* Reponses caissier -> client */
 magasin_shm_t *shm = NULL;  /* Pointeur vers la memoire partagee */
 
+/* Tableaux du segment (voir lier_zones) */
+vendeur_info_t *shm_vendeurs = NULL;
+caissier_info_t *shm_caissiers = NULL;
+int *shm_attente_vendeurs = NULL;
+int *shm_attente_caissiers = NULL;
+index_charge_t *shm_index_vendeurs = NULL;
+index_charge_t *shm_index_caissiers = NULL;
+int *shm_annuaire = NULL;
+achat_info_t *shm_achats = NULL;
+int *shm_places = NULL;
+int *shm_files_vendeurs = NULL;
+int *shm_files_caissiers = NULL;
+anneau_t *shm_anneaux_vendeurs = NULL;
+anneau_t *shm_anneaux_caissiers = NULL;
+journal_t *shm_journaux = NULL;
+
+/* Alignement de chaque tableau du segment (ligne de cache) */
+#define ALIGNEMENT_ZONE TAILLE_LIGNE_CACHE
+
+/* Instance et type de memoire (choisir_instance, herites par exec) */
+static int instance_choisie = 0;
+static char fichier_cle[128] = IPC_KEY_FILE;    /* Fichier pour ftok */
+static char nom_posix[96] = "";                 /* Vide : segment System V */
+static char chemin_enorme[160] = "";            /* Fichier hugetlbfs mappe */
+static size_t taille_mappee = 0;                /* Taille du mmap POSIX */
+
+/* Mesures de l'attachement (bilan_memoire) */
+static long long attache_ns = 0;
+static long fautes_attache = 0;
+static long fautes_apres_attache = 0;           /* ru_minflt apres attache */
+
+/* Files privees creees par ce processus (TRANSPORT_FILES), a detruire */
+static int *files_creees = NULL;
+static int nb_files_creees = 0;
+
+/* Boites du mode threads (TRANSPORT_THREADS), NULL sinon */
+static boite_t *boites_vendeurs = NULL;
+static boite_t *boites_caissiers = NULL;
+static boite_t *boites_clients = NULL;  /* Reponses et decisions d'un client */
+static int nb_boites_vendeurs = 0;
+static int nb_boites_caissiers = 0;
+static int nb_boites_clients = 0;
+
+/* Statistiques de la reception bloquante (propres au thread : un processus
+   par acteur, ou un thread par acteur en mode threads) */
+static __thread long nb_reveils = 0;        /* Retours de msgrcv (message ou signal) */
+static __thread long long attente_ns = 0;   /* Temps total passe bloque */
+
+/* Nombre d'essais en attente active avant de dormir sur le futex */
+#define VERROU_SPIN 100
+
+static void futex_reveiller(int *adresse, int nombre);
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : compter_reveil
+ * Description : Comptabilise un reveil et la duree d'attente depuis debut
+ * Parametre   : debut - instant (CLOCK_MONOTONIC) du debut de l'attente
+ * -----------------------------------------------------------------------------
+ */
+static void compter_reveil(const struct timespec *debut);
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : compter_message
+ * Description : Compte un message du protocole (bilan messages / client)
+ * -----------------------------------------------------------------------------
+ */
+static void compter_message(void) {
+    __atomic_fetch_add(&shm->messages_envoyes, 1, __ATOMIC_RELAXED);
+}
+
+static void compter_reveil(const struct timespec *debut) {
+    struct timespec fin;
+    
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    nb_reveils++;
+    attente_ns += (long long)(fin.tv_sec - debut->tv_sec) * 1000000000LL
+                + (fin.tv_nsec - debut->tv_nsec);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : reserver_zone
+ * Description : Reserve un tableau a la fin de la disposition en cours
+ * Parametres  :
+ *   - taille : taille courante du segment (mise a jour)
+ *   - octets : taille du tableau
+ * Retour      : Decalage du tableau depuis le debut du segment
+ * -----------------------------------------------------------------------------
+ */
+static size_t reserver_zone(size_t *taille, size_t octets) {
+    size_t off = (*taille + ALIGNEMENT_ZONE - 1) & ~(size_t)(ALIGNEMENT_ZONE - 1);
+    
+    *taille = off + octets;
+    return off;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : calculer_disposition
+ * Description : Remplit les capacites et decalages de l'en-tete pour les
+ *               nombres d'acteurs donnes ; les anneaux ne sont reserves
+ *               qu'en TRANSPORT_ANNEAU
+ * Parametres  : d (en-tete a remplir), nb_vendeurs, nb_caissiers,
+ *               nb_clients, transport
+ * -----------------------------------------------------------------------------
+ */
+static void calculer_disposition(magasin_shm_t *d, int nb_vendeurs, int nb_caissiers,
+                                 int nb_clients, int transport) {
+    size_t taille = sizeof(magasin_shm_t);
+    
+    d->capacite_vendeurs = nb_vendeurs;
+    d->capacite_caissiers = nb_caissiers;
+    d->capacite_clients = nb_clients;
+    d->off_vendeurs = reserver_zone(&taille, nb_vendeurs * sizeof(vendeur_info_t));
+    d->off_caissiers = reserver_zone(&taille, nb_caissiers * sizeof(caissier_info_t));
+    d->off_attente_vendeurs = reserver_zone(&taille, nb_vendeurs * sizeof(int));
+    d->off_attente_caissiers = reserver_zone(&taille, nb_caissiers * sizeof(int));
+    d->off_index_vendeurs = reserver_zone(&taille, taille_index(nb_vendeurs));
+    d->off_index_caissiers = reserver_zone(&taille, taille_index(nb_caissiers));
+    d->off_annuaire = reserver_zone(&taille, (size_t)NB_RAYONS * nb_vendeurs * sizeof(int));
+    d->off_achats = reserver_zone(&taille, (size_t)nb_clients * sizeof(achat_info_t));
+    d->off_places = reserver_zone(&taille, (size_t)nb_clients * sizeof(int));
+    d->off_files_vendeurs = reserver_zone(&taille, nb_vendeurs * sizeof(int));
+    d->off_files_caissiers = reserver_zone(&taille, nb_caissiers * sizeof(int));
+    if (transport == TRANSPORT_ANNEAU) {
+        d->off_anneaux_vendeurs = reserver_zone(&taille, nb_vendeurs * sizeof(anneau_t));
+        d->off_anneaux_caissiers = reserver_zone(&taille, nb_caissiers * sizeof(anneau_t));
+    }
+    d->nb_journaux = 1 + nb_vendeurs + nb_caissiers +
+                     (nb_clients < NB_JOURNAUX_CLIENTS ? nb_clients : NB_JOURNAUX_CLIENTS);
+    d->off_journaux = reserver_zone(&taille, (size_t)d->nb_journaux * sizeof(journal_t));
+    d->taille_segment = taille;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : lier_zones
+ * Description : Positionne les pointeurs shm_* d'apres l'en-tete du segment
+ *               attache (l'adresse d'attachement differe d'un processus a
+ *               l'autre, seuls les decalages sont partages)
+ * -----------------------------------------------------------------------------
+ */
+static void lier_zones(void) {
+    char *base = (char *)shm;
+    
+    shm_vendeurs = (vendeur_info_t *)(base + shm->off_vendeurs);
+    shm_caissiers = (caissier_info_t *)(base + shm->off_caissiers);
+    shm_attente_vendeurs = (int *)(base + shm->off_attente_vendeurs);
+    shm_attente_caissiers = (int *)(base + shm->off_attente_caissiers);
+    shm_index_vendeurs = (index_charge_t *)(base + shm->off_index_vendeurs);
+    shm_index_caissiers = (index_charge_t *)(base + shm->off_index_caissiers);
+    shm_annuaire = (int *)(base + shm->off_annuaire);
+    shm_achats = (achat_info_t *)(base + shm->off_achats);
+    shm_places = (int *)(base + shm->off_places);
+    shm_files_vendeurs = (int *)(base + shm->off_files_vendeurs);
+    shm_files_caissiers = (int *)(base + shm->off_files_caissiers);
+    shm_anneaux_vendeurs = shm->off_anneaux_vendeurs ?
+        (anneau_t *)(base + shm->off_anneaux_vendeurs) : NULL;
+    shm_anneaux_caissiers = shm->off_anneaux_caissiers ?
+        (anneau_t *)(base + shm->off_anneaux_caissiers) : NULL;
+    shm_journaux = (journal_t *)(base + shm->off_journaux);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : choisir_instance
+ * Description : Choisit le nom de l'instance et la memoire POSIX
+ *               - nom : suffixe du fichier ftok (les semaphores et files
+ *                 d'une instance nommee sont distincts) et du nom POSIX
+ *               - posix : shm_open + mmap au lieu de shmget + shmat
+ *               Le choix est exporte dans l'environnement pour que les
+ *               processus lances par exec (et monitoring lance depuis le
+ *               meme shell avec les memes options) retrouvent l'instance.
+ * Parametres  : nom (NULL ou "" : instance par defaut), posix (0 ou 1)
+ * -----------------------------------------------------------------------------
+ */
+void choisir_instance(const char *nom, int posix) {
+    int nomme = (nom != NULL && nom[0] != '\0');
+    
+    instance_choisie = 1;
+    if (nomme) {
+        snprintf(fichier_cle, sizeof(fichier_cle), "%s_%s", IPC_KEY_FILE, nom);
+        setenv(ENV_INSTANCE, nom, 1);
+    } else {
+        snprintf(fichier_cle, sizeof(fichier_cle), "%s", IPC_KEY_FILE);
+        unsetenv(ENV_INSTANCE);
+    }
+    if (posix) {
+        snprintf(nom_posix, sizeof(nom_posix), "/magasin%s%s",
+                 nomme ? "_" : "", nomme ? nom : "");
+        snprintf(chemin_enorme, sizeof(chemin_enorme), "%s%s", CHEMIN_HUGETLBFS, nom_posix);
+        setenv(ENV_MEMOIRE, "posix", 1);
+    } else {
+        nom_posix[0] = '\0';
+        chemin_enorme[0] = '\0';
+        unsetenv(ENV_MEMOIRE);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : lire_instance
+ * Description : Reprend le choix du processus initial (environnement) si
+ *               choisir_instance n'a pas ete appelee dans ce processus
+ * -----------------------------------------------------------------------------
+ */
+static void lire_instance(void) {
+    const char *memoire = getenv(ENV_MEMOIRE);
+    
+    if (!instance_choisie) {
+        choisir_instance(getenv(ENV_INSTANCE),
+                         memoire != NULL && strcmp(memoire, "posix") == 0);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : fautes_mineures
+ * Description : Fautes de page mineures du processus depuis son lancement
+ * -----------------------------------------------------------------------------
+ */
+static long fautes_mineures(void) {
+    struct rusage usage;
+    
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : mapper_posix
+ * Description : Mappe un objet de memoire partagee ouvert (MAP_POPULATE :
+ *               toutes les pages sont installees maintenant, pas au premier
+ *               acces dans la boucle des acteurs)
+ * Parametres  : fd, taille, enorme (1 : fichier hugetlbfs, MAP_HUGETLB)
+ * Retour      : Adresse, ou MAP_FAILED
+ * -----------------------------------------------------------------------------
+ */
+static void *mapper_posix(int fd, size_t taille, int enorme) {
+    int options = MAP_SHARED | MAP_POPULATE;
+    
+#ifdef MAP_HUGETLB
+    if (enorme) {
+        options |= MAP_HUGETLB;
+    }
+#else
+    (void)enorme;
+#endif
+    return mmap(NULL, taille, PROT_READ | PROT_WRITE, options, fd, 0);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : creer_segment_sysv
+ * Description : Cree (ou recree) et attache le segment System V
+ * Parametres  : key_shm - cle ftok, taille - taille du segment
+ * Retour      : Adresse du segment, ou NULL si erreur
+ * -----------------------------------------------------------------------------
+ */
+static void *creer_segment_sysv(key_t key_shm, size_t taille) {
+    void *adresse;
+    
+    shm_id = shmget(key_shm, taille, IPC_CREAT | IPC_EXCL | 0666);
+    if (shm_id == -1) {
+        if (errno == EEXIST) {
+            /* Le segment existe deja (d'une autre taille), le supprimer et recreer */
+            shm_id = shmget(key_shm, 0, 0666);
+            if (shm_id != -1) {
+                shmctl(shm_id, IPC_RMID, NULL);
+            }
+            shm_id = shmget(key_shm, taille, IPC_CREAT | 0666);
+        }
+        if (shm_id == -1) {
+            perror("[ERREUR] shmget");
+            return NULL;
+        }
+    }
+    
+    /* Attacher la memoire partagee */
+    adresse = shmat(shm_id, NULL, 0);
+    if (adresse == (void *)-1) {
+        perror("[ERREUR] shmat");
+        return NULL;
+    }
+    return adresse;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : creer_segment_posix
+ * Description : Cree et mappe le segment POSIX
+ *               1. Pages enormes : fichier sur hugetlbfs (CHEMIN_HUGETLBFS),
+ *                  taille arrondie a TAILLE_PAGE_ENORME ; echoue sans pages
+ *                  enormes reservees (vm.nr_hugepages)
+ *               2. Sinon shm_open (tmpfs), avec MADV_HUGEPAGE (pages enormes
+ *                  transparentes si le noyau les autorise pour tmpfs)
+ *               Les pages sont pre-chargees (MAP_POPULATE) et verrouillees
+ *               en memoire (mlock, sans erreur si la limite est atteinte).
+ * Parametre   : taille - taille demandee
+ * Retour      : Adresse du segment, ou NULL si erreur
+ * -----------------------------------------------------------------------------
+ */
+static void *creer_segment_posix(size_t taille) {
+    size_t taille_enorme = (taille + TAILLE_PAGE_ENORME - 1) & ~(size_t)(TAILLE_PAGE_ENORME - 1);
+    void *adresse;
+    int fd;
+    
+    /* Un segment d'une execution precedente est remplace */
+    unlink(chemin_enorme);
+    shm_unlink(nom_posix);
+    
+    /* 1. Fichier hugetlbfs */
+    fd = open(chemin_enorme, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd != -1) {
+        adresse = MAP_FAILED;
+        if (ftruncate(fd, taille_enorme) == 0) {
+            adresse = mapper_posix(fd, taille_enorme, 1);
+        }
+        close(fd);
+        if (adresse != MAP_FAILED) {
+            taille_mappee = taille_enorme;
+            mlock(adresse, taille_mappee);
+            return adresse;
+        }
+        unlink(chemin_enorme);
+    }
+    chemin_enorme[0] = '\0';
+    
+    /* 2. shm_open */
+    fd = shm_open(nom_posix, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd == -1) {
+        perror("[ERREUR] shm_open");
+        return NULL;
+    }
+    if (ftruncate(fd, taille) == -1) {
+        perror("[ERREUR] ftruncate");
+        close(fd);
+        return NULL;
+    }
+    adresse = mmap(NULL, taille, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (adresse == MAP_FAILED) {
+        perror("[ERREUR] mmap");
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(adresse, taille, MADV_HUGEPAGE);
+#endif
+    /* Pre-chargement apres le conseil, puis verrouillage */
+#ifdef MADV_POPULATE_WRITE
+    madvise(adresse, taille, MADV_POPULATE_WRITE);
+#endif
+    mlock(adresse, taille);
+    taille_mappee = taille;
+    return adresse;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : attacher_segment_posix
+ * Description : Ouvre le segment POSIX de l'instance (hugetlbfs d'abord,
+ *               puis shm_open) et le mappe avec pre-chargement
+ * Retour      : Adresse du segment, ou NULL si erreur
+ * -----------------------------------------------------------------------------
+ */
+static void *attacher_segment_posix(void) {
+    struct stat st;
+    void *adresse;
+    int enorme = 1;
+    int fd;
+    
+    fd = open(chemin_enorme, O_RDWR);
+    if (fd == -1) {
+        enorme = 0;
+        chemin_enorme[0] = '\0';
+        fd = shm_open(nom_posix, O_RDWR, 0666);
+    }
+    if (fd == -1) {
+        perror("[ERREUR] shm_open dans attacher_ipc");
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1) {
+        perror("[ERREUR] fstat dans attacher_ipc");
+        close(fd);
+        return NULL;
+    }
+    adresse = mapper_posix(fd, st.st_size, enorme);
+    close(fd);
+    if (adresse == MAP_FAILED) {
+        perror("[ERREUR] mmap dans attacher_ipc");
+        return NULL;
+    }
+    taille_mappee = st.st_size;
+    return adresse;
+}
+
 /* Union pour semctl (necessaire sur certains systemes) */
 union semun {
     int val;
@@ -40,22 +452,26 @@ union semun {
  * -----------------------------------------------------------------------------
  * Fonction    : creer_ipc
  * Description : Cree toutes les IPC necessaires a la simulation
- *               - Memoire partagee pour l'etat global
+ *               - Memoire partagee pour l'etat global, dimensionnee d'apres
+ *                 les nombres d'acteurs (en-tete + tableaux)
  *               - Semaphores pour la synchronisation
  *               - Files de messages pour la communication
- * Parametres  : nb_vendeurs, nb_caissiers, nb_clients
+ * Parametres  : nb_vendeurs, nb_caissiers, nb_clients, transport
  * Retour      : 0 si succes, -1 si erreur
  * -----------------------------------------------------------------------------
  */
-int creer_ipc(int nb_vendeurs, int nb_caissiers, int nb_clients) {
+int creer_ipc(int nb_vendeurs, int nb_caissiers, int nb_clients, int transport) {
     key_t key_shm, key_sem, key_msg_v, key_msg_c;
+    magasin_shm_t disposition;
     int nb_semaphores;
     union semun arg;
     int fd;
     int i;
     
+    lire_instance();
+    
     /* Creer le fichier pour ftok si necessaire */
-    fd = open(IPC_KEY_FILE, O_CREAT | O_RDWR, 0666);
+    fd = open(fichier_cle, O_CREAT | O_RDWR, 0666);
     if (fd == -1) {
         perror("[ERREUR] Creation fichier IPC");
         return -1;
@@ -63,10 +479,10 @@ int creer_ipc(int nb_vendeurs, int nb_caissiers, int nb_clients) {
     close(fd);
     
     /* Generer les cles IPC avec ftok */
-    key_shm = ftok(IPC_KEY_FILE, SHM_KEY_ID);
-    key_sem = ftok(IPC_KEY_FILE, SEM_KEY_ID);
-    key_msg_v = ftok(IPC_KEY_FILE, MSG_VENDEUR_KEY_ID);
-    key_msg_c = ftok(IPC_KEY_FILE, MSG_CAISSIER_KEY_ID);
+    key_shm = ftok(fichier_cle, SHM_KEY_ID);
+    key_sem = ftok(fichier_cle, SEM_KEY_ID);
+    key_msg_v = ftok(fichier_cle, MSG_VENDEUR_KEY_ID);
+    key_msg_c = ftok(fichier_cle, MSG_CAISSIER_KEY_ID);
     
     if (key_shm == -1 || key_sem == -1 || key_msg_v == -1 || key_msg_c == -1) {
         perror("[ERREUR] ftok");
@@ -75,38 +491,52 @@ int creer_ipc(int nb_vendeurs, int nb_caissiers, int nb_clients) {
     
     /* ===== MEMOIRE PARTAGEE ===== */
     
-    /* Creer le segment de memoire partagee */
-    shm_id = shmget(key_shm, sizeof(magasin_shm_t), IPC_CREAT | IPC_EXCL | 0666);
-    if (shm_id == -1) {
-        if (errno == EEXIST) {
-            /* Le segment existe deja, le supprimer et recreer */
-            shm_id = shmget(key_shm, sizeof(magasin_shm_t), 0666);
-            if (shm_id != -1) {
-                shmctl(shm_id, IPC_RMID, NULL);
-            }
-            shm_id = shmget(key_shm, sizeof(magasin_shm_t), IPC_CREAT | 0666);
-        }
-        if (shm_id == -1) {
-            perror("[ERREUR] shmget");
-            return -1;
-        }
-    }
+    /* Taille du segment d'apres les nombres d'acteurs */
+    memset(&disposition, 0, sizeof(disposition));
+    calculer_disposition(&disposition, nb_vendeurs, nb_caissiers, nb_clients, transport);
     
-    /* Attacher la memoire partagee */
-    shm = (magasin_shm_t *)shmat(shm_id, NULL, 0);
-    if (shm == (void *)-1) {
-        perror("[ERREUR] shmat");
+    /* Creer le segment : System V, ou POSIX (shm_open + mmap) */
+    if (nom_posix[0] != '\0') {
+        shm = creer_segment_posix(disposition.taille_segment);
+    } else {
+        shm = creer_segment_sysv(key_shm, disposition.taille_segment);
+    }
+    if (shm == NULL) {
         return -1;
     }
     
-    /* Initialiser la memoire partagee */
-    memset(shm, 0, sizeof(magasin_shm_t));
+    /* Initialiser la memoire partagee : en-tete puis tableaux */
+    memset(shm, 0, disposition.taille_segment);
+    memcpy(shm, &disposition, sizeof(disposition));
+    lier_zones();
     shm->nb_vendeurs = nb_vendeurs;
     shm->nb_caissiers = nb_caissiers;
     shm->nb_clients = nb_clients;
     shm->simulation_active = 0;
     shm->clients_termines = 0;
     shm->pid_initial = getpid();
+    shm->transport = transport;
+    shm->protocole = PROTOCOLE_V2;
+    shm->messages_envoyes = 0;
+    shm->memoire_posix = (nom_posix[0] != '\0');
+    shm->pages_enormes = (chemin_enorme[0] != '\0');
+    
+    /* Index des longueurs de file : tous les acteurs a 0 client */
+    index_init(shm_index_vendeurs, nb_vendeurs);
+    index_init(shm_index_caissiers, nb_caissiers);
+    
+    /* Anneaux de requetes (reserves si transport = TRANSPORT_ANNEAU) */
+    for (i = 0; shm_anneaux_vendeurs != NULL && i < nb_vendeurs; i++) {
+        anneau_init(&shm_anneaux_vendeurs[i]);
+    }
+    for (i = 0; shm_anneaux_caissiers != NULL && i < nb_caissiers; i++) {
+        anneau_init(&shm_anneaux_caissiers[i]);
+    }
+    
+    /* Journaux des traces (vides, processus journal pas encore lance) */
+    for (i = 0; i < shm->nb_journaux; i++) {
+        journal_init(&shm_journaux[i]);
+    }
     
     /* ===== SEMAPHORES ===== */
     
@@ -193,44 +623,209 @@ int creer_ipc(int nb_vendeurs, int nb_caissiers, int nb_clients) {
         }
     }
     
+    /* Par defaut, les reponses partagent les files des requetes */
+    msg_reponse_vendeur_id = msg_vendeur_id;
+    msg_reponse_caissier_id = msg_caissier_id;
+    shm->file_reponses = -1;
+    
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : creer_files_acteurs
+ * Description : Cree les files privees du mode TRANSPORT_FILES
+ *               - une file par vendeur et par caissier : chacune a sa propre
+ *                 limite d'octets et ne contient que ses requetes
+ *               - une file pour toutes les reponses aux clients
+ *               Les IDs (IPC_PRIVATE) sont publies en memoire partagee.
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int creer_files_acteurs(void) {
+    int i;
+    
+    files_creees = malloc((shm->nb_vendeurs + shm->nb_caissiers + 1) * sizeof(int));
+    if (!files_creees) {
+        perror("[ERREUR] malloc");
+        return -1;
+    }
+    
+    for (i = 0; i < shm->nb_vendeurs + shm->nb_caissiers + 1; i++) {
+        int id = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+        if (id == -1) {
+            perror("[ERREUR] msgget file acteur");
+            return -1;
+        }
+        files_creees[nb_files_creees++] = id;
+        
+        if (i < shm->nb_vendeurs) {
+            shm_files_vendeurs[i] = id;
+        } else if (i < shm->nb_vendeurs + shm->nb_caissiers) {
+            shm_files_caissiers[i - shm->nb_vendeurs] = id;
+        } else {
+            shm->file_reponses = id;
+        }
+    }
+    
+    msg_reponse_vendeur_id = shm->file_reponses;
+    msg_reponse_caissier_id = shm->file_reponses;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : creer_boites_threads
+ * Description : Cree les boites du mode TRANSPORT_THREADS
+ *               - une boite de requetes par vendeur et par caissier
+ *               - une boite par client pour ses reponses et, en protocole 2,
+ *                 la decision que son vendeur attend (type de la session)
+ *               Les acteurs etant des threads du processus initial, aucun
+ *               ID n'est publie en memoire partagee.
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int creer_boites_threads(void) {
+    int i;
+    
+    boites_vendeurs = malloc(shm->nb_vendeurs * sizeof(boite_t));
+    boites_caissiers = malloc(shm->nb_caissiers * sizeof(boite_t));
+    boites_clients = malloc(shm->nb_clients * sizeof(boite_t));
+    if (!boites_vendeurs || !boites_caissiers || !boites_clients) {
+        perror("[ERREUR] malloc boites");
+        return -1;
+    }
+    
+    nb_boites_vendeurs = shm->nb_vendeurs;
+    nb_boites_caissiers = shm->nb_caissiers;
+    nb_boites_clients = shm->nb_clients;
+    for (i = 0; i < nb_boites_vendeurs; i++) {
+        boite_init(&boites_vendeurs[i]);
+    }
+    for (i = 0; i < nb_boites_caissiers; i++) {
+        boite_init(&boites_caissiers[i]);
+    }
+    for (i = 0; i < nb_boites_clients; i++) {
+        boite_init(&boites_clients[i]);
+    }
     return 0;
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : fermer_boites_threads
+ * Description : Ferme toutes les boites du mode threads (arret sur signal
+ *               ou echec de creation) : chaque acteur en attente recoit
+ *               une erreur (EIDRM, comme sur une file detruite) et termine,
+ *               sans que les IPC soient encore detruites
+ * -----------------------------------------------------------------------------
+ */
+void fermer_boites_threads(void) {
+    int i;
+    
+    if (boites_vendeurs == NULL) {
+        return;
+    }
+    for (i = 0; i < nb_boites_vendeurs; i++) {
+        boite_fermer(&boites_vendeurs[i]);
+    }
+    for (i = 0; i < nb_boites_caissiers; i++) {
+        boite_fermer(&boites_caissiers[i]);
+    }
+    for (i = 0; i < nb_boites_clients; i++) {
+        boite_fermer(&boites_clients[i]);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : detruire_boites_threads
+ * Description : Libere les boites du mode threads
+ *               A appeler une fois tous les threads acteurs termines (pas
+ *               depuis un gestionnaire de signal : des threads peuvent encore
+ *               attendre sur les boites, la fin du processus suffit alors)
+ * -----------------------------------------------------------------------------
+ */
+void detruire_boites_threads(void) {
+    int i;
+    
+    if (boites_vendeurs == NULL) {
+        return;
+    }
+    for (i = 0; i < nb_boites_vendeurs; i++) {
+        boite_detruire(&boites_vendeurs[i]);
+    }
+    for (i = 0; i < nb_boites_caissiers; i++) {
+        boite_detruire(&boites_caissiers[i]);
+    }
+    for (i = 0; i < nb_boites_clients; i++) {
+        boite_detruire(&boites_clients[i]);
+    }
+    free(boites_vendeurs);
+    free(boites_caissiers);
+    free(boites_clients);
+    boites_vendeurs = NULL;
+    boites_caissiers = NULL;
+    boites_clients = NULL;
+}
+
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : attacher_ipc
  * Description : Attache les IPC existantes (appele par les processus fils
- *               apres fork/exec)
+ *               apres fork/exec) ; mesure la duree de l'attachement de la
+ *               memoire et les fautes de page qu'il provoque (bilan_memoire)
  * Retour      : 0 si succes, -1 si erreur
  * -----------------------------------------------------------------------------
  */
 int attacher_ipc(void) {
     key_t key_shm, key_sem, key_msg_v, key_msg_c;
+    long long debut;
+    long fautes;
+    
+    lire_instance();
     
     /* Generer les cles IPC */
-    key_shm = ftok(IPC_KEY_FILE, SHM_KEY_ID);
-    key_sem = ftok(IPC_KEY_FILE, SEM_KEY_ID);
-    key_msg_v = ftok(IPC_KEY_FILE, MSG_VENDEUR_KEY_ID);
-    key_msg_c = ftok(IPC_KEY_FILE, MSG_CAISSIER_KEY_ID);
+    key_shm = ftok(fichier_cle, SHM_KEY_ID);
+    key_sem = ftok(fichier_cle, SEM_KEY_ID);
+    key_msg_v = ftok(fichier_cle, MSG_VENDEUR_KEY_ID);
+    key_msg_c = ftok(fichier_cle, MSG_CAISSIER_KEY_ID);
     
     if (key_shm == -1 || key_sem == -1 || key_msg_v == -1 || key_msg_c == -1) {
         perror("[ERREUR] ftok dans attacher_ipc");
         return -1;
     }
     
-    /* Recuperer la memoire partagee */
-    shm_id = shmget(key_shm, sizeof(magasin_shm_t), 0666);
-    if (shm_id == -1) {
-        perror("[ERREUR] shmget dans attacher_ipc");
-        return -1;
-    }
+    debut = horloge_ns();
+    fautes = fautes_mineures();
     
-    /* Attacher la memoire partagee */
-    shm = (magasin_shm_t *)shmat(shm_id, NULL, 0);
-    if (shm == (void *)-1) {
-        perror("[ERREUR] shmat dans attacher_ipc");
-        return -1;
+    if (nom_posix[0] != '\0') {
+        /* Memoire POSIX : mmap pre-charge (MAP_POPULATE) */
+        shm = attacher_segment_posix();
+        if (shm == NULL) {
+            return -1;
+        }
+    } else {
+        /* Recuperer la memoire partagee (taille lue dans l'en-tete) */
+        shm_id = shmget(key_shm, 0, 0666);
+        if (shm_id == -1) {
+            perror("[ERREUR] shmget dans attacher_ipc");
+            return -1;
+        }
+        
+        /* Attacher la memoire partagee */
+        shm = (magasin_shm_t *)shmat(shm_id, NULL, 0);
+        if (shm == (void *)-1) {
+            perror("[ERREUR] shmat dans attacher_ipc");
+            shm = NULL;
+            return -1;
+        }
     }
+    lier_zones();
+    
+    attache_ns = horloge_ns() - debut;
+    fautes_apres_attache = fautes_mineures();
+    fautes_attache = fautes_apres_attache - fautes;
     
     /* Recuperer les semaphores */
     sem_id = semget(key_sem, 0, 0666);
@@ -252,6 +847,15 @@ int attacher_ipc(void) {
         return -1;
     }
     
+    /* File des reponses publiee en memoire partagee (TRANSPORT_FILES) */
+    if (shm->file_reponses != -1) {
+        msg_reponse_vendeur_id = shm->file_reponses;
+        msg_reponse_caissier_id = shm->file_reponses;
+    } else {
+        msg_reponse_vendeur_id = msg_vendeur_id;
+        msg_reponse_caissier_id = msg_caissier_id;
+    }
+    
     return 0;
 }
 
@@ -263,8 +867,27 @@ int attacher_ipc(void) {
  */
 void detacher_ipc(void) {
     if (shm != NULL && shm != (void *)-1) {
-        shmdt(shm);
+        if (taille_mappee > 0) {
+            munmap(shm, taille_mappee);
+            taille_mappee = 0;
+        } else {
+            shmdt(shm);
+        }
         shm = NULL;
+        shm_vendeurs = NULL;
+        shm_caissiers = NULL;
+        shm_attente_vendeurs = NULL;
+        shm_attente_caissiers = NULL;
+        shm_index_vendeurs = NULL;
+        shm_index_caissiers = NULL;
+        shm_annuaire = NULL;
+        shm_achats = NULL;
+        shm_places = NULL;
+        shm_files_vendeurs = NULL;
+        shm_files_caissiers = NULL;
+        shm_anneaux_vendeurs = NULL;
+        shm_anneaux_caissiers = NULL;
+        shm_journaux = NULL;
     }
 }
 
@@ -299,43 +922,152 @@ void detruire_ipc(void) {
         msg_caissier_id = -1;
     }
     
+    /* Detruire les files privees par acteur */
+    while (nb_files_creees > 0) {
+        msgctl(files_creees[--nb_files_creees], IPC_RMID, NULL);
+    }
+    free(files_creees);
+    files_creees = NULL;
+    msg_reponse_vendeur_id = -1;
+    msg_reponse_caissier_id = -1;
+    
+    /* Detruire le segment POSIX (fichier hugetlbfs ou objet shm_open) */
+    if (chemin_enorme[0] != '\0') {
+        unlink(chemin_enorme);
+    } else if (nom_posix[0] != '\0') {
+        shm_unlink(nom_posix);
+    }
+    
     /* Supprimer le fichier de cle */
-    unlink(IPC_KEY_FILE);
+    unlink(fichier_cle);
 }
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : sem_P
- * Description : Operation P (wait/proberen) sur un semaphore
- *               Decremente le semaphore de 1, bloque si <= 0
- * Parametre   : sem_index - index du semaphore dans l'ensemble
- * Retour      : 0 si succes, -1 si erreur
+ * Fonction    : futex_attendre / futex_reveiller
+ * Description : Appels systeme futex sur un mot en memoire partagee
+ *               (pas de FUTEX_PRIVATE_FLAG : le mot est partage entre
+ *               processus)
  * -----------------------------------------------------------------------------
  */
-int sem_P(int sem_index) {
-    struct sembuf op = {sem_index, -1, 0};
-    
-    if (semop(sem_id, &op, 1) == -1) {
-        if (errno != EINTR) {
-            perror("[ERREUR] semop P");
-        }
-        return -1;
-    }
-    return 0;
+static void futex_attendre(int *adresse, int valeur) {
+    syscall(SYS_futex, adresse, FUTEX_WAIT, valeur, NULL, NULL, 0);
+}
+
+static void futex_reveiller(int *adresse, int nombre) {
+    syscall(SYS_futex, adresse, FUTEX_WAKE, nombre, NULL, NULL, 0);
 }
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : sem_V
- * Description : Operation V (signal/verhogen) sur un semaphore
- *               Incremente le semaphore de 1
- * Parametre   : sem_index - index du semaphore dans l'ensemble
- * Retour      : 0 si succes, -1 si erreur
+ * Fonction    : pause_cpu
+ * Description : Indique au processeur une boucle d'attente active
  * -----------------------------------------------------------------------------
  */
-int sem_V(int sem_index) {
+static inline void pause_cpu(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : verrou_prendre
+ * Description : Prend le verrou (mutex futex d'apres U. Drepper)
+ *               1. CAS 0 -> 1 : cas non conteste, aucun appel systeme
+ *               2. Attente active courte (VERROU_SPIN essais)
+ *               3. Passage a l'etat 2 et sommeil FUTEX_WAIT
+ * Parametre   : v - verrou en memoire partagee
+ * -----------------------------------------------------------------------------
+ */
+void verrou_prendre(verrou_t *v) {
+    int attendu;
+    int i;
+    
+    /* Chemin rapide : verrou libre */
+    attendu = 0;
+    if (__atomic_compare_exchange_n(&v->etat, &attendu, 1, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    
+    /* Attente active : le detenteur libere souvent tres vite */
+    for (i = 0; i < VERROU_SPIN; i++) {
+        pause_cpu();
+        attendu = 0;
+        if (__atomic_load_n(&v->etat, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&v->etat, &attendu, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+    
+    /* Contention : signaler un attenteur (etat 2) et dormir */
+    while (__atomic_exchange_n(&v->etat, 2, __ATOMIC_ACQUIRE) != 0) {
+        futex_attendre(&v->etat, 2);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : verrou_rendre
+ * Description : Libere le verrou ; FUTEX_WAKE uniquement si un processus
+ *               a pu s'endormir (etat 2)
+ * Parametre   : v - verrou en memoire partagee
+ * -----------------------------------------------------------------------------
+ */
+void verrou_rendre(verrou_t *v) {
+    if (__atomic_exchange_n(&v->etat, 0, __ATOMIC_RELEASE) == 2) {
+        futex_reveiller(&v->etat, 1);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : sem_P
+ * Description : Operation P (wait/proberen) sur un semaphore
+ *               Decremente le semaphore de 1, bloque si <= 0
+ *               Le mutex SEM_MUTEX_SHM est un verrou futex en memoire
+ *               partagee (pas d'appel systeme sans contention)
+ * Parametre   : sem_index - index du semaphore dans l'ensemble
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int sem_P(int sem_index) {
+    struct sembuf op = {sem_index, -1, 0};
+    
+    if (sem_index == SEM_MUTEX_SHM && shm != NULL) {
+        verrou_prendre(&shm->verrou_shm);
+        return 0;
+    }
+    
+    if (semop(sem_id, &op, 1) == -1) {
+        if (errno != EINTR) {
+            perror("[ERREUR] semop P");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : sem_V
+ * Description : Operation V (signal/verhogen) sur un semaphore
+ *               Incremente le semaphore de 1
+ *               SEM_MUTEX_SHM : liberation du verrou futex
+ * Parametre   : sem_index - index du semaphore dans l'ensemble
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int sem_V(int sem_index) {
     struct sembuf op = {sem_index, 1, 0};
     
+    if (sem_index == SEM_MUTEX_SHM && shm != NULL) {
+        verrou_rendre(&shm->verrou_shm);
+        return 0;
+    }
+    
     if (semop(sem_id, &op, 1) == -1) {
         perror("[ERREUR] semop V");
         return -1;
@@ -365,66 +1097,1354 @@ int sem_wait_zero(int sem_index) {
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : trouver_vendeur_moins_charge
- * Description : Trouve le vendeur avec la file d'attente la plus courte
- * Retour      : Index du vendeur le moins charge
- * Note        : Doit etre appele avec le mutex SHM verrouille
+ * Fonction    : recevoir_message
+ * Description : Reception bloquante d'un message de type mtype
+ *               Le noyau ne reveille le processus qu'a l'arrivee d'un message
+ *               de ce type ; un signal (SIGINT) interrompt l'attente avec
+ *               EINTR, et la destruction de la file avec EIDRM
+ * Parametres  :
+ *   - file_id : identifiant de la file de messages
+ *   - msg     : buffer de reception (mtype inclus)
+ *   - taille  : taille du message sans le mtype
+ *   - mtype   : type de message attendu
+ * Retour      : 0 si succes, -1 si interrompu ou erreur (errno positionne)
  * -----------------------------------------------------------------------------
  */
-int trouver_vendeur_moins_charge(void) {
-    int idx = 0;
-    int min_file = shm->vendeurs[0].file_attente;
-    int i;
+int recevoir_message(int file_id, void *msg, size_t taille, long mtype) {
+    struct timespec debut;
+    ssize_t ret;
+    
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    ret = msgrcv(file_id, msg, taille, mtype, 0);
+    compter_reveil(&debut);
     
-    for (i = 1; i < shm->nb_vendeurs; i++) {
-        if (shm->vendeurs[i].file_attente < min_file) {
-            min_file = shm->vendeurs[i].file_attente;
-            idx = i;
+    return (ret == -1) ? -1 : 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : attendre_boite
+ * Description : Reception bloquante dans une boite du mode threads, comptee
+ *               comme un reveil (meme bilan que recevoir_message)
+ * Parametres  : b, msg (mtype inclus), taille (mtype inclus), mtype
+ * Retour      : 0 si succes, -1 (errno = EIDRM) si la boite est fermee
+ * -----------------------------------------------------------------------------
+ */
+static int attendre_boite(boite_t *b, void *msg, size_t taille, long mtype) {
+    struct timespec debut;
+    int ret;
+    
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    ret = boite_retirer(b, msg, taille, mtype);
+    compter_reveil(&debut);
+    return ret;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : anneau_init
+ * Description : Initialise un anneau vide : la cellule i attend le
+ *               producteur de la position i
+ * Parametre   : a - anneau a initialiser
+ * -----------------------------------------------------------------------------
+ */
+void anneau_init(anneau_t *a) {
+    unsigned int i;
+    
+    memset(a, 0, sizeof(anneau_t));
+    for (i = 0; i < TAILLE_ANNEAU; i++) {
+        a->cellules[i].sequence = i;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : journal_init
+ * Description : Initialise un journal de traces vide (cellule i libre pour
+ *               le tour de la position i, comme anneau_init)
+ * Parametre   : j
+ * -----------------------------------------------------------------------------
+ */
+void journal_init(journal_t *j) {
+    unsigned int i;
+    
+    memset(j, 0, sizeof(journal_t));
+    for (i = 0; i < TAILLE_JOURNAL; i++) {
+        j->traces[i].sequence = i;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : anneau_deposer
+ * Description : Depose un message dans l'anneau (file bornee de D. Vyukov)
+ *               1. Reserver la position par CAS sur ecriture
+ *               2. Copier le message dans la cellule
+ *               3. Publier (sequence = position + 1, release)
+ *               4. Incrementer signal et reveiller le consommateur s'il dort
+ * Parametres  : a, msg, taille (mtype inclus)
+ * Retour      : 0 si succes, -1 si l'anneau est plein
+ * -----------------------------------------------------------------------------
+ */
+int anneau_deposer(anneau_t *a, const void *msg, size_t taille) {
+    cellule_anneau_t *cellule;
+    unsigned int pos = __atomic_load_n(&a->ecriture, __ATOMIC_RELAXED);
+    
+    for (;;) {
+        cellule = &a->cellules[pos & (TAILLE_ANNEAU - 1)];
+        unsigned int seq = __atomic_load_n(&cellule->sequence, __ATOMIC_ACQUIRE);
+        int diff = (int)(seq - pos);
+        
+        if (diff == 0) {
+            /* Cellule libre pour ce tour : tenter de la reserver */
+            if (__atomic_compare_exchange_n(&a->ecriture, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Le consommateur n'a pas encore libere la cellule : plein */
+            return -1;
+        } else {
+            /* Un autre producteur a pris cette position */
+            pos = __atomic_load_n(&a->ecriture, __ATOMIC_RELAXED);
         }
     }
-    return idx;
+    
+    memcpy(&cellule->msg, msg, taille);
+    __atomic_store_n(&cellule->sequence, pos + 1, __ATOMIC_RELEASE);
+    
+    /* Reveil : seq_cst, en miroir du consommateur (attente puis signal) */
+    __atomic_fetch_add(&a->signal, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&a->attente, __ATOMIC_SEQ_CST)) {
+        futex_reveiller(&a->signal, 1);
+    }
+    return 0;
 }
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : trouver_caissier_moins_charge
- * Description : Trouve le caissier avec la file d'attente la plus courte
- * Retour      : Index du caissier le moins charge
- * Note        : Doit etre appele avec le mutex SHM verrouille
+ * Fonction    : anneau_retirer
+ * Description : Retire le plus ancien message publie (consommateur unique)
+ *               et rend la cellule aux producteurs du tour suivant ;
+ *               incremente libere et reveille un producteur s'il en
+ *               attend une place (en miroir de anneau_deposer)
+ * Parametres  : a, msg (buffer de sortie), taille
+ * Retour      : 0 si un message a ete lu, -1 si l'anneau est vide
  * -----------------------------------------------------------------------------
  */
-int trouver_caissier_moins_charge(void) {
-    int idx = 0;
-    int min_file = shm->caissiers[0].file_attente;
-    int i;
+int anneau_retirer(anneau_t *a, void *msg, size_t taille) {
+    unsigned int pos = a->lecture;
+    cellule_anneau_t *cellule = &a->cellules[pos & (TAILLE_ANNEAU - 1)];
+    unsigned int seq = __atomic_load_n(&cellule->sequence, __ATOMIC_ACQUIRE);
+    
+    if ((int)(seq - (pos + 1)) < 0) {
+        return -1;  /* Rien de publie a cette position */
+    }
+    
+    memcpy(msg, &cellule->msg, taille);
+    __atomic_store_n(&cellule->sequence, pos + TAILLE_ANNEAU, __ATOMIC_RELEASE);
+    a->lecture = pos + 1;
+    
+    /* Une place de plus : une seule cellule, un seul producteur a reveiller */
+    __atomic_fetch_add(&a->libere, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&a->producteurs, __ATOMIC_SEQ_CST) > 0) {
+        futex_reveiller(&a->libere, 1);
+    }
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : anneau_deposer_attendre
+ * Description : Depose un message ; si l'anneau est plein, le producteur
+ *               s'annonce (producteurs + 1), reessaie, puis dort sur le
+ *               futex libere jusqu'au prochain retrait. L'attente est
+ *               comptee dans le bilan comme celle du consommateur.
+ *               Un signal ne fait que relancer l'essai : la requete doit
+ *               partir.
+ * Parametres  : a, msg, taille
+ * -----------------------------------------------------------------------------
+ */
+void anneau_deposer_attendre(anneau_t *a, const void *msg, size_t taille) {
+    struct timespec debut;
+    
+    if (anneau_deposer(a, msg, taille) == 0) {
+        return;
+    }
     
-    for (i = 1; i < shm->nb_caissiers; i++) {
-        if (shm->caissiers[i].file_attente < min_file) {
-            min_file = shm->caissiers[i].file_attente;
-            idx = i;
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    __atomic_fetch_add(&a->producteurs, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+        int libere = __atomic_load_n(&a->libere, __ATOMIC_SEQ_CST);
+        
+        /* Un retrait a pu avoir lieu depuis le dernier essai */
+        if (anneau_deposer(a, msg, taille) == 0) {
+            break;
         }
+        futex_attendre(&a->libere, libere);
     }
-    return idx;
+    __atomic_fetch_sub(&a->producteurs, 1, __ATOMIC_SEQ_CST);
+    compter_reveil(&debut);
 }
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : trouver_vendeur_pour_rayon
- * Description : Trouve un vendeur competent pour un rayon donne
- * Parametre   : rayon - numero du rayon (0 a NB_RAYONS-1)
- * Retour      : Index du vendeur competent
- * Note        : Au moins un vendeur par rayon est garanti a l'initialisation
+ * Fonction    : anneau_attendre
+ * Description : Retire un message ; si l'anneau est vide, le consommateur
+ *               annonce qu'il dort (attente = 1), reverifie, puis dort sur
+ *               le futex signal jusqu'au prochain depot
+ * Parametres  : a, msg, taille
+ * Retour      : 0 si succes, -1 si interrompu par un signal (EINTR)
  * -----------------------------------------------------------------------------
  */
-int trouver_vendeur_pour_rayon(int rayon) {
+int anneau_attendre(anneau_t *a, void *msg, size_t taille) {
+    struct timespec debut;
+    int ret = 0;
+    
+    if (anneau_retirer(a, msg, taille) == 0) {
+        return 0;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    for (;;) {
+        int signal = __atomic_load_n(&a->signal, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&a->attente, 1, __ATOMIC_SEQ_CST);
+        
+        /* Un depot a pu avoir lieu entre le premier essai et ici */
+        if (anneau_retirer(a, msg, taille) == 0) {
+            break;
+        }
+        
+        if (syscall(SYS_futex, &a->signal, FUTEX_WAIT, signal,
+                    NULL, NULL, 0) == -1 && errno == EINTR) {
+            ret = -1;
+            break;
+        }
+        if (anneau_retirer(a, msg, taille) == 0) {
+            break;
+        }
+    }
+    __atomic_store_n(&a->attente, 0, __ATOMIC_SEQ_CST);
+    compter_reveil(&debut);
+    
+    if (ret == -1) {
+        errno = EINTR;
+    }
+    return ret;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : envoyer_requete_vendeur
+ * Description : Envoie une requete client -> vendeur (msg->vendeur_id)
+ *               TRANSPORT_SYSV   : msgsnd sur la file des vendeurs
+ *               TRANSPORT_ANNEAU : depot dans l'anneau du vendeur
+ *               TRANSPORT_THREADS : depot dans la boite du vendeur
+ * Parametre   : msg - requete (mtype positionne ici)
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int envoyer_requete_vendeur(msg_client_vendeur_t *msg) {
+    msg->mtype = msg->vendeur_id + 1;
+    compter_message();
+    
+    if (shm->transport == TRANSPORT_ANNEAU) {
+        /* Anneau plein (cas extreme) : dormir jusqu'au prochain retrait */
+        anneau_deposer_attendre(&shm_anneaux_vendeurs[msg->vendeur_id],
+                                msg, sizeof(*msg));
+        return 0;
+    }
+    if (shm->transport == TRANSPORT_THREADS) {
+        return boite_deposer(&boites_vendeurs[msg->vendeur_id], msg, sizeof(*msg));
+    }
+    if (shm->transport == TRANSPORT_FILES) {
+        return msgsnd(shm_files_vendeurs[msg->vendeur_id], msg,
+                      sizeof(*msg) - sizeof(long), 0);
+    }
+    return msgsnd(msg_vendeur_id, msg, sizeof(*msg) - sizeof(long), 0);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : envoyer_requete_caissier
+ * Description : Envoie une requete client -> caissier (msg->caissier_id)
+ * Parametre   : msg - requete (mtype positionne ici)
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int envoyer_requete_caissier(msg_client_caissier_t *msg) {
+    msg->mtype = msg->caissier_id + 1;
+    compter_message();
+    
+    if (shm->transport == TRANSPORT_ANNEAU) {
+        anneau_deposer_attendre(&shm_anneaux_caissiers[msg->caissier_id],
+                                msg, sizeof(*msg));
+        return 0;
+    }
+    if (shm->transport == TRANSPORT_THREADS) {
+        return boite_deposer(&boites_caissiers[msg->caissier_id], msg, sizeof(*msg));
+    }
+    if (shm->transport == TRANSPORT_FILES) {
+        return msgsnd(shm_files_caissiers[msg->caissier_id], msg,
+                      sizeof(*msg) - sizeof(long), 0);
+    }
+    return msgsnd(msg_caissier_id, msg, sizeof(*msg) - sizeof(long), 0);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : envoyer_reponse_vendeur / envoyer_reponse_caissier
+ * Description : Envoie une reponse a un client sur la file des reponses
+ *               (file dediee en TRANSPORT_FILES, boite du client en
+ *               TRANSPORT_THREADS, sinon file des requetes)
+ * Parametres  : client_id - destinataire, msg - reponse (mtype positionne ici)
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int envoyer_reponse_vendeur(int client_id, msg_vendeur_client_t *msg) {
+    msg->mtype = MTYPE_REPONSE_VENDEUR(client_id);
+    compter_message();
+    if (shm->transport == TRANSPORT_THREADS) {
+        return boite_deposer(&boites_clients[client_id], msg, sizeof(*msg));
+    }
+    return msgsnd(msg_reponse_vendeur_id, msg, sizeof(*msg) - sizeof(long), 0);
+}
+
+int envoyer_reponse_caissier(int client_id, msg_caissier_client_t *msg) {
+    msg->mtype = MTYPE_REPONSE_CAISSIER(client_id);
+    compter_message();
+    if (shm->transport == TRANSPORT_THREADS) {
+        return boite_deposer(&boites_clients[client_id], msg, sizeof(*msg));
+    }
+    return msgsnd(msg_reponse_caissier_id, msg, sizeof(*msg) - sizeof(long), 0);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : envoyer_decision / recevoir_decision
+ * Description : Decision d'achat (deux protocoles) : elle voyage sur la file des
+ *               reponses vendeur avec le type de la session du client, le
+ *               vendeur l'attend donc sans toucher a sa boite de requetes
+ * Parametres  : msg (client_id renseigne) / client_id de la session
+ * Retour      : 0 si succes, -1 si erreur ou interruption
+ * -----------------------------------------------------------------------------
+ */
+int envoyer_decision(msg_client_vendeur_t *msg) {
+    msg->mtype = MTYPE_DECISION(msg->client_id);
+    compter_message();
+    if (shm->transport == TRANSPORT_THREADS) {
+        return boite_deposer(&boites_clients[msg->client_id], msg, sizeof(*msg));
+    }
+    return msgsnd(msg_reponse_vendeur_id, msg, sizeof(*msg) - sizeof(long), 0);
+}
+
+int recevoir_decision(int client_id, msg_client_vendeur_t *msg) {
+    if (shm->transport == TRANSPORT_THREADS) {
+        return attendre_boite(&boites_clients[client_id], msg, sizeof(*msg),
+                              MTYPE_DECISION(client_id));
+    }
+    return recevoir_message(msg_reponse_vendeur_id, msg,
+                            sizeof(*msg) - sizeof(long), MTYPE_DECISION(client_id));
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : recevoir_reponse_vendeur / recevoir_reponse_caissier
+ * Description : Reception bloquante d'une reponse destinee a un client
+ * Parametres  : client_id, msg (buffer de sortie)
+ * Retour      : 0 si succes, -1 si interrompu (EINTR) ou file detruite
+ * -----------------------------------------------------------------------------
+ */
+int recevoir_reponse_vendeur(int client_id, msg_vendeur_client_t *msg) {
+    if (shm->transport == TRANSPORT_THREADS) {
+        return attendre_boite(&boites_clients[client_id], msg, sizeof(*msg),
+                              MTYPE_REPONSE_VENDEUR(client_id));
+    }
+    return recevoir_message(msg_reponse_vendeur_id, msg,
+                            sizeof(*msg) - sizeof(long), MTYPE_REPONSE_VENDEUR(client_id));
+}
+
+int recevoir_reponse_caissier(int client_id, msg_caissier_client_t *msg) {
+    if (shm->transport == TRANSPORT_THREADS) {
+        return attendre_boite(&boites_clients[client_id], msg, sizeof(*msg),
+                              MTYPE_REPONSE_CAISSIER(client_id));
+    }
+    return recevoir_message(msg_reponse_caissier_id, msg,
+                            sizeof(*msg) - sizeof(long), MTYPE_REPONSE_CAISSIER(client_id));
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : recevoir_requete_vendeur / recevoir_requete_caissier
+ * Description : Reception bloquante de la prochaine requete adressee a ce
+ *               vendeur (ou caissier), par le transport choisi
+ * Parametres  : id du destinataire, msg (buffer de sortie)
+ * Retour      : 0 si succes, -1 si interrompu (EINTR) ou file detruite
+ * -----------------------------------------------------------------------------
+ */
+int recevoir_requete_vendeur(int vendeur_id, msg_client_vendeur_t *msg) {
+    if (shm->transport == TRANSPORT_ANNEAU) {
+        return anneau_attendre(&shm_anneaux_vendeurs[vendeur_id], msg, sizeof(*msg));
+    }
+    if (shm->transport == TRANSPORT_THREADS) {
+        return attendre_boite(&boites_vendeurs[vendeur_id], msg, sizeof(*msg), 0);
+    }
+    if (shm->transport == TRANSPORT_FILES) {
+        return recevoir_message(shm_files_vendeurs[vendeur_id], msg,
+                                sizeof(*msg) - sizeof(long), vendeur_id + 1);
+    }
+    return recevoir_message(msg_vendeur_id, msg, sizeof(*msg) - sizeof(long),
+                            vendeur_id + 1);
+}
+
+int recevoir_requete_caissier(int caissier_id, msg_client_caissier_t *msg) {
+    if (shm->transport == TRANSPORT_ANNEAU) {
+        return anneau_attendre(&shm_anneaux_caissiers[caissier_id], msg, sizeof(*msg));
+    }
+    if (shm->transport == TRANSPORT_THREADS) {
+        return attendre_boite(&boites_caissiers[caissier_id], msg, sizeof(*msg), 0);
+    }
+    if (shm->transport == TRANSPORT_FILES) {
+        return recevoir_message(shm_files_caissiers[caissier_id], msg,
+                                sizeof(*msg) - sizeof(long), caissier_id + 1);
+    }
+    return recevoir_message(msg_caissier_id, msg, sizeof(*msg) - sizeof(long),
+                            caissier_id + 1);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : envoyer_arret
+ * Description : Debloque les vendeurs et caissiers en attente de message
+ *               Un message avec client_id = -1 signifie "fin de service" ;
+ *               il couvre le cas ou le SIGINT arrive juste avant msgrcv
+ * -----------------------------------------------------------------------------
+ */
+void envoyer_arret(void) {
+    msg_client_vendeur_t msg_v;
+    msg_client_caissier_t msg_c;
     int i;
     
+    memset(&msg_v, 0, sizeof(msg_v));
+    msg_v.client_id = -1;
     for (i = 0; i < shm->nb_vendeurs; i++) {
-        if (shm->vendeurs[i].rayon == rayon) {
-            return i;
+        msg_v.mtype = i + 1;
+        msg_v.vendeur_id = i;
+        if (shm->transport == TRANSPORT_ANNEAU) {
+            anneau_deposer(&shm_anneaux_vendeurs[i], &msg_v, sizeof(msg_v));
+        } else if (shm->transport == TRANSPORT_THREADS) {
+            boite_deposer(&boites_vendeurs[i], &msg_v, sizeof(msg_v));
+        } else if (shm->transport == TRANSPORT_FILES) {
+            msgsnd(shm_files_vendeurs[i], &msg_v, sizeof(msg_v) - sizeof(long), IPC_NOWAIT);
+        } else {
+            msgsnd(msg_vendeur_id, &msg_v, sizeof(msg_v) - sizeof(long), IPC_NOWAIT);
         }
     }
     
-    /* Ne devrait jamais arriver car initialisation garantit 1 vendeur/rayon */
-    return 0;
+    memset(&msg_c, 0, sizeof(msg_c));
+    msg_c.client_id = -1;
+    for (i = 0; i < shm->nb_caissiers; i++) {
+        msg_c.mtype = i + 1;
+        msg_c.caissier_id = i;
+        if (shm->transport == TRANSPORT_ANNEAU) {
+            anneau_deposer(&shm_anneaux_caissiers[i], &msg_c, sizeof(msg_c));
+        } else if (shm->transport == TRANSPORT_THREADS) {
+            boite_deposer(&boites_caissiers[i], &msg_c, sizeof(msg_c));
+        } else if (shm->transport == TRANSPORT_FILES) {
+            msgsnd(shm_files_caissiers[i], &msg_c, sizeof(msg_c) - sizeof(long), IPC_NOWAIT);
+        } else {
+            msgsnd(msg_caissier_id, &msg_c, sizeof(msg_c) - sizeof(long), IPC_NOWAIT);
+        }
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : bilan_attente
+ * Description : Compare la reception bloquante a l'ancienne boucle de polling
+ *               Le polling se reveillait une fois par periode d'attente ; on
+ *               en deduit les reveils evites. Les totaux sont cumules en
+ *               memoire partagee pour le bilan du processus initial, puis
+ *               les compteurs du thread sont remis a zero.
+ * Parametres  :
+ *   - periode_polling_us : periode de l'ancien usleep (microsecondes)
+ *   - reveils            : reveils reellement effectues
+ *   - evites             : reveils a vide evites
+ *   - cpu_ms             : temps CPU (user + sys) du thread appelant
+ * -----------------------------------------------------------------------------
+ */
+void bilan_attente(long periode_polling_us, long *reveils, long *evites,
+                   double *cpu_ms) {
+    struct rusage usage;
+    long polling = (long)(attente_ns / (periode_polling_us * 1000LL));
+    
+    *reveils = nb_reveils;
+    *evites = (polling > nb_reveils) ? polling - nb_reveils : 0;
+    
+    getrusage(RUSAGE_THREAD, &usage);
+    *cpu_ms = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+    
+    if (shm != NULL) {
+        __atomic_fetch_add(&shm->reveils_total, *reveils, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shm->reveils_evites_total, *evites, __ATOMIC_RELAXED);
+    }
+    
+    /* Un travailleur recycle ne doit pas recompter ces attentes */
+    nb_reveils = 0;
+    attente_ns = 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : compter_lancement
+ * Description : Cumule la latence de lancement et le temps de preparation
+ *               d'un client (bilan du processus initial)
+ * Parametres  :
+ *   - lancement_ns   : du fork (ou de la fin du client precedent pour un
+ *                      travailleur recycle) au debut du processus client
+ *   - preparation_ns : initialisation du log et attachement des IPC
+ * -----------------------------------------------------------------------------
+ */
+void compter_lancement(long long lancement_ns, long long preparation_ns) {
+    __atomic_fetch_add(&shm->lancements, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shm->lancement_ns_total, lancement_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shm->preparation_ns_total, preparation_ns, __ATOMIC_RELAXED);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : bilan_memoire
+ * Description : Cumule en memoire partagee, pour le role de l'appelant, la
+ *               duree d'attachement du segment, les fautes de page mineures
+ *               provoquees par l'attachement et celles survenues depuis
+ *               (pendant le service). Sans effet si le processus n'a pas
+ *               appele attacher_ipc (processus initial, mode threads).
+ * Parametre   : role - ROLE_VENDEUR, ROLE_CAISSIER ou ROLE_CLIENT
+ * -----------------------------------------------------------------------------
+ */
+void bilan_memoire(int role) {
+    memoire_role_t *m;
+    long service;
+    
+    if (shm == NULL || role < 0 || role >= NB_ROLES || fautes_apres_attache == 0) {
+        return;
+    }
+    m = &shm->memoire[role];
+    service = fautes_mineures() - fautes_apres_attache;
+    __atomic_fetch_add(&m->attachements, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->attache_ns, attache_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->fautes_attache, fautes_attache, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->fautes_service, service, __ATOMIC_RELAXED);
+    
+    /* Un travailleur recycle (zygote) ne doit pas recompter l'attachement */
+    fautes_apres_attache = 0;
+}
+
+/* Vecteur de 4 entiers (extension GCC), lu a toute adresse alignee sur
+   un int */
+typedef int v4si_t __attribute__((vector_size(16), aligned(sizeof(int))));
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : indice_minimum
+ * Description : Indice de la plus petite valeur, le premier en cas d'egalite
+ *               Reduction vectorielle : chaque voie garde son minimum et
+ *               l'indice ou il a ete vu (selection par masque de
+ *               comparaison, sans branchement), puis les 4 voies et les
+ *               derniers elements sont compares un a un.
+ * Parametres  : valeurs (n >= 1 entiers), n
+ * Retour      : Indice du minimum
+ * Note        : Lecture sans verrou : chaque entier est lu d'un bloc, le
+ *               tableau entier est un instantane eventuellement perime
+ * -----------------------------------------------------------------------------
+ */
+int indice_minimum(const int *valeurs, int n) {
+    int meilleur = 0;
+    int min_valeur = valeurs[0];
+    int i = 1;
+    
+    if (n >= 4) {
+        v4si_t mini = *(const v4si_t *)valeurs;
+        v4si_t indices = {0, 1, 2, 3};
+        v4si_t courant = indices;
+        v4si_t pas = {4, 4, 4, 4};
+        int k;
+        
+        for (i = 4; i + 4 <= n; i += 4) {
+            v4si_t x = *(const v4si_t *)(valeurs + i);
+            v4si_t plus_petit = x < mini;
+            
+            courant += pas;
+            mini = (x & plus_petit) | (mini & ~plus_petit);
+            indices = (courant & plus_petit) | (indices & ~plus_petit);
+        }
+        
+        /* Reduction des 4 voies (egalite : plus petit indice) */
+        min_valeur = mini[0];
+        meilleur = indices[0];
+        for (k = 1; k < 4; k++) {
+            if (mini[k] < min_valeur || (mini[k] == min_valeur && indices[k] < meilleur)) {
+                min_valeur = mini[k];
+                meilleur = indices[k];
+            }
+        }
+    }
+    
+    /* Elements restants (indices superieurs : inegalite stricte) */
+    for (; i < n; i++) {
+        int v = valeurs[i];
+        
+        if (v < min_valeur) {
+            min_valeur = v;
+            meilleur = i;
+        }
+    }
+    return meilleur;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : taille_index
+ * Description : Taille d'un index de charge pour nb acteurs
+ * Parametre   : nb - nombre d'acteurs
+ * Retour      : Taille en octets (en-tete + masques)
+ * -----------------------------------------------------------------------------
+ */
+size_t taille_index(int nb) {
+    size_t mots = (nb + 63) / 64;
+    
+    return sizeof(index_charge_t) + (MAX_QUEUE + 1) * mots * sizeof(unsigned long long);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : index_init
+ * Description : Initialise l'index : les nb acteurs ont une file vide
+ * Parametres  : ix (zone de taille_index(nb) octets), nb
+ * -----------------------------------------------------------------------------
+ */
+void index_init(index_charge_t *ix, int nb) {
+    int i;
+    
+    ix->curseur = 0;
+    ix->nb = nb;
+    ix->mots = (nb + 63) / 64;
+    memset(ix->niveaux, 0, (MAX_QUEUE + 1) * ix->mots * sizeof(unsigned long long));
+    for (i = 0; i < nb; i++) {
+        ix->niveaux[i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : index_deplacer
+ * Description : Fait passer un acteur d'une longueur de file a une autre
+ *               Le bit est pose dans le nouveau niveau avant d'etre efface
+ *               de l'ancien : une recherche concurrente voit toujours
+ *               l'acteur dans au moins un niveau.
+ * Parametres  : ix, acteur, ancienne, nouvelle (0 a MAX_QUEUE)
+ * Note        : Appele sous le verrou de l'acteur (un seul deplacement a
+ *               la fois pour un acteur donne)
+ * -----------------------------------------------------------------------------
+ */
+void index_deplacer(index_charge_t *ix, int acteur, int ancienne, int nouvelle) {
+    unsigned long long bit = 1ULL << (acteur % 64);
+    int mot = acteur / 64;
+    
+    if (ancienne == nouvelle) {
+        return;
+    }
+    __atomic_fetch_or(&ix->niveaux[nouvelle * ix->mots + mot], bit, __ATOMIC_RELEASE);
+    __atomic_fetch_and(&ix->niveaux[ancienne * ix->mots + mot], ~bit, __ATOMIC_RELEASE);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : premier_bit
+ * Description : Premier acteur present dans un niveau, en partant de depart
+ *               et en revenant au debut apres le dernier mot
+ * Parametres  : masques (mots mots), mots, depart
+ * Retour      : Indice de l'acteur, ou -1 si le niveau est vide
+ * -----------------------------------------------------------------------------
+ */
+static int premier_bit(const unsigned long long *masques, int mots, int depart) {
+    int mot = depart / 64;
+    unsigned long long m = __atomic_load_n(&masques[mot], __ATOMIC_ACQUIRE)
+                         & (~0ULL << (depart % 64));
+    int k;
+    
+    /* Le mot de depart est relu en entier au dernier tour */
+    for (k = 0; k <= mots; k++) {
+        if (m != 0) {
+            return mot * 64 + __builtin_ctzll(m);
+        }
+        mot = (mot + 1 < mots) ? mot + 1 : 0;
+        m = __atomic_load_n(&masques[mot], __ATOMIC_ACQUIRE);
+    }
+    return -1;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : index_moins_charge
+ * Description : Acteur de plus petite longueur de file
+ *               Les niveaux sont parcourus par longueur croissante ; dans le
+ *               premier niveau non vide, on prend le premier acteur a partir
+ *               du curseur, puis le curseur passe a l'acteur suivant : les
+ *               acteurs a egalite sont choisis a tour de role.
+ * Parametres  : ix, attente (longueurs des files, pour le repli)
+ * Retour      : Indice de l'acteur
+ * Note        : Sans verrou ; si tous les niveaux semblent vides (acteur
+ *               deplace entre deux lectures), repli sur indice_minimum
+ * -----------------------------------------------------------------------------
+ */
+int index_moins_charge(index_charge_t *ix, const int *attente) {
+    int depart = (int)(__atomic_load_n(&ix->curseur, __ATOMIC_RELAXED) % (unsigned int)ix->nb);
+    int longueur, choix;
+    
+    for (longueur = 0; longueur <= MAX_QUEUE; longueur++) {
+        choix = premier_bit(&ix->niveaux[longueur * ix->mots], ix->mots, depart);
+        if (choix >= 0) {
+            __atomic_store_n(&ix->curseur, (unsigned int)choix + 1, __ATOMIC_RELAXED);
+            return choix;
+        }
+    }
+    return indice_minimum(attente, ix->nb);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : index_extremes
+ * Description : Longueurs extremes d'apres l'index : premier et dernier
+ *               niveaux non vides (O(MAX_QUEUE x mots), sans verrou)
+ * Parametres  : ix, min, max (resultats, 0 si l'index semble vide)
+ * -----------------------------------------------------------------------------
+ */
+void index_extremes(index_charge_t *ix, int *min, int *max) {
+    int longueur;
+    
+    *min = -1;
+    *max = 0;
+    for (longueur = 0; longueur <= MAX_QUEUE; longueur++) {
+        if (premier_bit(&ix->niveaux[longueur * ix->mots], ix->mots, 0) >= 0) {
+            if (*min < 0) {
+                *min = longueur;
+            }
+            *max = longueur;
+        }
+    }
+    if (*min < 0) {
+        *min = 0;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : fixer_file_vendeur / fixer_file_caissier
+ * Description : Publie la nouvelle longueur de la file d'un acteur et
+ *               deplace l'acteur dans l'index
+ * Parametres  : idx, longueur (0 a MAX_QUEUE)
+ * Note        : Appele sous le verrou de l'acteur
+ * -----------------------------------------------------------------------------
+ */
+void fixer_file_vendeur(int idx, int longueur) {
+    int ancienne = shm_attente_vendeurs[idx];
+    
+    __atomic_store_n(&shm_attente_vendeurs[idx], longueur, __ATOMIC_RELAXED);
+    index_deplacer(shm_index_vendeurs, idx, ancienne, longueur);
+}
+
+void fixer_file_caissier(int idx, int longueur) {
+    int ancienne = shm_attente_caissiers[idx];
+    
+    __atomic_store_n(&shm_attente_caissiers[idx], longueur, __ATOMIC_RELAXED);
+    index_deplacer(shm_index_caissiers, idx, ancienne, longueur);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : trouver_vendeur_moins_charge
+ * Description : Trouve le vendeur avec la file d'attente la plus courte
+ * Retour      : Index du vendeur le moins charge
+ * Note        : Aucun verrou requis : l'index est lu de facon atomique ;
+ *               l'instantane peut etre legerement perime
+ * -----------------------------------------------------------------------------
+ */
+int trouver_vendeur_moins_charge(void) {
+    return index_moins_charge(shm_index_vendeurs, shm_attente_vendeurs);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : trouver_caissier_moins_charge
+ * Description : Trouve le caissier avec la file d'attente la plus courte
+ * Retour      : Index du caissier le moins charge
+ * Note        : Aucun verrou requis (voir trouver_vendeur_moins_charge)
+ * -----------------------------------------------------------------------------
+ */
+int trouver_caissier_moins_charge(void) {
+    return index_moins_charge(shm_index_caissiers, shm_attente_caissiers);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : noter_equilibre
+ * Description : Mesure l'ecart entre la plus longue et la plus courte file
+ *               d'un groupe apres une reservation
+ * Parametres  : e (equilibre du groupe), ix (index du groupe), reprises
+ * -----------------------------------------------------------------------------
+ */
+static void noter_equilibre(equilibre_t *e, index_charge_t *ix, int reprises) {
+    int min, max, ecart, actuel;
+    
+    index_extremes(ix, &min, &max);
+    ecart = max - min;
+    __atomic_fetch_add(&e->reservations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->reprises, reprises, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->ecart_total, ecart, __ATOMIC_RELAXED);
+    actuel = __atomic_load_n(&e->ecart_max, __ATOMIC_RELAXED);
+    while (ecart > actuel &&
+           !__atomic_compare_exchange_n(&e->ecart_max, &actuel, ecart, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : tasser_queue
+ * Description : Regroupe les clients d'un anneau dont tous les emplacements
+ *               sont pris alors que des clients en sont sortis (emplacements
+ *               PLACE_LIBRE entre tete et fin) ; recalcule leurs positions.
+ *               Seul cas en O(MAX_QUEUE), rare : les sorties ont lieu le
+ *               plus souvent en tete.
+ * Parametre   : f (sous le verrou de l'acteur)
+ * -----------------------------------------------------------------------------
+ */
+static void tasser_queue(queue_clients_t *f) {
+    int lecture, ecriture = f->tete;
+    int id;
+    
+    for (lecture = f->tete; lecture < f->fin; lecture++) {
+        id = f->clients[lecture % MAX_QUEUE];
+        if (id != PLACE_LIBRE) {
+            f->clients[ecriture % MAX_QUEUE] = id;
+            shm_places[id] = ecriture;
+            ecriture++;
+        }
+    }
+    f->fin = ecriture;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : sequence_ouvrir
+ * Description : Debut d'une modification de fiche : la sequence devient
+ *               impaire avant toute ecriture
+ * Parametre   : sequence (sous le verrou de l'acteur : un seul ecrivain)
+ * -----------------------------------------------------------------------------
+ */
+void sequence_ouvrir(unsigned int *sequence) {
+    __atomic_store_n(sequence, *sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : sequence_fermer
+ * Description : Fin de la modification : la sequence redevient paire,
+ *               apres toutes les ecritures (release)
+ * Parametre   : sequence
+ * -----------------------------------------------------------------------------
+ */
+void sequence_fermer(unsigned int *sequence) {
+    __atomic_store_n(sequence, *sequence + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : inscrire
+ * Description : Ajoute un client en fin de file (sous le verrou de
+ *               l'acteur) et note sa position dans shm_places
+ * Parametres  : f, sequence (de la fiche), file (longueur), fixer
+ *               (fixer_file_*), idx, client_id
+ * Retour      : 0, FILE_PLEINE si MAX_QUEUE clients attendent deja
+ * -----------------------------------------------------------------------------
+ */
+static int inscrire(queue_clients_t *f, unsigned int *sequence, const int *file,
+                    void (*fixer)(int, int), int idx, int client_id) {
+    int n = *file;
+    
+    if (n >= MAX_QUEUE) {
+        return FILE_PLEINE;
+    }
+    sequence_ouvrir(sequence);
+    if (f->fin - f->tete == MAX_QUEUE) {
+        tasser_queue(f);
+    }
+    f->clients[f->fin % MAX_QUEUE] = client_id;
+    shm_places[client_id] = f->fin;
+    f->fin++;
+    fixer(idx, n + 1);
+    sequence_fermer(sequence);
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : desinscrire
+ * Description : Retire un client de la file en O(1) : son emplacement,
+ *               retrouve par shm_places, devient PLACE_LIBRE ; la tete
+ *               avance au-dela des emplacements libres (sous le verrou de
+ *               l'acteur, section de sequence ouverte par l'appelant). Rien
+ *               si le client n'est pas dans cette file.
+ * Parametres  : f, file (longueur), fixer (fixer_file_*), idx, client_id
+ * -----------------------------------------------------------------------------
+ */
+static void desinscrire(queue_clients_t *f, const int *file,
+                        void (*fixer)(int, int), int idx, int client_id) {
+    int place = shm_places[client_id];
+    
+    if (place < f->tete || place >= f->fin ||
+        f->clients[place % MAX_QUEUE] != client_id) {
+        return;
+    }
+    f->clients[place % MAX_QUEUE] = PLACE_LIBRE;
+    while (f->tete < f->fin && f->clients[f->tete % MAX_QUEUE] == PLACE_LIBRE) {
+        f->tete++;
+    }
+    fixer(idx, *file - 1);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : lire_queue
+ * Description : Clients d'une file dans l'ordre d'arrivee, sans verrou
+ * Parametres  : queue, ids (resultat), max
+ * Retour      : Nombre de clients copies
+ * -----------------------------------------------------------------------------
+ */
+int lire_queue(const queue_clients_t *queue, int *ids, int max) {
+    int tete = __atomic_load_n(&queue->tete, __ATOMIC_RELAXED);
+    int fin = __atomic_load_n(&queue->fin, __ATOMIC_RELAXED);
+    int n = 0;
+    int id;
+    
+    if (fin - tete > MAX_QUEUE) {
+        fin = tete + MAX_QUEUE;
+    }
+    for (; tete < fin && n < max; tete++) {
+        id = __atomic_load_n(&queue->clients[tete % MAX_QUEUE], __ATOMIC_RELAXED);
+        if (id != PLACE_LIBRE) {
+            ids[n++] = id;
+        }
+    }
+    return n;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : copier_fiche
+ * Description : Lecture seqlock d'une fiche : copie ses champs (occupe,
+ *               servis, encaisse), sa file et la longueur publiee, et
+ *               recommence si un ecrivain l'a modifiee pendant la copie.
+ *               Apres ESSAIS_INSTANTANE echecs, cede le processeur a
+ *               l'ecrivain (peut-etre preempte au milieu de sa
+ *               modification). Apres RELECTURES_MAX echecs (ecrivain mort
+ *               en pleine modification), rend la derniere copie marquee
+ *               perimee, avec la derniere sequence lue : l'appelant ne
+ *               reessaie que si elle change.
+ * Parametres  : sequence, occupe, servis, encaisse (NULL pour un vendeur),
+ *               queue, longueur, copie (resultat)
+ * Retour      : Nombre de relectures
+ * -----------------------------------------------------------------------------
+ */
+static int copier_fiche(const unsigned int *sequence, const int *occupe, const int *servis,
+                        const long *encaisse, const queue_clients_t *queue,
+                        const int *longueur, instantane_acteur_t *copie) {
+    unsigned int debut;
+    int relectures = 0;
+    
+    copie->perime = 0;
+    for (;;) {
+        debut = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+        if ((debut & 1) == 0) {
+            copie->occupe = __atomic_load_n(occupe, __ATOMIC_RELAXED);
+            copie->servis = __atomic_load_n(servis, __ATOMIC_RELAXED);
+            copie->encaisse = encaisse ? __atomic_load_n(encaisse, __ATOMIC_RELAXED) : 0;
+            copie->longueur = __atomic_load_n(longueur, __ATOMIC_RELAXED);
+            copie->nb_clients = lire_queue(queue, copie->clients, MAX_QUEUE);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(sequence, __ATOMIC_RELAXED) == debut) {
+                copie->sequence = debut;
+                return relectures;
+            }
+        }
+        relectures++;
+        if (relectures >= RELECTURES_MAX) {
+            copie->sequence = debut;
+            copie->perime = 1;
+            return relectures;
+        }
+        if (relectures % ESSAIS_INSTANTANE == 0) {
+            sched_yield();
+        }
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : instantane_vendeur / instantane_caissier
+ * Description : Copie coherente de la fiche d'un vendeur / d'un caissier
+ *               (copier_fiche), sans prendre son verrou
+ * Parametres  : idx, copie
+ * Retour      : Nombre de relectures
+ * -----------------------------------------------------------------------------
+ */
+int instantane_vendeur(int idx, instantane_acteur_t *copie) {
+    vendeur_info_t *v = &shm_vendeurs[idx];
+    
+    copie->rayon = v->rayon;
+    return copier_fiche(&v->sequence, &v->occupe, &v->servis, NULL, &v->queue,
+                        &shm_attente_vendeurs[idx], copie);
+}
+
+int instantane_caissier(int idx, instantane_acteur_t *copie) {
+    caissier_info_t *c = &shm_caissiers[idx];
+    
+    copie->rayon = -1;
+    return copier_fiche(&c->sequence, &c->occupe, &c->servis, &c->encaisse, &c->queue,
+                        &shm_attente_caissiers[idx], copie);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : reserver_vendeur
+ * Description : Choix du premier vendeur et inscription dans sa file
+ *               Le choix lit les files sans verrou ; sous le verrou du
+ *               vendeur choisi, si sa file n'a plus la longueur vue lors du
+ *               choix, un autre client l'a pris entre-temps : le verrou est
+ *               rendu et le choix refait. Les clients arrives ensemble se
+ *               repartissent ainsi au lieu de s'empiler sur le meme vendeur.
+ * Parametres  : rayon, client_id
+ * Retour      : Index du vendeur, FILE_PLEINE si sa file est pleine
+ * -----------------------------------------------------------------------------
+ */
+int reserver_vendeur(int rayon, int client_id) {
+    equilibre_t *e = &shm->equilibre[ROLE_VENDEUR];
+    int reprises = 0;
+    int v, vu, resultat;
+    
+    for (;;) {
+        v = choisir_vendeur(rayon);
+        vu = __atomic_load_n(&shm_attente_vendeurs[v], __ATOMIC_RELAXED);
+        verrou_prendre(&shm_vendeurs[v].verrou);
+        if (shm_attente_vendeurs[v] == vu || reprises + 1 >= ESSAIS_RESERVATION) {
+            break;
+        }
+        verrou_rendre(&shm_vendeurs[v].verrou);
+        reprises++;
+    }
+    resultat = inscrire(&shm_vendeurs[v].queue, &shm_vendeurs[v].sequence,
+                        &shm_attente_vendeurs[v], fixer_file_vendeur, v, client_id);
+    verrou_rendre(&shm_vendeurs[v].verrou);
+    
+    if (resultat == FILE_PLEINE) {
+        __atomic_fetch_add(&e->refus, 1, __ATOMIC_RELAXED);
+        return FILE_PLEINE;
+    }
+    noter_equilibre(e, shm_index_vendeurs, reprises);
+    return v;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : reserver_caissier
+ * Description : Choix du caissier le moins charge et inscription dans sa
+ *               file (meme verification que reserver_vendeur)
+ * Parametre   : client_id
+ * Retour      : Index du caissier, FILE_PLEINE si sa file est pleine
+ * -----------------------------------------------------------------------------
+ */
+int reserver_caissier(int client_id) {
+    equilibre_t *e = &shm->equilibre[ROLE_CAISSIER];
+    int reprises = 0;
+    int c, vu, resultat;
+    
+    for (;;) {
+        c = trouver_caissier_moins_charge();
+        vu = __atomic_load_n(&shm_attente_caissiers[c], __ATOMIC_RELAXED);
+        verrou_prendre(&shm_caissiers[c].verrou);
+        if (shm_attente_caissiers[c] == vu || reprises + 1 >= ESSAIS_RESERVATION) {
+            break;
+        }
+        verrou_rendre(&shm_caissiers[c].verrou);
+        reprises++;
+    }
+    resultat = inscrire(&shm_caissiers[c].queue, &shm_caissiers[c].sequence,
+                        &shm_attente_caissiers[c], fixer_file_caissier, c, client_id);
+    verrou_rendre(&shm_caissiers[c].verrou);
+    
+    if (resultat == FILE_PLEINE) {
+        __atomic_fetch_add(&e->refus, 1, __ATOMIC_RELAXED);
+        return FILE_PLEINE;
+    }
+    noter_equilibre(e, shm_index_caissiers, reprises);
+    return c;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : entrer_file_vendeur
+ * Description : Inscrit un client chez un vendeur donne (redirection)
+ * Parametres  : vendeur_idx, client_id
+ * Retour      : 0, FILE_PLEINE si la file du vendeur est pleine
+ * -----------------------------------------------------------------------------
+ */
+int entrer_file_vendeur(int vendeur_idx, int client_id) {
+    vendeur_info_t *v = &shm_vendeurs[vendeur_idx];
+    int resultat;
+    
+    verrou_prendre(&v->verrou);
+    resultat = inscrire(&v->queue, &v->sequence, &shm_attente_vendeurs[vendeur_idx],
+                        fixer_file_vendeur, vendeur_idx, client_id);
+    verrou_rendre(&v->verrou);
+    
+    if (resultat == FILE_PLEINE) {
+        __atomic_fetch_add(&shm->equilibre[ROLE_VENDEUR].refus, 1, __ATOMIC_RELAXED);
+    }
+    return resultat;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : sortir_file_vendeur
+ * Description : Retire un client de la file d'un vendeur
+ * Parametres  : vendeur_idx, client_id
+ * -----------------------------------------------------------------------------
+ */
+void sortir_file_vendeur(int vendeur_idx, int client_id) {
+    vendeur_info_t *v = &shm_vendeurs[vendeur_idx];
+    
+    verrou_prendre(&v->verrou);
+    sequence_ouvrir(&v->sequence);
+    desinscrire(&v->queue, &shm_attente_vendeurs[vendeur_idx],
+                fixer_file_vendeur, vendeur_idx, client_id);
+    sequence_fermer(&v->sequence);
+    verrou_rendre(&v->verrou);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : terminer_paiement
+ * Description : Fin d'un encaissement, en une seule section de sequence
+ *               sous le verrou du caissier : le client quitte la file, le
+ *               caissier redevient libre, ses compteurs (servis, encaisse)
+ *               avancent. Le chiffre d'affaires du magasin suit aussitot.
+ * Parametres  : caissier_idx, client_id, montant
+ * -----------------------------------------------------------------------------
+ */
+void terminer_paiement(int caissier_idx, int client_id, int montant) {
+    caissier_info_t *c = &shm_caissiers[caissier_idx];
+    
+    verrou_prendre(&c->verrou);
+    sequence_ouvrir(&c->sequence);
+    desinscrire(&c->queue, &shm_attente_caissiers[caissier_idx],
+                fixer_file_caissier, caissier_idx, client_id);
+    c->occupe = 0;
+    c->servis++;
+    c->encaisse += montant;
+    sequence_fermer(&c->sequence);
+    verrou_rendre(&c->verrou);
+    
+    __atomic_fetch_add(&shm->chiffre_affaires, montant, __ATOMIC_RELAXED);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : construire_annuaire
+ * Description : Construit l'annuaire des rayons d'apres shm_vendeurs[].rayon
+ *               La ligne r de shm_annuaire liste, par ordre d'indice, les
+ *               nb_vendeurs_rayon[r] vendeurs du rayon r.
+ * -----------------------------------------------------------------------------
+ */
+void construire_annuaire(void) {
+    int r, i;
+    
+    for (r = 0; r < NB_RAYONS; r++) {
+        shm->nb_vendeurs_rayon[r] = 0;
+        shm->curseur_rayon[r] = 0;
+    }
+    for (i = 0; i < shm->nb_vendeurs; i++) {
+        r = shm_vendeurs[i].rayon;
+        shm_annuaire[r * shm->capacite_vendeurs + shm->nb_vendeurs_rayon[r]++] = i;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : cout_vendeur
+ * Description : Cout d'un vendeur pour le routage : longueur de sa file,
+ *               ou attente prevue (file x duree moyenne des discussions)
+ * Parametres  : v - index du vendeur, ewma - 1 pour l'attente prevue
+ * -----------------------------------------------------------------------------
+ */
+static long cout_vendeur(int v, int ewma) {
+    long file = __atomic_load_n(&shm_attente_vendeurs[v], __ATOMIC_RELAXED);
+    
+    if (ewma) {
+        return file * __atomic_load_n(&shm_vendeurs[v].service_ewma_ms, __ATOMIC_RELAXED);
+    }
+    return file;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : meilleur_du_rayon
+ * Description : Vendeur du rayon de plus petit cout
+ *               Seuls les vendeurs du rayon (annuaire) sont examines, en
+ *               partant du curseur du rayon ; le curseur passe ensuite au
+ *               vendeur suivant de la liste, pour que les clients d'un
+ *               rayon se repartissent entre ses specialistes.
+ * Parametres  : rayon, ewma (voir cout_vendeur)
+ * Retour      : Index du vendeur
+ * -----------------------------------------------------------------------------
+ */
+static int meilleur_du_rayon(int rayon, int ewma) {
+    const int *liste = &shm_annuaire[rayon * shm->capacite_vendeurs];
+    int n = shm->nb_vendeurs_rayon[rayon];
+    int depart, meilleur, k;
+    long min_cout;
+    
+    /* Ne devrait jamais arriver car initialisation garantit 1 vendeur/rayon */
+    if (n == 0) {
+        return 0;
+    }
+    
+    depart = (int)(__atomic_load_n(&shm->curseur_rayon[rayon], __ATOMIC_RELAXED) % (unsigned int)n);
+    meilleur = depart;
+    min_cout = cout_vendeur(liste[depart], ewma);
+    for (k = 1; k < n; k++) {
+        int pos = (depart + k < n) ? depart + k : depart + k - n;
+        long c = cout_vendeur(liste[pos], ewma);
+        
+        if (c < min_cout) {
+            min_cout = c;
+            meilleur = pos;
+        }
+    }
+    __atomic_store_n(&shm->curseur_rayon[rayon], (unsigned int)meilleur + 1, __ATOMIC_RELAXED);
+    return liste[meilleur];
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : trouver_vendeur_pour_rayon
+ * Description : Trouve le vendeur competent le moins charge pour un rayon
+ * Parametre   : rayon - numero du rayon (0 a NB_RAYONS-1)
+ * Retour      : Index du vendeur competent
+ * Note        : Au moins un vendeur par rayon est garanti a l'initialisation ;
+ *               lecture sans verrou des longueurs de file (instantane)
+ * -----------------------------------------------------------------------------
+ */
+int trouver_vendeur_pour_rayon(int rayon) {
+    return meilleur_du_rayon(rayon, 0);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : deux_choix
+ * Description : Tire deux vendeurs distincts du rayon et garde le moins
+ *               charge (le premier tire en cas d'egalite)
+ * Parametre   : rayon
+ * Retour      : Index du vendeur
+ * -----------------------------------------------------------------------------
+ */
+static int deux_choix(int rayon) {
+    const int *liste = &shm_annuaire[rayon * shm->capacite_vendeurs];
+    int n = shm->nb_vendeurs_rayon[rayon];
+    int a, b;
+    
+    if (n < 2) {
+        return (n == 1) ? liste[0] : 0;
+    }
+    a = aleatoire() % n;
+    b = aleatoire() % (n - 1);
+    if (b >= a) {
+        b++;
+    }
+    return (cout_vendeur(liste[b], 0) < cout_vendeur(liste[a], 0)) ? liste[b] : liste[a];
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : nom_routage
+ * Description : Nom d'une politique de routage
+ * Parametre   : routage - ROUTAGE_*
+ * Retour      : Nom (chaine constante)
+ * -----------------------------------------------------------------------------
+ */
+const char *nom_routage(int routage) {
+    switch (routage) {
+    case ROUTAGE_DIRECT:
+        return "direct";
+    case ROUTAGE_DEUX_CHOIX:
+        return "deux";
+    case ROUTAGE_EWMA:
+        return "ewma";
+    default:
+        return "redirection";
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : choisir_vendeur
+ * Description : Premier vendeur d'un client selon la politique de routage
+ *               de la simulation (shm->routage)
+ * Parametre   : rayon - rayon recherche
+ * Retour      : Index du vendeur
+ * -----------------------------------------------------------------------------
+ */
+int choisir_vendeur(int rayon) {
+    switch (shm->routage) {
+    case ROUTAGE_DIRECT:
+        return meilleur_du_rayon(rayon, 0);
+    case ROUTAGE_DEUX_CHOIX:
+        return deux_choix(rayon);
+    case ROUTAGE_EWMA:
+        return meilleur_du_rayon(rayon, 1);
+    default:
+        return trouver_vendeur_moins_charge();
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : noter_service_vendeur
+ * Description : EWMA de la duree des discussions d'un vendeur :
+ *               moyenne += (duree - moyenne) / 2^EWMA_DECALAGE
+ * Parametres  : vendeur_id, duree_ms
+ * Note        : Un seul ecrivain (le vendeur) : lecture puis ecriture
+ *               atomiques, sans verrou
+ * -----------------------------------------------------------------------------
+ */
+void noter_service_vendeur(int vendeur_id, int duree_ms) {
+    int *moyenne = &shm_vendeurs[vendeur_id].service_ewma_ms;
+    int m = __atomic_load_n(moyenne, __ATOMIC_RELAXED);
+    
+    __atomic_store_n(moyenne, m + (duree_ms - m) / (1 << EWMA_DECALAGE), __ATOMIC_RELAXED);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : compter_premier_service
+ * Description : Cumule le delai avant le premier service d'un client
+ * Parametre   : entree_ns - entree du client dans le magasin
+ * -----------------------------------------------------------------------------
+ */
+void compter_premier_service(long long entree_ns) {
+    __atomic_fetch_add(&shm->premiers_services, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shm->premier_service_ns_total, horloge_ns() - entree_ns,
+                       __ATOMIC_RELAXED);
 }
@@ -10,7 +10,8 @@
  *   - Les prototypes des fonctions IPC
  * 
  * IPC System V utilisees :
- *   - Memoire partagee (shmget, shmat, shmdt, shmctl)
+ *   - Memoire partagee (shmget, shmat, shmdt, shmctl), ou POSIX
+ *     (shm_open, mmap) avec l'option -m posix
  *   - Semaphores (semget, semop, semctl)
  *   - Files de messages (msgget, msgsnd, msgrcv, msgctl)
  * 
@@ -30,32 +31,167 @@
 
 /* ============== STRUCTURES DE DONNEES ============== */
 
+/* Taille d'une ligne de cache : chaque fiche vendeur / caissier en occupe
+   au moins une, pour que l'acteur qui l'ecrit n'invalide pas celle du
+   voisin */
+#define TAILLE_LIGNE_CACHE  64
+
+/*
+ * Structure : verrou_t
+ * Description : Verrou en memoire partagee base sur un futex
+ *               etat = 0 : libre, 1 : pris, 2 : pris avec des processus
+ *               en attente. Prise et liberation sans appel systeme tant
+ *               qu'il n'y a pas de contention.
+ */
+typedef struct {
+    int etat;                       /* Mot futex (acces atomiques) */
+} verrou_t;
+
+/* Emplacement d'un client retire du milieu de la file */
+#define PLACE_LIBRE         -1
+
+/* Resultat de reserver_* / entrer_file_vendeur quand la file est pleine */
+#define FILE_PLEINE         -1
+
+/*
+ * Structure : queue_clients_t
+ * Description : File d'attente d'un vendeur ou d'un caissier, en anneau :
+ *               tete et fin sont des positions absolues (emplacement :
+ *               position % MAX_QUEUE). Un client retire du milieu laisse un
+ *               emplacement PLACE_LIBRE, saute quand la tete l'atteint ; sa
+ *               position est retrouvee en O(1) par shm_places[client].
+ *               Le nombre de clients presents est shm_attente_*.
+ */
+typedef struct {
+    int tete;                       /* Position du plus ancien emplacement */
+    int fin;                        /* Position du prochain emplacement */
+    int clients[MAX_QUEUE];         /* ID client ou PLACE_LIBRE */
+} queue_clients_t;
+
+/* Journaux des traces (log.c) : un par vendeur, un par caissier, un pour
+   le processus initial, et NB_JOURNAUX_CLIENTS partages par les clients */
+#define TAILLE_JOURNAL      128     /* Traces par journal (puissance de 2) */
+#define TAILLE_TEXTE_TRACE  216     /* Texte d'une trace TRACE_TEXTE */
+#define NB_JOURNAUX_CLIENTS 16
+
+/*
+ * Structure : trace_t
+ * Description : Evenement du journal, enregistrement binaire de taille
+ *               fixe (32 octets), tel qu'ecrit dans FICHIER_EVENEMENTS et
+ *               relu par logdump. Les types (TRACE_*) et leur texte sont
+ *               dans log.h / log.c.
+ */
+typedef struct {
+    long long ns;                   /* horloge_ns (TRACE_HORLOGE : ecart
+                                       horloge murale - horloge_ns) */
+    unsigned short type;            /* TRACE_* */
+    unsigned char acteur;           /* ROLE_VENDEUR, ..., ROLE_INITIAL */
+    unsigned char erreur;           /* 1 : log_erreur */
+    int id;                         /* Id de l'acteur */
+    int client;                     /* Client concerne (-1 : aucun) */
+    int cible;                      /* Vendeur / caissier vise, ou valeur */
+    int rayon;                      /* Rayon concerne (-1 : aucun) */
+    int montant;                    /* Euros (TRACE_TEXTE : longueur du
+                                       texte qui suit) */
+} trace_t;
+
+/*
+ * Structure : cellule_journal_t
+ * Description : Cellule d'un journal ; sequence joue le meme role que
+ *               dans cellule_anneau_t (cellule libre ou publiee). texte
+ *               n'est rempli que pour TRACE_TEXTE : "auteur\0message".
+ */
+typedef struct {
+    unsigned int sequence;          /* Numero de tour (acces atomiques) */
+    int proprietaire;               /* Processus qui l'a reservee (0 :
+                                       pas encore note) */
+    trace_t trace;
+    char texte[TAILLE_TEXTE_TRACE];
+} cellule_journal_t;
+
+/*
+ * Structure : journal_t
+ * Description : Anneau de traces d'un ou plusieurs acteurs vers le
+ *               processus journal (multi-producteurs / consommateur
+ *               unique, comme anneau_t). Un journal plein ne bloque jamais
+ *               l'acteur : la trace est perdue et comptee. Une cellule
+ *               reservee et jamais publiee n'est abandonnee par le
+ *               processus journal qu'une fois son proprietaire mort.
+ */
+typedef struct {
+    unsigned int ecriture;          /* Prochaine position a reserver */
+    unsigned int lecture;           /* Prochaine position a lire */
+    long perdues;                   /* Traces perdues (journal plein) */
+    cellule_journal_t traces[TAILLE_JOURNAL];
+} __attribute__((aligned(TAILLE_LIGNE_CACHE))) journal_t;
+
 /*
  * Structure : vendeur_info_t
- * Description : Informations sur un vendeur en memoire partagee
+ * Description : Fiche d'un vendeur en memoire partagee, alignee sur une
+ *               ligne de cache. La longueur de sa file n'est pas ici mais
+ *               dans le tableau contigu shm_attente_vendeurs, seul lu par
+ *               la recherche du vendeur le moins charge.
+ *               Chaque modification (sous le verrou) est encadree par
+ *               sequence_ouvrir / sequence_fermer : le monitoring en lit
+ *               une copie coherente sans verrou (instantane_vendeur).
  */
 typedef struct {
-    int rayon;                      /* Rayon d'expertise (0 a NB_RAYONS-1) */
-    int file_attente;               /* Nombre de clients en attente */
+    verrou_t verrou;                /* Protege la queue, la longueur de la
+                                       file et occupe */
+    unsigned int sequence;          /* Seqlock : impaire pendant une
+                                       modification */
     int occupe;                     /* 1 si occupe avec un client */
+    int servis;                     /* Discussions menees a terme */
+    int rayon;                      /* Rayon d'expertise (0 a NB_RAYONS-1) */
     pid_t pid;                      /* PID du processus vendeur */
-    int clients_queue[MAX_QUEUE];   /* IDs des clients dans la queue */
-} vendeur_info_t;
+    int service_ewma_ms;            /* Duree moyenne d'une discussion
+                                       (EWMA, ecrite par le vendeur) */
+    queue_clients_t queue;          /* Clients dans la queue */
+} __attribute__((aligned(TAILLE_LIGNE_CACHE))) vendeur_info_t;
 
 /*
  * Structure : caissier_info_t
- * Description : Informations sur un caissier en memoire partagee
+ * Description : Fiche d'un caissier, alignee et protegee comme
+ *               vendeur_info_t ; la longueur de sa file est dans
+ *               shm_attente_caissiers
  */
 typedef struct {
-    int file_attente;               /* Nombre de clients en attente */
+    verrou_t verrou;                /* Protege la queue, la longueur de la
+                                       file et occupe */
+    unsigned int sequence;          /* Seqlock (voir vendeur_info_t) */
     int occupe;                     /* 1 si occupe avec un client */
+    int servis;                     /* Paiements encaisses */
+    long encaisse;                  /* Montant encaisse (euros) */
     pid_t pid;                      /* PID du processus caissier */
-    int clients_queue[MAX_QUEUE];   /* IDs des clients dans la queue */
-} caissier_info_t;
+    queue_clients_t queue;          /* Clients dans la queue */
+} __attribute__((aligned(TAILLE_LIGNE_CACHE))) caissier_info_t;
+
+/*
+ * Structure : instantane_acteur_t
+ * Description : Copie coherente de la fiche d'un vendeur ou d'un caissier
+ *               et de sa file, lue sans verrou (instantane_vendeur /
+ *               instantane_caissier)
+ */
+typedef struct {
+    unsigned int sequence;          /* Sequence (paire) de la fiche copiee,
+                                       derniere lue si perime */
+    int perime;                     /* 1 : pas de copie coherente apres
+                                       RELECTURES_MAX, champs a ignorer */
+    int occupe;
+    int rayon;                      /* Vendeur ; -1 pour un caissier */
+    int longueur;                   /* Longueur de la file */
+    int servis;
+    long encaisse;                  /* Caissier ; 0 pour un vendeur */
+    int nb_clients;                 /* Clients copies dans clients */
+    int clients[MAX_QUEUE];         /* File, dans l'ordre d'arrivee */
+} instantane_acteur_t;
 
 /*
  * Structure : achat_info_t
  * Description : Information sur un achat (transmission vendeur -> caissier)
+ *               Publication sans verrou : le vendeur ecrit le montant puis
+ *               valide (store release), le caissier consomme valide par un
+ *               echange atomique (acquire)
  */
 typedef struct {
     int client_id;                  /* Numero du client */
@@ -63,47 +199,80 @@ typedef struct {
     int valide;                     /* 1 si l'entree est valide */
 } achat_info_t;
 
+/* ============== STRUCTURES DE MESSAGES ============== */
+
 /*
- * Structure : magasin_shm_t
- * Description : Structure principale en memoire partagee
- *               Contient l'etat global du magasin
+ * Conventions pour les mtype :
+ *   - client -> vendeur : mtype = vendeur_id + 1 (<= MAX_VENDEURS, donc
+ *     < MTYPE_BASE_CLIENT)
+ *   - client -> caissier : mtype = caissier_id + 1 (<= MAX_CAISSIERS)
+ *   - a partir de MTYPE_BASE_CLIENT, trois types par client, entrelaces
+ *     pour qu'aucune plage ne deborde sur une autre quel que soit le
+ *     nombre de clients :
+ *       vendeur -> client  : MTYPE_BASE_CLIENT + 3 * client_id
+ *       caissier -> client : MTYPE_BASE_CLIENT + 3 * client_id + 1
+ *       client -> vendeur, decision : + 3 * client_id + 2,
+ *       sur la file des reponses vendeur : type propre a la session
  */
-typedef struct {
-    int nb_vendeurs;                /* Nombre de vendeurs */
-    int nb_caissiers;               /* Nombre de caissiers */
-    int nb_clients;                 /* Nombre total de clients */
-    int simulation_active;          /* 1 si la simulation est en cours */
-    
-    vendeur_info_t vendeurs[MAX_VENDEURS];
-    caissier_info_t caissiers[MAX_CAISSIERS];
-    achat_info_t achats[MAX_CLIENTS];  /* Table des achats en attente */
-    
-    pid_t pid_initial;              /* PID du processus initial */
-    int clients_termines;           /* Nombre de clients ayant termine */
-    long chiffre_affaires;          /* Total des ventes encaissees (euros) */
-} magasin_shm_t;
+#define MTYPE_BASE_CLIENT               1000
+#if MAX_VENDEURS >= MTYPE_BASE_CLIENT || MAX_CAISSIERS >= MTYPE_BASE_CLIENT
+#error "MAX_VENDEURS et MAX_CAISSIERS doivent rester sous MTYPE_BASE_CLIENT"
+#endif
+#define MTYPE_REPONSE_VENDEUR(client)   (MTYPE_BASE_CLIENT + 3L * (client))
+#define MTYPE_REPONSE_CAISSIER(client)  (MTYPE_BASE_CLIENT + 3L * (client) + 1)
+#define MTYPE_DECISION(client)          (MTYPE_BASE_CLIENT + 3L * (client) + 2)
 
-/* ============== STRUCTURES DE MESSAGES ============== */
+/*
+ * Versions du protocole client / vendeur / caissier
+ *   - 1 : le vendeur repond deux fois (competent, puis discussion finie),
+ *         le caissier repond deux fois (prix, puis paiement fini)
+ *         -> 7 messages pour un client qui achete
+ *   - 2 : une seule reponse vendeur apres la discussion, une seule
+ *         reponse caissier avec le montant paye
+ *         -> 5 messages pour un client qui achete
+ */
+/* Dans les deux versions, la decision d'achat voyage sur le type propre
+   a la session (MTYPE_DECISION) : le vendeur l'attend sans reveil inutile
+   et sans remettre en file les requetes des autres clients */
+#define PROTOCOLE_V1        1
+#define PROTOCOLE_V2        2
 
 /*
- * Conventions pour les mtype :
- *   - client -> vendeur : mtype = vendeur_id + 1
- *   - vendeur -> client : mtype = client_id + 1000
- *   - client -> caissier : mtype = caissier_id + 1
- *   - caissier -> client : mtype = client_id + 2000
+ * Politiques de routage : choix du premier vendeur d'un client
+ *   - REDIRECTION : vendeur le moins charge, qui redirige le client vers
+ *                   un vendeur du rayon s'il n'est pas competent
+ *   - DIRECT      : vendeur competent le moins charge (annuaire), sans
+ *                   redirection
+ *   - DEUX_CHOIX  : le moins charge de deux vendeurs competents tires au
+ *                   hasard (puissance de deux choix)
+ *   - EWMA        : vendeur competent dont l'attente prevue (longueur de
+ *                   file x duree moyenne de ses discussions) est la plus
+ *                   courte
  */
+#define ROUTAGE_REDIRECTION 0
+#define ROUTAGE_DIRECT      1
+#define ROUTAGE_DEUX_CHOIX  2
+#define ROUTAGE_EWMA        3
+#define NB_ROUTAGES         4
+
+/* Moyenne glissante des durees de discussion : poids 1/2^EWMA_DECALAGE
+   pour la nouvelle mesure */
+#define EWMA_DECALAGE       3
 
 /*
  * Structure : msg_client_vendeur_t
  * Description : Message envoye par un client a un vendeur
  */
 typedef struct {
-    long mtype;             /* Type du message (vendeur_id + 1) */
+    long mtype;             /* vendeur_id + 1 ; MTYPE_DECISION(client_id)
+                               pour une decision */
     int client_id;          /* ID du client */
     int vendeur_id;         /* ID du vendeur cible */
     int rayon_voulu;        /* Rayon recherche par le client */
     int type_requete;       /* 0: demande rayon, 1: decision vente */
     int decision_achat;     /* 0: non, 1: oui (si type_requete=1) */
+    long long entree_ns;    /* Entree du client dans le magasin
+                               (horloge_ns), pour le premier service */
 } msg_client_vendeur_t;
 
 /*
@@ -111,7 +280,7 @@ typedef struct {
  * Description : Message envoye par un vendeur a un client
  */
 typedef struct {
-    long mtype;             /* Type du message (client_id + 1000) */
+    long mtype;             /* MTYPE_REPONSE_VENDEUR(client_id) */
     int vendeur_id;         /* ID du vendeur */
     int est_competent;      /* 1 si competent pour le rayon demande */
     int vendeur_recommande; /* Vendeur recommande si pas competent */
@@ -134,15 +303,234 @@ typedef struct {
  * Description : Message envoye par un caissier a un client
  */
 typedef struct {
-    long mtype;             /* Type du message (client_id + 2000) */
+    long mtype;             /* MTYPE_REPONSE_CAISSIER(client_id) */
     int montant;            /* Montant a payer */
     int paiement_termine;   /* 1 quand le paiement est effectue */
 } msg_caissier_client_t;
 
+/* ============== TRANSPORT DES REQUETES ============== */
+
+/* Transport des requetes client -> vendeur et client -> caissier
+   (les reponses aux clients passent toujours par des files System V) */
+#define TRANSPORT_SYSV      0   /* Files de messages System V (defaut) */
+#define TRANSPORT_ANNEAU    1   /* Anneaux MPSC en memoire partagee */
+#define TRANSPORT_FILES     2   /* Une file System V par vendeur/caissier,
+                                   reponses sur une file dediee */
+#define TRANSPORT_THREADS   3   /* Mode threads (./main -T) : boites en
+                                   memoire du processus, une par acteur */
+
+/* Nombre de cellules d'un anneau (puissance de 2 ; un anneau plein fait
+   dormir le client qui depose jusqu'au prochain retrait) */
+#define TAILLE_ANNEAU       512
+
+/*
+ * Structure : cellule_anneau_t
+ * Description : Cellule d'un anneau ; sequence indique si la cellule est
+ *               libre pour le tour courant ou publiee par un producteur
+ */
+typedef struct {
+    unsigned int sequence;          /* Numero de tour (acces atomiques) */
+    union {
+        msg_client_vendeur_t vendeur;
+        msg_client_caissier_t caissier;
+    } msg;
+} cellule_anneau_t;
+
+/*
+ * Structure : anneau_t
+ * Description : File bornee multi-producteurs / consommateur unique
+ *               Les clients reservent une cellule par CAS sur ecriture,
+ *               le vendeur (ou caissier) proprietaire lit sans verrou.
+ *               Le consommateur dort sur le futex signal quand l'anneau
+ *               est vide, les producteurs sur le futex libere quand il
+ *               est plein.
+ */
+typedef struct {
+    unsigned int ecriture;          /* Prochaine position a reserver */
+    unsigned int lecture;           /* Prochaine position a lire */
+    int signal;                     /* Mot futex, incremente a chaque depot */
+    int attente;                    /* 1 si le consommateur dort */
+    int libere;                     /* Mot futex, incremente a chaque retrait */
+    int producteurs;                /* Producteurs qui attendent une place */
+    cellule_anneau_t cellules[TAILLE_ANNEAU];
+} anneau_t;
+
+/*
+ * Structure : index_charge_t
+ * Description : Index des longueurs de file d'un groupe d'acteurs (vendeurs
+ *               ou caissiers) pour trouver le moins charge sans parcourir
+ *               tout le groupe. Une longueur de file est bornee par
+ *               MAX_QUEUE : pour chaque longueur L (0 a MAX_QUEUE), un
+ *               masque de bits dont le bit i est a 1 si l'acteur i a L
+ *               clients. Les masques sont modifies par operations atomiques
+ *               (index_deplacer) sous le verrou de l'acteur concerne ; la
+ *               recherche lit sans verrou le premier niveau non vide.
+ *               curseur fait tourner le choix entre acteurs a egalite.
+ */
+typedef struct {
+    unsigned int curseur;           /* Premier acteur examine (tourniquet) */
+    int nb;                         /* Acteurs indexes */
+    int mots;                       /* Mots de 64 bits par longueur */
+    unsigned long long niveaux[]    /* [(MAX_QUEUE + 1) * mots] */
+        __attribute__((aligned(TAILLE_LIGNE_CACHE)));
+} index_charge_t;
+
+/* ============== MEMOIRE PARTAGEE ============== */
+
+/* Instance nommee et type de memoire, transmis aux processus lances par
+   exec (et lus par monitoring) via l'environnement */
+#define ENV_INSTANCE        "MAGASIN_INSTANCE"
+#define ENV_MEMOIRE         "MAGASIN_MEMOIRE"   /* "posix" ou absent */
+
+/* Pages enormes pour le segment POSIX (fichier sur hugetlbfs) */
+#define CHEMIN_HUGETLBFS    "/dev/hugepages"
+#define TAILLE_PAGE_ENORME  (2 * 1024 * 1024)
+
+/* Roles des processus pour le bilan de l'attachement */
+#define ROLE_VENDEUR        0
+#define ROLE_CAISSIER       1
+#define ROLE_CLIENT         2
+#define NB_ROLES            3
+#define ROLE_INITIAL        NB_ROLES    /* Processus initial (traces) */
+
+/*
+ * Structure : memoire_role_t
+ * Description : Cout de l'attachement du segment pour un role (cumuls des
+ *               processus de ce role, voir bilan_memoire)
+ */
+typedef struct {
+    long attachements;              /* Processus ayant attache le segment */
+    long long attache_ns;           /* Cumul des durees d'attachement */
+    long fautes_attache;            /* Fautes mineures pendant l'attachement */
+    long fautes_service;            /* Fautes mineures apres l'attachement */
+} memoire_role_t;
+
+/* Essais de reserver_vendeur / reserver_caissier avant d'accepter un
+   acteur dont la file a change entre le choix et la prise du verrou */
+#define ESSAIS_RESERVATION  4
+
+/* Relectures d'un instantane avant de ceder le processeur a l'acteur en
+   cours de modification, et avant d'abandonner (ecrivain mort au milieu
+   d'une modification : la sequence reste impaire) */
+#define ESSAIS_INSTANTANE   8
+#define RELECTURES_MAX      (8 * ESSAIS_INSTANTANE)
+
+/*
+ * Structure : equilibre_t
+ * Description : Equilibre des files d'un groupe (vendeurs ou caissiers),
+ *               mesure a chaque reservation : ecart entre la plus longue
+ *               et la plus courte file juste apres l'entree du client
+ */
+typedef struct {
+    long reservations;              /* Clients places par reserver_* */
+    long reprises;                  /* Choix refaits (file modifiee entre
+                                       le choix et le verrou) */
+    long ecart_total;               /* Cumul des ecarts max - min */
+    int ecart_max;                  /* Plus grand ecart observe */
+    long refus;                     /* Clients refuses, file pleine */
+} equilibre_t;
+
+/*
+ * Structure : magasin_shm_t
+ * Description : En-tete du segment de memoire partagee
+ *               Contient l'etat global du magasin et la disposition des
+ *               tableaux qui le suivent, dimensionnes a la creation d'apres
+ *               les nombres reels d'acteurs (decalages en octets depuis le
+ *               debut du segment, 0 si le tableau est absent). attacher_ipc
+ *               et monitoring retrouvent les tableaux grace a cet en-tete.
+ */
+typedef struct {
+    int nb_vendeurs;                /* Nombre de vendeurs */
+    int nb_caissiers;               /* Nombre de caissiers */
+    int nb_clients;                 /* Nombre total de clients */
+    int simulation_active;          /* 1 si la simulation est en cours */
+    
+    verrou_t verrou_shm;            /* Remplace le semaphore SEM_MUTEX_SHM
+                                       (plus utilise par les acteurs : un
+                                       verrou par vendeur / caissier) */
+    
+    /* Disposition du segment */
+    size_t taille_segment;          /* Taille totale (en-tete + tableaux) */
+    int capacite_vendeurs;          /* Elements de chaque tableau */
+    int capacite_caissiers;
+    int capacite_clients;
+    size_t off_vendeurs;            /* vendeur_info_t[capacite_vendeurs] */
+    size_t off_caissiers;           /* caissier_info_t[capacite_caissiers] */
+    size_t off_attente_vendeurs;    /* int[capacite_vendeurs] : files */
+    size_t off_attente_caissiers;   /* int[capacite_caissiers] : files */
+    size_t off_index_vendeurs;      /* index_charge_t des vendeurs */
+    size_t off_index_caissiers;     /* index_charge_t des caissiers */
+    size_t off_annuaire;            /* int[NB_RAYONS][capacite_vendeurs] */
+    
+    /* Annuaire des rayons : vendeurs de chaque rayon, ranges dans la
+       ligne du rayon du tableau off_annuaire (construire_annuaire) */
+    int nb_vendeurs_rayon[NB_RAYONS];
+    size_t off_achats;              /* achat_info_t[capacite_clients] */
+    size_t off_places;              /* int[capacite_clients] : position de
+                                       chaque client dans sa file */
+    size_t off_files_vendeurs;      /* int[capacite_vendeurs] */
+    size_t off_files_caissiers;     /* int[capacite_caissiers] */
+    size_t off_anneaux_vendeurs;    /* anneau_t[], TRANSPORT_ANNEAU seul */
+    size_t off_anneaux_caissiers;
+    size_t off_journaux;            /* journal_t[nb_journaux] */
+    int nb_journaux;
+    
+    int journal_actif;              /* 1 : log_message passe par les
+                                       journaux (processus journal lance) */
+    int sortie_log;                 /* SORTIE_* (log.h), option -l */
+    long long decalage_horloge;     /* Horloge murale - horloge_ns (ns),
+                                       commun a tous les processus */
+    
+    int memoire_posix;              /* 1 : shm_open + mmap, 0 : System V */
+    int pages_enormes;              /* 1 : segment sur hugetlbfs */
+    
+    int transport;                  /* TRANSPORT_SYSV, _ANNEAU, _FILES
+                                       ou _THREADS */
+    int protocole;                  /* PROTOCOLE_V1 ou PROTOCOLE_V2 */
+    int routage;                    /* ROUTAGE_REDIRECTION, _DIRECT, ... */
+    
+    /* File des reponses (TRANSPORT_FILES), publiee pour attacher_ipc ;
+       les files par acteur sont dans les tableaux files_* */
+    int file_reponses;                  /* Reponses vendeurs/caissiers */
+    
+    pid_t pid_initial;              /* PID du processus initial */
+    
+    /* Compteurs globaux : mis a jour par operations atomiques, sur leurs
+       propres lignes de cache (les champs ci-dessus sont lus par tous) */
+    long messages_envoyes           /* Messages envoyes (hors arret) */
+        __attribute__((aligned(TAILLE_LIGNE_CACHE)));
+    int clients_termines;           /* Nombre de clients ayant termine */
+    long chiffre_affaires;          /* Total des ventes encaissees (euros) */
+    long reveils_total;             /* Reveils sur reception bloquante */
+    long reveils_evites_total;      /* Reveils qu'aurait fait le polling */
+    
+    /* Lancement des clients (fork + exec ou mode zygote) */
+    int prochain_client;            /* Prochain ID a servir (zygote) */
+    long lancements;                /* Clients lances */
+    long long lancement_ns_total;   /* Cumul fork -> debut du client */
+    long long preparation_ns_total; /* Cumul log_init + attacher_ipc */
+    
+    /* Routage : redirections et delai avant le premier service (de
+       l'entree du client au debut de la discussion avec un vendeur
+       competent) */
+    long redirections;
+    long premiers_services;
+    long long premier_service_ns_total;
+    
+    /* Tourniquet de trouver_vendeur_pour_rayon, par rayon */
+    unsigned int curseur_rayon[NB_RAYONS];
+    
+    /* Cout de l'attachement par role (bilan_memoire) */
+    memoire_role_t memoire[NB_ROLES];
+    
+    /* Equilibre des files, indice ROLE_VENDEUR ou ROLE_CAISSIER */
+    equilibre_t equilibre[2];
+} magasin_shm_t;
+
 /* ============== SEMAPHORES ============== */
 
 /* Index des semaphores dans l'ensemble */
-#define SEM_MUTEX_SHM       0   /* Mutex pour acces memoire partagee */
+#define SEM_MUTEX_SHM       0   /* Mutex memoire partagee (verrou futex) */
 #define SEM_MUTEX_LOG       1   /* Mutex pour le fichier de log */
 #define SEM_VENDEUR_BASE    2   /* Base pour les semaphores vendeurs */
 /* Les semaphores caissiers suivent : SEM_VENDEUR_BASE + nb_vendeurs + i */
@@ -153,17 +541,80 @@ extern int shm_id;              /* ID de la memoire partagee */
 extern int sem_id;              /* ID de l'ensemble de semaphores */
 extern int msg_vendeur_id;      /* ID de la file de messages vendeurs */
 extern int msg_caissier_id;     /* ID de la file de messages caissiers */
+extern int msg_reponse_vendeur_id;  /* File des reponses vendeur -> client */
+extern int msg_reponse_caissier_id; /* File des reponses caissier -> client */
 extern magasin_shm_t *shm;      /* Pointeur vers la memoire partagee */
 
+/* Tableaux du segment, places d'apres l'en-tete (creer_ipc, attacher_ipc) */
+extern vendeur_info_t *shm_vendeurs;
+extern caissier_info_t *shm_caissiers;
+extern int *shm_attente_vendeurs;           /* Longueur de la file de chaque
+                                               vendeur (sous son verrou) */
+extern int *shm_attente_caissiers;          /* Idem pour les caissiers */
+extern index_charge_t *shm_index_vendeurs;  /* Index des longueurs de file */
+extern index_charge_t *shm_index_caissiers;
+extern int *shm_annuaire;                   /* Vendeurs de chaque rayon */
+extern achat_info_t *shm_achats;            /* Achats en attente, par client */
+extern int *shm_places;                     /* Position de chaque client dans
+                                               sa file (queue_clients_t) */
+extern int *shm_files_vendeurs;             /* File de chaque vendeur (FILES) */
+extern int *shm_files_caissiers;            /* File de chaque caissier (FILES) */
+extern anneau_t *shm_anneaux_vendeurs;      /* Anneau de chaque vendeur */
+extern anneau_t *shm_anneaux_caissiers;     /* Anneau de chaque caissier */
+extern journal_t *shm_journaux;             /* Journaux des traces (log.c) */
+
 /* ============== FONCTIONS ============== */
 
+/*
+ * Fonction : choisir_instance
+ * Description : Choisit l'instance (nom) et le type de memoire partagee
+ *               avant creer_ipc ou attacher_ipc ; sans appel, le choix
+ *               est lu dans l'environnement (ENV_INSTANCE, ENV_MEMOIRE)
+ * Parametres :
+ *   - nom   : NULL ou "" pour l'instance par defaut
+ *   - posix : 1 pour shm_open + mmap (pages enormes si disponibles)
+ */
+void choisir_instance(const char *nom, int posix);
+
 /*
  * Fonction : creer_ipc
  * Description : Cree toutes les IPC (appele par le processus initial)
- * Parametres : nb_vendeurs, nb_caissiers, nb_clients
+ *               Le segment est dimensionne d'apres les nombres d'acteurs ;
+ *               les anneaux ne sont reserves qu'en TRANSPORT_ANNEAU
+ * Parametres : nb_vendeurs, nb_caissiers, nb_clients, transport
+ * Retour : 0 si succes, -1 si erreur
+ */
+int creer_ipc(int nb_vendeurs, int nb_caissiers, int nb_clients, int transport);
+
+/*
+ * Fonction : creer_files_acteurs
+ * Description : Cree une file de messages privee par vendeur et par
+ *               caissier, plus une file pour les reponses aux clients
+ *               (TRANSPORT_FILES). Les IDs sont publies en memoire partagee.
  * Retour : 0 si succes, -1 si erreur
  */
-int creer_ipc(int nb_vendeurs, int nb_caissiers, int nb_clients);
+int creer_files_acteurs(void);
+
+/*
+ * Fonction : creer_boites_threads
+ * Description : Cree les boites en memoire du processus du mode threads
+ *               (une par vendeur, par caissier et par client)
+ * Retour : 0 si succes, -1 si erreur
+ */
+int creer_boites_threads(void);
+
+/*
+ * Fonction : fermer_boites_threads
+ * Description : Reveille les acteurs en attente dans les boites du mode
+ *               threads ; leurs receptions echouent desormais (arret)
+ */
+void fermer_boites_threads(void);
+
+/*
+ * Fonction : detruire_boites_threads
+ * Description : Libere les boites du mode threads (threads acteurs termines)
+ */
+void detruire_boites_threads(void);
 
 /*
  * Fonction : attacher_ipc
@@ -184,9 +635,25 @@ void detacher_ipc(void);
  */
 void detruire_ipc(void);
 
+/*
+ * Fonction : verrou_prendre
+ * Description : Prend un verrou futex (CAS, courte attente active, puis
+ *               sommeil FUTEX_WAIT sous contention)
+ * Parametre : v - verrou en memoire partagee
+ */
+void verrou_prendre(verrou_t *v);
+
+/*
+ * Fonction : verrou_rendre
+ * Description : Libere un verrou futex (FUTEX_WAKE seulement si attente)
+ * Parametre : v - verrou en memoire partagee
+ */
+void verrou_rendre(verrou_t *v);
+
 /*
  * Fonction : sem_P
  * Description : Operation P (wait) sur un semaphore
+ *               SEM_MUTEX_SHM est redirige vers le verrou futex shm->verrou_shm
  * Parametre : sem_index - index du semaphore
  * Retour : 0 si succes, -1 si erreur
  */
@@ -208,9 +675,200 @@ int sem_V(int sem_index);
  */
 int sem_wait_zero(int sem_index);
 
+/*
+ * Fonction : recevoir_message
+ * Description : Reception bloquante d'un message de type mtype
+ *               Le processus dort jusqu'a l'arrivee du message : plus de
+ *               polling IPC_NOWAIT + usleep
+ * Parametres : file_id, msg, taille (sans le mtype), mtype
+ * Retour : 0 si succes, -1 si interrompu (EINTR) ou file detruite
+ */
+int recevoir_message(int file_id, void *msg, size_t taille, long mtype);
+
+/*
+ * Fonction : anneau_init
+ * Description : Initialise un anneau vide
+ */
+void anneau_init(anneau_t *a);
+
+/*
+ * Fonction : journal_init
+ * Description : Initialise un journal de traces vide
+ */
+void journal_init(journal_t *j);
+
+/*
+ * Fonction : anneau_deposer
+ * Description : Depose un message (producteur quelconque) et reveille le
+ *               consommateur s'il dort
+ * Parametres : a, msg, taille (mtype inclus, <= taille d'une cellule)
+ * Retour : 0 si succes, -1 si l'anneau est plein
+ */
+int anneau_deposer(anneau_t *a, const void *msg, size_t taille);
+
+/*
+ * Fonction : anneau_deposer_attendre
+ * Description : Depose un message, en dormant sur le futex libere tant
+ *               que l'anneau est plein
+ */
+void anneau_deposer_attendre(anneau_t *a, const void *msg, size_t taille);
+
+/*
+ * Fonction : anneau_retirer
+ * Description : Retire le plus ancien message (consommateur unique) et
+ *               reveille un producteur qui attend une place
+ * Retour : 0 si un message a ete lu, -1 si l'anneau est vide
+ */
+int anneau_retirer(anneau_t *a, void *msg, size_t taille);
+
+/*
+ * Fonction : anneau_attendre
+ * Description : Retire un message, en dormant sur le futex si vide
+ * Retour : 0 si succes, -1 si interrompu par un signal (EINTR)
+ */
+int anneau_attendre(anneau_t *a, void *msg, size_t taille);
+
+/*
+ * Fonction : envoyer_requete_vendeur / envoyer_requete_caissier
+ * Description : Envoie une requete de client par le transport choisi
+ *               (shm->transport) ; le destinataire est msg->vendeur_id
+ *               ou msg->caissier_id, le mtype est positionne ici
+ * Retour : 0 si succes, -1 si erreur
+ */
+int envoyer_requete_vendeur(msg_client_vendeur_t *msg);
+int envoyer_requete_caissier(msg_client_caissier_t *msg);
+
+/*
+ * Fonction : envoyer_reponse_vendeur / envoyer_reponse_caissier
+ * Description : Envoie une reponse a client_id sur la file des reponses
+ *               du transport choisi (mtype positionne ici)
+ * Retour : 0 si succes, -1 si erreur
+ */
+int envoyer_reponse_vendeur(int client_id, msg_vendeur_client_t *msg);
+int envoyer_reponse_caissier(int client_id, msg_caissier_client_t *msg);
+
+/*
+ * Fonction : envoyer_decision / recevoir_decision
+ * Description : Decision d'achat (deux protocoles), sur le type propre a la
+ *               session (MTYPE_DECISION) de la file des reponses vendeur :
+ *               le vendeur n'y voit jamais les requetes des autres clients
+ * Retour : 0 si succes, -1 si erreur ou interruption
+ */
+int envoyer_decision(msg_client_vendeur_t *msg);
+int recevoir_decision(int client_id, msg_client_vendeur_t *msg);
+
+/*
+ * Fonction : recevoir_reponse_vendeur / recevoir_reponse_caissier
+ * Description : Reception bloquante d'une reponse destinee a client_id
+ * Retour : 0 si succes, -1 si interrompu (EINTR) ou file detruite
+ */
+int recevoir_reponse_vendeur(int client_id, msg_vendeur_client_t *msg);
+int recevoir_reponse_caissier(int client_id, msg_caissier_client_t *msg);
+
+/*
+ * Fonction : recevoir_requete_vendeur / recevoir_requete_caissier
+ * Description : Reception bloquante de la prochaine requete d'un vendeur
+ *               ou d'un caissier, quel que soit le transport
+ * Retour : 0 si succes, -1 si interrompu (EINTR) ou file detruite
+ */
+int recevoir_requete_vendeur(int vendeur_id, msg_client_vendeur_t *msg);
+int recevoir_requete_caissier(int caissier_id, msg_client_caissier_t *msg);
+
+/*
+ * Fonction : envoyer_arret
+ * Description : Envoie un message d'arret (client_id = -1) a chaque vendeur
+ *               et caissier pour debloquer leur reception
+ */
+void envoyer_arret(void);
+
+/*
+ * Fonction : bilan_attente
+ * Description : Calcule les reveils effectues et ceux evites par rapport
+ *               a une boucle de polling, et les cumule en memoire partagee
+ *               (les compteurs du processus sont ensuite remis a zero)
+ * Parametres :
+ *   - periode_polling_us : periode du polling remplace (microsecondes)
+ *   - reveils, evites    : resultats (nombre de reveils)
+ *   - cpu_ms             : temps CPU consomme par le processus
+ */
+void bilan_attente(long periode_polling_us, long *reveils, long *evites,
+                   double *cpu_ms);
+
+/*
+ * Fonction : compter_lancement
+ * Description : Cumule en memoire partagee la latence de lancement d'un
+ *               client et son temps de preparation (nanosecondes)
+ */
+void compter_lancement(long long lancement_ns, long long preparation_ns);
+
+/*
+ * Fonction : bilan_memoire
+ * Description : Cumule en memoire partagee la duree d'attachement et les
+ *               fautes de page (a l'attachement, puis en service) du
+ *               processus appelant, pour son role
+ * Parametre : role - ROLE_VENDEUR, ROLE_CAISSIER ou ROLE_CLIENT
+ */
+void bilan_memoire(int role);
+
+/*
+ * Fonction : taille_index / index_init
+ * Description : Taille d'un index pour nb acteurs ; initialisation avec
+ *               tous les acteurs a 0 client
+ */
+size_t taille_index(int nb);
+void index_init(index_charge_t *ix, int nb);
+
+/*
+ * Fonction : index_deplacer
+ * Description : Fait passer l'acteur de la longueur ancienne a nouvelle
+ *               (appele sous le verrou de l'acteur)
+ */
+void index_deplacer(index_charge_t *ix, int acteur, int ancienne, int nouvelle);
+
+/*
+ * Fonction : index_moins_charge
+ * Description : Acteur de plus petite longueur de file, en O(MAX_QUEUE +
+ *               nb / 64) ; a egalite, le premier a partir du curseur, qui
+ *               avance apres chaque choix (tourniquet)
+ * Parametres : ix, attente (longueurs, pour le repli si l'index est vu
+ *              pendant un deplacement)
+ * Retour : Indice de l'acteur
+ */
+int index_moins_charge(index_charge_t *ix, const int *attente);
+
+/*
+ * Fonction : index_extremes
+ * Description : Plus courte et plus longue file d'apres l'index
+ *               (premier et dernier niveaux non vides)
+ * Parametres : ix, min, max (resultats)
+ */
+void index_extremes(index_charge_t *ix, int *min, int *max);
+
+/*
+ * Fonction : fixer_file_vendeur / fixer_file_caissier
+ * Description : Change la longueur de la file d'un acteur et met l'index
+ *               a jour (appele sous le verrou de l'acteur)
+ * Parametres : idx (vendeur ou caissier), longueur (0 a MAX_QUEUE)
+ */
+void fixer_file_vendeur(int idx, int longueur);
+void fixer_file_caissier(int idx, int longueur);
+
+/*
+ * Fonction : indice_minimum
+ * Description : Indice de la plus petite valeur d'un tableau (le premier
+ *               en cas d'egalite), par reduction vectorielle 4 entiers a
+ *               la fois
+ * Parametres : valeurs (n >= 1 entiers), n
+ * Retour : Indice du minimum
+ */
+int indice_minimum(const int *valeurs, int n);
+
 /*
  * Fonction : trouver_vendeur_moins_charge
  * Description : Trouve le vendeur avec la file d'attente la plus courte
+ *               (index_moins_charge ; egalites departagees en tourniquet)
+ *               Lecture sans verrou (instantane) : le resultat est une
+ *               indication, la file est modifiee sous le verrou du vendeur
  * Retour : Index du vendeur
  */
 int trouver_vendeur_moins_charge(void);
@@ -218,13 +876,133 @@ int trouver_vendeur_moins_charge(void);
 /*
  * Fonction : trouver_caissier_moins_charge
  * Description : Trouve le caissier avec la file d'attente la plus courte
+ *               Lecture sans verrou, comme pour les vendeurs
  * Retour : Index du caissier
  */
 int trouver_caissier_moins_charge(void);
 
+/*
+ * Fonction : nom_routage
+ * Description : Nom d'une politique de routage (option -r de main)
+ * Retour : "redirection", "direct", "deux" ou "ewma"
+ */
+const char *nom_routage(int routage);
+
+/*
+ * Fonction : choisir_vendeur
+ * Description : Premier vendeur d'un client selon shm->routage
+ * Parametre : rayon - rayon recherche par le client
+ * Retour : Index du vendeur
+ */
+int choisir_vendeur(int rayon);
+
+/*
+ * Fonction : noter_service_vendeur
+ * Description : Met a jour la duree moyenne (EWMA) des discussions du
+ *               vendeur (appele par le vendeur apres chaque discussion)
+ * Parametres : vendeur_id, duree_ms
+ */
+void noter_service_vendeur(int vendeur_id, int duree_ms);
+
+/*
+ * Fonction : compter_premier_service
+ * Description : Cumule le delai entre l'entree d'un client et le debut de
+ *               sa discussion avec un vendeur competent
+ * Parametre : entree_ns - entree du client (msg_client_vendeur_t)
+ */
+void compter_premier_service(long long entree_ns);
+
+/*
+ * Fonction : reserver_vendeur
+ * Description : Choisit le premier vendeur d'un client (choisir_vendeur) et
+ *               l'inscrit dans sa file en une operation : sous le verrou du
+ *               vendeur, la longueur de file vue au moment du choix est
+ *               verifiee ; si un autre client s'est inscrit entre-temps,
+ *               le choix est refait (au plus ESSAIS_RESERVATION fois)
+ * Parametres : rayon, client_id
+ * Retour : Index du vendeur, FILE_PLEINE si sa file est pleine
+ */
+int reserver_vendeur(int rayon, int client_id);
+
+/*
+ * Fonction : reserver_caissier
+ * Description : Meme operation pour le caissier le moins charge
+ * Parametre : client_id
+ * Retour : Index du caissier, FILE_PLEINE si sa file est pleine
+ */
+int reserver_caissier(int client_id);
+
+/*
+ * Fonction : entrer_file_vendeur
+ * Description : Inscrit un client dans la file d'un vendeur impose
+ *               (redirection)
+ * Parametres : vendeur_idx, client_id
+ * Retour : 0, FILE_PLEINE si la file du vendeur est pleine
+ */
+int entrer_file_vendeur(int vendeur_idx, int client_id);
+
+/*
+ * Fonction : sortir_file_vendeur
+ * Description : Retire un client de la file d'un vendeur
+ * Parametres : vendeur_idx, client_id
+ */
+void sortir_file_vendeur(int vendeur_idx, int client_id);
+
+/*
+ * Fonction : terminer_paiement
+ * Description : Retire le client de la file du caissier, libere le
+ *               caissier et compte le paiement (servis, encaisse) en une
+ *               seule modification de la fiche, puis ajoute le montant au
+ *               chiffre d'affaires
+ * Parametres : caissier_idx, client_id, montant
+ */
+void terminer_paiement(int caissier_idx, int client_id, int montant);
+
+/*
+ * Fonction : lire_queue
+ * Description : Copie les clients d'une file dans l'ordre d'arrivee (sans
+ *               verrou : vue approximative, pour l'affichage)
+ * Parametres : queue, ids (resultat), max
+ * Retour : Nombre de clients copies
+ */
+int lire_queue(const queue_clients_t *queue, int *ids, int max);
+
+/*
+ * Fonction : sequence_ouvrir / sequence_fermer
+ * Description : Encadrent une modification de la fiche d'un acteur (sous
+ *               son verrou) : la sequence est impaire entre les deux
+ * Parametre : sequence (champ sequence de la fiche)
+ */
+void sequence_ouvrir(unsigned int *sequence);
+void sequence_fermer(unsigned int *sequence);
+
+/*
+ * Fonction : instantane_vendeur / instantane_caissier
+ * Description : Copie coherente d'une fiche et de sa file, sans verrou :
+ *               la lecture est refaite tant qu'une modification l'a
+ *               chevauchee (sequence impaire ou changee), au plus
+ *               RELECTURES_MAX fois (sinon copie->perime = 1) ;
+ *               copie->sequence permet de ne la refaire que si la fiche a
+ *               change depuis
+ * Parametres : idx, copie (resultat)
+ * Retour : Nombre de relectures
+ */
+int instantane_vendeur(int idx, instantane_acteur_t *copie);
+int instantane_caissier(int idx, instantane_acteur_t *copie);
+
+/*
+ * Fonction : construire_annuaire
+ * Description : Range chaque vendeur dans la liste de son rayon (appele
+ *               par le processus initial une fois les rayons attribues,
+ *               avant le lancement des acteurs)
+ */
+void construire_annuaire(void);
+
 /*
  * Fonction : trouver_vendeur_pour_rayon
- * Description : Trouve un vendeur competent pour un rayon donne
+ * Description : Trouve le vendeur competent le moins charge pour un rayon
+ *               donne (parmi les vendeurs du rayon dans l'annuaire ; a
+ *               egalite, a tour de role)
  * Parametre : rayon - numero du rayon (0 a NB_RAYONS-1)
  * Retour : Index du vendeur
  */
@@ -6,10 +6,26 @@
  * Ce module gere l'ecriture des logs dans :
  *   - Le terminal (stdout pour les messages, stderr pour les erreurs)
  *   - Un fichier de log (magasin.log)
+ *   - Un fichier d'evenements binaires (magasin.evt, relu par ./logdump)
  * 
- * Les acces sont proteges par un semaphore mutex pour eviter les melanges
+ * Une fois le processus journal lance (lancer_journal), chaque acteur
+ * depose ses evenements dans son journal en memoire partagee, sans verrou,
+ * sans formatage ni entree/sortie ; le processus journal les releve par
+ * ordre d'horodatage, les ajoute a magasin.evt et ecrit leur texte par
+ * lots. Avant (et sans IPC, moteur -E), les messages sont ecrits
+ * directement, proteges par un semaphore mutex pour eviter les melanges
  * de messages entre processus.
  * 
+ * La sortie choisie (log_sortie, shm->sortie_log) s'applique aux deux
+ * chemins ; avec SORTIE_AUCUNE, un evenement ne coute qu'un test, et
+ * seuls les bilans (NIVEAU_BILAN) et les erreurs sont ecrits, directement
+ * sur le terminal.
+ * 
+ * Horodatage : horloge monotone (horloge_ns, lue par le vDSO) plus un
+ * ecart unique avec l'horloge murale, publie dans la memoire partagee :
+ * les lignes de tous les processus se trient a la nanoseconde. Le
+ * prefixe "HH:MM:SS" n'est reformate qu'une fois par seconde.
+ * 
  * =============================================================================
  */
 
@@ -19,22 +35,71 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
 #include <sys/file.h>
+#include <sys/wait.h>
+#include "utils.h"
+
+/* Declaration des noms de rayons */
+DECLARE_NOMS_RAYONS;
 
 /* Fichier de log (partage entre tous les processus) */
 static FILE *log_file = NULL;
 
+/* Journal et identite du thread (log_producteur ; par defaut : processus
+   initial) */
+static __thread int journal_courant = 0;
+static __thread int role_courant = ROLE_INITIAL;
+static __thread int id_courant = 0;
+
+/* Processus producteur, note dans chaque cellule reservee (0 : getpid) */
+static pid_t pid_producteur = 0;
+
+/* Sortie des logs tant que la memoire partagee n'est pas attachee */
+static int sortie_locale = SORTIE_TOUT;
+
+/* Ecart horloge murale - horloge_ns mesure par ce processus (0 : pas
+   encore mesure), en attendant celui de la memoire partagee */
+static long long decalage_local = 0;
+
+/* Derniere seconde formatee et son "HH:MM:SS" (cache par thread) */
+static __thread long long seconde_cache = -1;
+static __thread char heure_cache[16];
+
+/* Processus journal (connu du seul processus initial) */
+static pid_t pid_journal = 0;
+
+/* Noms des types d'evenements (colonne type du CSV de logdump) */
+static const char *NOMS_TRACES[NB_TRACES] = {
+    "texte", "horloge",
+    "entree", "choix_vendeur", "va_vendeur", "redirection", "file_pleine",
+    "vendeurs_pleins", "discussion", "discussion_fin", "quitte", "sans_achat",
+    "achat", "caisses_pleines", "va_caissier", "doit_payer", "paye",
+    "paiement", "sortie",
+    "vendeur_pret", "demande", "discussion_client", "vente", "refus_achat",
+    "fin_service",
+    "caisse_ouverte", "arrivee_caisse", "a_payer", "encaisse", "caisse_fermee",
+    "demarrage", "attente_clients", "clients_termines", "arret_acteurs",
+    "signal", "nettoyage", "fin"
+};
+
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : log_init
- * Description : Ouvre le fichier de log en mode ajout
+ * Description : Ouvre le fichier de log en mode ajout (sauf si la sortie
+ *               choisie l'exclut)
  * Retour      : 0 si succes, -1 si erreur
  * -----------------------------------------------------------------------------
  */
 int log_init(void) {
+    if (sortie_locale == SORTIE_TERMINAL || sortie_locale == SORTIE_AUCUNE) {
+        return 0;
+    }
     log_file = fopen(FICHIER_LOG, "a");
     if (log_file == NULL) {
         perror("[ERREUR] Ouverture fichier de log");
@@ -56,58 +121,261 @@ void log_close(void) {
     }
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : log_sortie
+ * Description : Choisit la sortie des logs (publiee dans la memoire
+ *               partagee si elle est attachee)
+ * Parametre   : sortie - SORTIE_*
+ * -----------------------------------------------------------------------------
+ */
+void log_sortie(int sortie) {
+    sortie_locale = sortie;
+    if (shm != NULL) {
+        shm->sortie_log = sortie;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : nom_sortie
+ * Description : Nom d'une sortie des logs
+ * Parametre   : sortie - SORTIE_*
+ * Retour      : Nom, NULL si inconnue
+ * -----------------------------------------------------------------------------
+ */
+const char *nom_sortie(int sortie) {
+    switch (sortie) {
+    case SORTIE_TOUT:     return "tout";
+    case SORTIE_FICHIER:  return "fichier";
+    case SORTIE_TERMINAL: return "terminal";
+    case SORTIE_AUCUNE:   return "aucune";
+    default:              return NULL;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : sortie_courante
+ * Description : Sortie des logs en vigueur (celle de la simulation une fois
+ *               la memoire partagee attachee)
+ * Retour      : SORTIE_*
+ * -----------------------------------------------------------------------------
+ */
+static int sortie_courante(void) {
+    return (shm != NULL) ? shm->sortie_log : sortie_locale;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : decalage_horloge
+ * Description : Ecart entre horloge murale et horloge_ns : celui de la
+ *               simulation (shm) s'il est publie, sinon celui mesure une
+ *               fois par ce processus
+ * Retour      : Ecart en nanosecondes
+ * -----------------------------------------------------------------------------
+ */
+static long long decalage_horloge(void) {
+    struct timespec reel;
+    
+    if (shm != NULL && shm->decalage_horloge != 0) {
+        return shm->decalage_horloge;
+    }
+    if (decalage_local == 0) {
+        clock_gettime(CLOCK_REALTIME, &reel);
+        decalage_local = reel.tv_sec * 1000000000LL + reel.tv_nsec - horloge_ns();
+    }
+    return decalage_local;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : heure_seconde
+ * Description : "HH:MM:SS" d'un instant ; localtime_r et strftime ne sont
+ *               appeles qu'au changement de seconde
+ * Parametre   : ns - instant de l'horloge murale en nanosecondes
+ * Retour      : Chaine du cache du thread (valide jusqu'au prochain appel)
+ * -----------------------------------------------------------------------------
+ */
+const char *heure_seconde(long long ns) {
+    long long seconde = ns / 1000000000LL;
+    time_t secondes = (time_t)seconde;
+    struct tm tm_info;
+    
+    if (seconde != seconde_cache) {
+        localtime_r(&secondes, &tm_info);
+        strftime(heure_cache, sizeof(heure_cache), "%H:%M:%S", &tm_info);
+        seconde_cache = seconde;
+    }
+    return heure_cache;
+}
+
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : get_timestamp
- * Description : Obtient l'horodatage actuel au format HH:MM:SS
+ * Description : Obtient l'horodatage actuel au format HH:MM:SS.nnnnnnnnn
  * Parametres  :
  *   - buffer : buffer pour stocker le resultat
  *   - size   : taille du buffer
  * -----------------------------------------------------------------------------
  */
 static void get_timestamp(char *buffer, size_t size) {
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(buffer, size, "%H:%M:%S", tm_info);
+    long long ns = horloge_ns() + decalage_horloge();
+    
+    snprintf(buffer, size, "%s.%09lld", heure_seconde(ns), ns % 1000000000LL);
 }
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : log_message
- * Description : Ecrit un message de log avec horodatage
- *               Le message est ecrit dans stdout ET dans le fichier de log
- *               L'acces est protege par un mutex (semaphore)
- * Parametres  :
- *   - auteur : identifiant de l'auteur du message
- *   - format : chaine de format (printf-like)
- *   - ...    : arguments variables
+ * Fonction    : nom_trace
+ * Description : Nom court d'un type d'evenement
+ * Parametre   : type
+ * Retour      : Nom, "?" si inconnu
  * -----------------------------------------------------------------------------
  */
-void log_message(const char *auteur, const char *format, ...) {
-    char timestamp[16];
-    char message[512];
-    va_list args;
+const char *nom_trace(int type) {
+    return (type >= 0 && type < NB_TRACES) ? NOMS_TRACES[type] : "?";
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : auteur_trace
+ * Description : Auteur d'un evenement : deduit de l'acteur, ou lu en tete
+ *               de la charge utile pour TRACE_TEXTE ("auteur\0message")
+ * Parametres  : t, texte, buffer, taille
+ * -----------------------------------------------------------------------------
+ */
+void auteur_trace(const trace_t *t, const char *texte, char *buffer, size_t taille) {
+    if (t->type == TRACE_TEXTE && texte != NULL) {
+        snprintf(buffer, taille, "%s", texte);
+    } else if (t->acteur == ROLE_VENDEUR) {
+        snprintf(buffer, taille, "VENDEUR %d", t->id);
+    } else if (t->acteur == ROLE_CAISSIER) {
+        snprintf(buffer, taille, "CAISSIER %d", t->id);
+    } else if (t->acteur == ROLE_CLIENT) {
+        snprintf(buffer, taille, "CLIENT %d", t->id);
+    } else {
+        snprintf(buffer, taille, "INITIAL");
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : message_trace
+ * Description : Texte d'un evenement (celui des anciens log_message)
+ * Parametres  : t, texte, buffer, taille
+ * -----------------------------------------------------------------------------
+ */
+void message_trace(const trace_t *t, const char *texte, char *buffer, size_t taille) {
+    const char *rayon = (t->rayon >= 0 && t->rayon < NB_RAYONS) ? NOMS_RAYONS[t->rayon] : "?";
     
-    /* Formater le message utilisateur */
-    va_start(args, format);
-    vsnprintf(message, sizeof(message), format, args);
-    va_end(args);
+    switch (t->type) {
+    case TRACE_TEXTE:
+        snprintf(buffer, taille, "%s", texte != NULL ? texte + strlen(texte) + 1 : "");
+        break;
+    case TRACE_HORLOGE:          snprintf(buffer, taille, "Debut du journal"); break;
+    case TRACE_ENTREE:           snprintf(buffer, taille, "Entre, cherche rayon: %s", rayon); break;
+    case TRACE_CHOIX_VENDEUR:    snprintf(buffer, taille, "Choisit vendeur %d", t->cible); break;
+    case TRACE_VA_VENDEUR:       snprintf(buffer, taille, "Va vers vendeur %d", t->cible); break;
+    case TRACE_REDIRECTION:      snprintf(buffer, taille, "Redirection vers vendeur %d", t->cible); break;
+    case TRACE_FILE_PLEINE:      snprintf(buffer, taille, "File du vendeur %d pleine", t->cible); break;
+    case TRACE_VENDEURS_PLEINS:  snprintf(buffer, taille, "Files des vendeurs pleines, quitte le magasin"); break;
+    case TRACE_DISCUSSION:       snprintf(buffer, taille, "Discussion en cours..."); break;
+    case TRACE_DISCUSSION_FIN:   snprintf(buffer, taille, "Discussion terminee"); break;
+    case TRACE_QUITTE:           snprintf(buffer, taille, "Quitte le magasin"); break;
+    case TRACE_SANS_ACHAT:       snprintf(buffer, taille, "N'achete pas, quitte le magasin"); break;
+    case TRACE_ACHAT:            snprintf(buffer, taille, "Decide d'acheter!"); break;
+    case TRACE_CAISSES_PLEINES:  snprintf(buffer, taille, "Files des caisses pleines, quitte le magasin"); break;
+    case TRACE_VA_CAISSIER:      snprintf(buffer, taille, "Va vers caissier %d", t->cible); break;
+    case TRACE_DOIT_PAYER:       snprintf(buffer, taille, "Doit payer %d euros", t->montant); break;
+    case TRACE_PAYE:             snprintf(buffer, taille, "Paye %d euros", t->montant); break;
+    case TRACE_PAIEMENT:         snprintf(buffer, taille, "Paiement effectue!"); break;
+    case TRACE_SORTIE:           snprintf(buffer, taille, "Quitte avec ses achats. Au revoir!"); break;
+    case TRACE_VENDEUR_PRET:     snprintf(buffer, taille, "Pret. Rayon: %s (%d)", rayon, t->rayon); break;
+    case TRACE_DEMANDE:          snprintf(buffer, taille, "Client %d demande rayon %s", t->client, rayon); break;
+    case TRACE_DISCUSSION_CLIENT: snprintf(buffer, taille, "Discussion avec client %d", t->client); break;
+    case TRACE_VENTE:            snprintf(buffer, taille, "Vente conclue: %d euros", t->montant); break;
+    case TRACE_REFUS_ACHAT:      snprintf(buffer, taille, "Client %d n'achete pas", t->client); break;
+    case TRACE_FIN_SERVICE:      snprintf(buffer, taille, "Fin du service"); break;
+    case TRACE_CAISSE_OUVERTE:   snprintf(buffer, taille, "Caisse ouverte"); break;
+    case TRACE_ARRIVEE_CAISSE:   snprintf(buffer, taille, "Client %d arrive", t->client); break;
+    case TRACE_A_PAYER:          snprintf(buffer, taille, "Client %d doit payer %d euros", t->client, t->montant); break;
+    case TRACE_ENCAISSE:         snprintf(buffer, taille, "Client %d a paye %d euros", t->client, t->montant); break;
+    case TRACE_CAISSE_FERMEE:    snprintf(buffer, taille, "Caisse fermee"); break;
+    case TRACE_DEMARRAGE:        snprintf(buffer, taille, "=== Demarrage de la simulation ==="); break;
+    case TRACE_ATTENTE_CLIENTS:  snprintf(buffer, taille, "En attente de la fin des clients..."); break;
+    case TRACE_CLIENTS_TERMINES: snprintf(buffer, taille, "Tous les clients ont termine."); break;
+    case TRACE_ARRET_ACTEURS:    snprintf(buffer, taille, "Arret des vendeurs et caissiers..."); break;
+    case TRACE_SIGNAL:           snprintf(buffer, taille, "Signal recu [%d], arret du programme...", t->cible); break;
+    case TRACE_NETTOYAGE:        snprintf(buffer, taille, "Nettoyage des IPC..."); break;
+    case TRACE_FIN:              snprintf(buffer, taille, "=== Simulation terminee ==="); break;
+    default:                     snprintf(buffer, taille, "Evenement %d", t->type); break;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : formater_trace
+ * Description : Ligne complete d'un evenement, au format de magasin.log
+ * Parametres  : t, texte, decalage (horloge murale - horloge_ns), ligne,
+ *               taille
+ * Retour      : Longueur de la ligne
+ * -----------------------------------------------------------------------------
+ */
+int formater_trace(const trace_t *t, const char *texte, long long decalage,
+                   char *ligne, size_t taille) {
+    char auteur[32];
+    char message[TAILLE_TEXTE_TRACE + 64];
+    long long ns = t->ns + decalage;
+    int n;
+
+    auteur_trace(t, texte, auteur, sizeof(auteur));
+    message_trace(t, texte, message, sizeof(message));
+
+    n = snprintf(ligne, taille, "[%s.%09lld][%s]%s %s\n", heure_seconde(ns),
+                 ns % 1000000000LL, auteur, t->erreur ? "[ERREUR]" : "", message);
+    return (n >= (int)taille) ? (int)taille - 1 : n;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : ecrire_directement
+ * Description : Ecriture sans processus journal : terminal (stdout, ou
+ *               stderr pour une erreur) et/ou fichier de log selon la
+ *               sortie, sous mutex ; une erreur va toujours sur stderr,
+ *               un bilan sur stdout avec SORTIE_AUCUNE
+ * Parametres  : erreur, auteur, message
+ * -----------------------------------------------------------------------------
+ */
+static void ecrire_directement(int erreur, const char *auteur, const char *message) {
+    char timestamp[32];
+    const char *marque = erreur ? "[ERREUR]" : "";
+    int sortie = sortie_courante();
+    int terminal = erreur || sortie != SORTIE_FICHIER;
+    int fichier = sortie == SORTIE_TOUT || sortie == SORTIE_FICHIER;
     
-    /* Obtenir l'horodatage actuel */
-    get_timestamp(timestamp, sizeof(timestamp));
+    if (!terminal && !fichier) {
+        return;
+    }
     
     /* Prendre le mutex pour eviter les melanges de messages */
     if (sem_id != -1) {
         sem_P(SEM_MUTEX_LOG);
     }
     
+    /* Horodatage pris sous le mutex : l'ordre du fichier est celui des
+       horodatages */
+    get_timestamp(timestamp, sizeof(timestamp));
+    
     /* Ecrire dans le terminal */
-    printf("[%s][%s] %s\n", timestamp, auteur, message);
-    fflush(stdout);
+    if (terminal) {
+        fprintf(erreur ? stderr : stdout, "[%s][%s]%s %s\n", timestamp, auteur, marque, message);
+        fflush(erreur ? stderr : stdout);
+    }
     
     /* Ecrire dans le fichier de log */
-    if (log_file != NULL) {
-        fprintf(log_file, "[%s][%s] %s\n", timestamp, auteur, message);
+    if (fichier && log_file != NULL) {
+        fprintf(log_file, "[%s][%s]%s %s\n", timestamp, auteur, marque, message);
         fflush(log_file);
     }
     
@@ -117,6 +385,552 @@ void log_message(const char *auteur, const char *format, ...) {
     }
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : log_producteur
+ * Description : Note l'acteur du thread appelant et choisit son journal :
+ *               le sien pour un vendeur ou un caissier, un des
+ *               NB_JOURNAUX_CLIENTS journaux partages pour un client
+ * Parametres  : role, id
+ * -----------------------------------------------------------------------------
+ */
+void log_producteur(int role, int id) {
+    int base;
+    
+    role_courant = role;
+    id_courant = id;
+    pid_producteur = getpid();
+    if (shm == NULL) {
+        return;
+    }
+    base = 1 + shm->nb_vendeurs + shm->nb_caissiers;
+    if (role == ROLE_VENDEUR) {
+        journal_courant = 1 + id;
+    } else if (role == ROLE_CAISSIER) {
+        journal_courant = 1 + shm->nb_vendeurs + id;
+    } else if (shm->nb_journaux > base) {
+        journal_courant = base + id % (shm->nb_journaux - base);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : reserver_cellule
+ * Description : Reserve une cellule du journal du thread (comme
+ *               anneau_deposer) et y remplit l'en-tete de l'evenement.
+ *               Journal plein : la trace est perdue et comptee, l'acteur
+ *               n'attend jamais.
+ * Parametres  : type, erreur, pos (position reservee, resultat)
+ * Retour      : Cellule a completer puis publier (publier_cellule), NULL
+ *               si perdue ; *pos = -1 si le processus journal ne tourne pas
+ * -----------------------------------------------------------------------------
+ */
+static cellule_journal_t *reserver_cellule(int type, int erreur, long long *pos) {
+    journal_t *j;
+    cellule_journal_t *c;
+    unsigned int p, seq;
+    int diff;
+    
+    if (shm == NULL || shm_journaux == NULL ||
+        !__atomic_load_n(&shm->journal_actif, __ATOMIC_ACQUIRE)) {
+        *pos = -1;
+        return NULL;
+    }
+    
+    j = &shm_journaux[journal_courant];
+    p = __atomic_load_n(&j->ecriture, __ATOMIC_RELAXED);
+    for (;;) {
+        c = &j->traces[p & (TAILLE_JOURNAL - 1)];
+        seq = __atomic_load_n(&c->sequence, __ATOMIC_ACQUIRE);
+        diff = (int)(seq - p);
+    
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&j->ecriture, &p, p + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Le processus journal n'a pas encore releve cette cellule */
+            __atomic_fetch_add(&j->perdues, 1, __ATOMIC_RELAXED);
+            *pos = 0;
+            return NULL;
+        } else {
+            p = __atomic_load_n(&j->ecriture, __ATOMIC_RELAXED);
+        }
+    }
+    
+    __atomic_store_n(&c->proprietaire, pid_producteur ? pid_producteur : getpid(),
+                     __ATOMIC_RELAXED);
+    c->trace.ns = horloge_ns();
+    c->trace.type = type;
+    c->trace.acteur = role_courant;
+    c->trace.erreur = erreur;
+    c->trace.id = id_courant;
+    *pos = p;
+    return c;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : publier_cellule
+ * Description : Rend la cellule visible au processus journal
+ * Parametres  : c, pos (de reserver_cellule)
+ * -----------------------------------------------------------------------------
+ */
+static void publier_cellule(cellule_journal_t *c, long long pos) {
+    __atomic_store_n(&c->sequence, (unsigned int)pos + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : deposer_texte
+ * Description : Depose un message libre (TRACE_TEXTE), formate sur place
+ *               dans la cellule : "auteur\0message"
+ * Parametres  : erreur (1 : log_erreur), auteur, format, args
+ * Retour      : 0 si la trace est prise en charge (deposee ou perdue),
+ *               -1 si le processus journal ne tourne pas
+ * -----------------------------------------------------------------------------
+ */
+static int deposer_texte(int erreur, const char *auteur, const char *format, va_list args) {
+    long long pos;
+    cellule_journal_t *c = reserver_cellule(TRACE_TEXTE, erreur, &pos);
+    int n;
+    
+    if (c == NULL) {
+        return (pos < 0) ? -1 : 0;
+    }
+    n = snprintf(c->texte, TAILLE_TEXTE_TRACE / 4, "%s", auteur);
+    if (n >= TAILLE_TEXTE_TRACE / 4) {
+        n = TAILLE_TEXTE_TRACE / 4 - 1;
+    }
+    n++;
+    n += vsnprintf(c->texte + n, TAILLE_TEXTE_TRACE - n, format, args);
+    if (n >= TAILLE_TEXTE_TRACE) {
+        n = TAILLE_TEXTE_TRACE - 1;
+    }
+    c->trace.client = -1;
+    c->trace.cible = -1;
+    c->trace.rayon = -1;
+    c->trace.montant = n + 1;
+    publier_cellule(c, pos);
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : log_evenement
+ * Description : Enregistre un evenement binaire, sans formatage ; sans
+ *               processus journal, son texte est ecrit directement
+ * Parametres  : niveau, type, client, cible, rayon, montant
+ * -----------------------------------------------------------------------------
+ */
+void log_evenement(int niveau, int type, int client, int cible, int rayon, int montant) {
+    long long pos;
+    cellule_journal_t *c;
+    trace_t t;
+    char auteur[32];
+    char message[TAILLE_TEXTE_TRACE];
+    
+    if (niveau < NIVEAU_BILAN && sortie_courante() == SORTIE_AUCUNE) {
+        return;
+    }
+    c = reserver_cellule(type, 0, &pos);
+    if (c != NULL) {
+        c->trace.client = client;
+        c->trace.cible = cible;
+        c->trace.rayon = rayon;
+        c->trace.montant = montant;
+        publier_cellule(c, pos);
+        return;
+    }
+    if (pos == 0) {
+        return;     /* Journal plein : perdue */
+    }
+    
+    memset(&t, 0, sizeof(t));
+    t.type = type;
+    t.acteur = role_courant;
+    t.id = id_courant;
+    t.client = client;
+    t.cible = cible;
+    t.rayon = rayon;
+    t.montant = montant;
+    auteur_trace(&t, NULL, auteur, sizeof(auteur));
+    message_trace(&t, NULL, message, sizeof(message));
+    ecrire_directement(0, auteur, message);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : ecrire_tout
+ * Description : write() complet d'un tampon (reprend apres une ecriture
+ *               partielle ou un signal)
+ * Parametres  : fd, tampon, taille
+ * -----------------------------------------------------------------------------
+ */
+static void ecrire_tout(int fd, const char *tampon, size_t taille) {
+    ssize_t n;
+    
+    while (fd >= 0 && taille > 0) {
+        n = write(fd, tampon, taille);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        tampon += n;
+        taille -= n;
+    }
+}
+
+/* Traces relevees et pas encore ecrites (processus journal seul) : copies
+   dans releve[], libres[] liste les copies disponibles, a_ecrire[] pointe
+   les copies occupees, triees par horodatage avant chaque ecriture */
+static cellule_journal_t *releve = NULL;
+static cellule_journal_t **a_ecrire = NULL;
+static int *libres = NULL;
+static long long *bloque_depuis = NULL;     /* Par journal : tete reservee
+                                               mais non publiee depuis */
+static int nb_a_ecrire = 0, nb_libres = 0;
+static unsigned int rang_releve = 0;        /* Ordre de releve (egalites) */
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : relever_journaux
+ * Description : Copie les traces publiees de chaque journal, dans l'ordre
+ *               du journal, et rend aussitot leurs cellules aux
+ *               producteurs. Une cellule reservee mais toujours pas publiee
+ *               apres RETARD_JOURNAL_NS n'est abandonnee (et comptee
+ *               perdue) que si le processus qui l'a reservee est mort, ou
+ *               apres l'arret du journal : un producteur seulement lent
+ *               finit toujours d'ecrire dans sa cellule avant qu'elle ne
+ *               soit rendue. Un TRACE_TEXTE de longueur invalide est
+ *               compte perdu, et son texte est toujours termine.
+ * Parametres  : actif (journal pas encore arrete), en_suspens (resultat)
+ * Retour      : Nombre de traces relevees ; *en_suspens : journaux dont la
+ *               tete attend encore sa publication
+ * -----------------------------------------------------------------------------
+ */
+static int relever_journaux(int actif, int *en_suspens) {
+    long long maintenant = horloge_ns();
+    cellule_journal_t *copie;
+    journal_t *j;
+    cellule_journal_t *c;
+    unsigned int seq;
+    pid_t proprietaire;
+    int releves = 0;
+    int i;
+    
+    *en_suspens = 0;
+    for (i = 0; i < shm->nb_journaux; i++) {
+        j = &shm_journaux[i];
+        while (nb_libres > 0) {
+            c = &j->traces[j->lecture & (TAILLE_JOURNAL - 1)];
+            seq = __atomic_load_n(&c->sequence, __ATOMIC_ACQUIRE);
+    
+            if (seq == j->lecture + 1) {
+                copie = &releve[libres[nb_libres - 1]];
+                copie->trace = c->trace;
+                if (c->trace.type == TRACE_TEXTE) {
+                    memcpy(copie->texte, c->texte, TAILLE_TEXTE_TRACE);
+                    copie->texte[TAILLE_TEXTE_TRACE - 1] = '\0';
+                }
+                __atomic_store_n(&c->proprietaire, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&c->sequence, j->lecture + TAILLE_JOURNAL, __ATOMIC_RELEASE);
+                j->lecture++;
+                bloque_depuis[i] = 0;
+    
+                /* Meme controle que logdump */
+                if (copie->trace.type == TRACE_TEXTE &&
+                    (copie->trace.montant <= 0 || copie->trace.montant > TAILLE_TEXTE_TRACE)) {
+                    __atomic_fetch_add(&j->perdues, 1, __ATOMIC_RELAXED);
+                    continue;
+                }
+                nb_libres--;
+                copie->sequence = rang_releve++;
+                a_ecrire[nb_a_ecrire++] = copie;
+                releves++;
+                continue;
+            }
+            if (seq != j->lecture ||
+                __atomic_load_n(&j->ecriture, __ATOMIC_RELAXED) == j->lecture) {
+                break;      /* Journal vide */
+            }
+    
+            /* Cellule reservee, pas encore publiee */
+            if (bloque_depuis[i] == 0) {
+                bloque_depuis[i] = maintenant;
+            }
+            proprietaire = __atomic_load_n(&c->proprietaire, __ATOMIC_RELAXED);
+            if (maintenant - bloque_depuis[i] <= RETARD_JOURNAL_NS ||
+                (actif && (proprietaire == 0 || kill(proprietaire, 0) == 0 || errno != ESRCH))) {
+                (*en_suspens)++;
+                break;
+            }
+    
+            /* Proprietaire mort (ou journal arrete : plus aucune
+               reservation, la cellule ne sera pas reutilisee) */
+            __atomic_store_n(&c->proprietaire, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&c->sequence, j->lecture + TAILLE_JOURNAL, __ATOMIC_RELEASE);
+            j->lecture++;
+            __atomic_fetch_add(&j->perdues, 1, __ATOMIC_RELAXED);
+            bloque_depuis[i] = 0;
+        }
+    }
+    return releves;
+}
+
+/* Ordre d'ecriture : horodatage, puis ordre de releve */
+static int comparer_traces(const void *a, const void *b) {
+    const cellule_journal_t *x = *(cellule_journal_t * const *)a;
+    const cellule_journal_t *y = *(cellule_journal_t * const *)b;
+    
+    if (x->trace.ns != y->trace.ns) {
+        return (x->trace.ns < y->trace.ns) ? -1 : 1;
+    }
+    return (int)(x->sequence - y->sequence);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : executer_journal
+ * Description : Boucle du processus journal : a chaque releve, copie les
+ *               traces publiees de tous les journaux (relever_journaux),
+ *               les trie par horodatage et ecrit celles plus vieilles que
+ *               RETARD_JOURNAL_NS ; les plus recentes attendent le releve
+ *               suivant. Le tri remet dans l'ordre les traces d'un journal
+ *               partage par plusieurs clients (une cellule reservee avant
+ *               une autre peut porter un horodatage plus tardif). Chaque
+ *               trace ajoute son enregistrement binaire (suivi du texte
+ *               pour TRACE_TEXTE, complete a un multiple de
+ *               sizeof(trace_t)) au tampon d'evenements et sa ligne de
+ *               texte aux tampons fichier et terminal ; chaque tampon est
+ *               vide par un seul write(). Apres arreter_journal (ou la mort
+ *               du processus initial), vide tout et termine. Seules les
+ *               sorties choisies (shm->sortie_log) sont ecrites.
+ * -----------------------------------------------------------------------------
+ */
+static void executer_journal(void) {
+    static char fichier[TAMPON_JOURNAL];
+    static char terminal[TAMPON_JOURNAL];
+    static char binaire[TAMPON_JOURNAL];
+    size_t n_fichier = 0, n_terminal = 0, n_binaire = 0;
+    long long decalage = decalage_horloge();
+    long long limite;
+    long ecrites = 0, perdues = 0;
+    int sortie = shm->sortie_log;
+    int fichiers = sortie == SORTIE_TOUT || sortie == SORTIE_FICHIER;
+    int fd_terminal = (sortie == SORTIE_TOUT || sortie == SORTIE_TERMINAL) ? STDOUT_FILENO : -1;
+    int fd = (fichiers && log_file != NULL) ? fileno(log_file) : -1;
+    int fd_evt = fichiers ?
+                 open(FICHIER_EVENEMENTS, O_WRONLY | O_CREAT | O_APPEND, 0644) : -1;
+    int capacite = shm->nb_journaux * TAILLE_JOURNAL;
+    int actif, i, k, n, releves, en_suspens;
+    size_t n_evt;
+    char ligne[384];
+    cellule_journal_t *c;
+    trace_t horloge;
+    
+    /* Autant de copies que de cellules dans l'ensemble des journaux */
+    releve = malloc(capacite * sizeof(cellule_journal_t));
+    a_ecrire = malloc(capacite * sizeof(cellule_journal_t *));
+    libres = malloc(capacite * sizeof(int));
+    bloque_depuis = calloc(shm->nb_journaux, sizeof(long long));
+    if (releve == NULL || a_ecrire == NULL || libres == NULL || bloque_depuis == NULL) {
+        perror("[ERREUR] malloc journal");
+        __atomic_store_n(&shm->journal_actif, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    for (i = 0; i < capacite; i++) {
+        libres[i] = capacite - 1 - i;
+    }
+    nb_libres = capacite;
+    
+    /* Horloge murale = horloge monotone + decalage : premier evenement de
+       l'execution, pour que logdump retrouve les heures */
+    memset(&horloge, 0, sizeof(horloge));
+    horloge.ns = decalage;
+    horloge.type = TRACE_HORLOGE;
+    horloge.acteur = ROLE_INITIAL;
+    ecrire_tout(fd_evt, (const char *)&horloge, sizeof(horloge));
+    
+    for (;;) {
+        actif = __atomic_load_n(&shm->journal_actif, __ATOMIC_ACQUIRE) &&
+                getppid() == shm->pid_initial;
+        releves = relever_journaux(actif, &en_suspens);
+        limite = (actif && nb_libres > 0) ? horloge_ns() - RETARD_JOURNAL_NS : LLONG_MAX;
+        qsort(a_ecrire, nb_a_ecrire, sizeof(*a_ecrire), comparer_traces);
+    
+        for (k = 0; k < nb_a_ecrire && a_ecrire[k]->trace.ns <= limite; k++) {
+            c = a_ecrire[k];
+            n = formater_trace(&c->trace, c->texte, decalage, ligne, sizeof(ligne));
+            n_evt = sizeof(trace_t);
+            if (c->trace.type == TRACE_TEXTE) {
+                n_evt += (c->trace.montant + sizeof(trace_t) - 1) / sizeof(trace_t) * sizeof(trace_t);
+            }
+    
+            if (n_fichier + n > sizeof(fichier) || n_terminal + n > sizeof(terminal) ||
+                n_binaire + n_evt > sizeof(binaire)) {
+                ecrire_tout(fd_evt, binaire, n_binaire);
+                ecrire_tout(fd, fichier, n_fichier);
+                ecrire_tout(fd_terminal, terminal, n_terminal);
+                n_binaire = n_fichier = n_terminal = 0;
+            }
+            memcpy(binaire + n_binaire, &c->trace, sizeof(trace_t));
+            if (c->trace.type == TRACE_TEXTE) {
+                memset(binaire + n_binaire + sizeof(trace_t), 0, n_evt - sizeof(trace_t));
+                memcpy(binaire + n_binaire + sizeof(trace_t), c->texte, c->trace.montant);
+            }
+            n_binaire += n_evt;
+    
+            memcpy(fichier + n_fichier, ligne, n);
+            n_fichier += n;
+            if (c->trace.erreur) {
+                ecrire_tout(STDERR_FILENO, ligne, n);
+            } else {
+                memcpy(terminal + n_terminal, ligne, n);
+                n_terminal += n;
+            }
+            libres[nb_libres++] = c - releve;
+            ecrites++;
+        }
+        memmove(a_ecrire, a_ecrire + k, (nb_a_ecrire - k) * sizeof(*a_ecrire));
+        nb_a_ecrire -= k;
+    
+        ecrire_tout(fd_evt, binaire, n_binaire);
+        ecrire_tout(fd, fichier, n_fichier);
+        ecrire_tout(fd_terminal, terminal, n_terminal);
+        n_binaire = n_fichier = n_terminal = 0;
+    
+        if (!actif && releves == 0 && nb_a_ecrire == 0 && en_suspens == 0) {
+            break;
+        }
+        if (releves == 0 && k == 0) {
+            usleep(PERIODE_JOURNAL_US);
+        }
+    }
+    
+    for (i = 0; i < shm->nb_journaux; i++) {
+        perdues += shm_journaux[i].perdues;
+    }
+    if (perdues > 0) {
+        n = snprintf(ligne, sizeof(ligne), "[JOURNAL] %ld traces ecrites, %ld perdues "
+                     "(journal plein ou trace jamais publiee)\n", ecrites, perdues);
+        ecrire_tout(fd, ligne, n);
+        ecrire_tout(fd_terminal, ligne, n);
+    }
+    if (fd_evt >= 0) {
+        close(fd_evt);
+    }
+    free(releve);
+    free(a_ecrire);
+    free(libres);
+    free(bloque_depuis);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : lancer_journal
+ * Description : Lance le processus journal (fork sans exec) ; il ignore
+ *               SIGINT / SIGTERM pour pouvoir vider les journaux pendant
+ *               l'arret de la simulation. Inutile avec SORTIE_AUCUNE.
+ * Retour      : 0 si succes (ou sortie aucune), -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+int lancer_journal(void) {
+    pid_t pid;
+    
+    if (shm == NULL || shm_journaux == NULL) {
+        return -1;
+    }
+    
+    /* Meme ecart d'horloge pour tous les processus de la simulation */
+    shm->decalage_horloge = decalage_horloge();
+    if (shm->sortie_log == SORTIE_AUCUNE) {
+        return 0;
+    }
+    
+    fflush(stdout);
+    if (log_file != NULL) {
+        fflush(log_file);
+    }
+    __atomic_store_n(&shm->journal_actif, 1, __ATOMIC_RELEASE);
+    
+    pid = fork();
+    if (pid == -1) {
+        perror("[ERREUR] fork journal");
+        __atomic_store_n(&shm->journal_actif, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    if (pid == 0) {
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+        signal(SIGHUP, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        executer_journal();
+        _exit(EXIT_SUCCESS);
+    }
+    pid_journal = pid;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : arreter_journal
+ * Description : Repasse en ecriture directe et attend que le processus
+ *               journal ait ecrit toutes les traces deposees
+ * -----------------------------------------------------------------------------
+ */
+void arreter_journal(void) {
+    if (pid_journal <= 0 || shm == NULL) {
+        return;
+    }
+    __atomic_store_n(&shm->journal_actif, 0, __ATOMIC_RELEASE);
+    waitpid(pid_journal, NULL, 0);
+    pid_journal = 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : log_message
+ * Description : Ecrit un message de log avec horodatage
+ *               Processus journal lance : le message est depose dans le
+ *               journal du thread (TRACE_TEXTE). Sinon il est ecrit dans
+ *               stdout ET dans le fichier de log, l'acces etant protege
+ *               par un mutex (semaphore). Avec SORTIE_AUCUNE, seul un
+ *               bilan est ecrit (sur stdout).
+ * Parametres  :
+ *   - niveau : NIVEAU_* de l'appel
+ *   - auteur : identifiant de l'auteur du message
+ *   - format : chaine de format (printf-like)
+ *   - ...    : arguments variables
+ * -----------------------------------------------------------------------------
+ */
+void log_message(int niveau, const char *auteur, const char *format, ...) {
+    char message[512];
+    va_list args;
+    
+    if (niveau < NIVEAU_BILAN && sortie_courante() == SORTIE_AUCUNE) {
+        return;
+    }
+    
+    /* Processus journal lance : deposer la trace, sans attendre */
+    va_start(args, format);
+    if (deposer_texte(0, auteur, format, args) == 0) {
+        va_end(args);
+        return;
+    }
+    va_end(args);
+    
+    /* Formater le message utilisateur */
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    
+    ecrire_directement(0, auteur, message);
+}
+
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : log_erreur
@@ -126,35 +940,20 @@ void log_message(const char *auteur, const char *format, ...) {
  * -----------------------------------------------------------------------------
  */
 void log_erreur(const char *auteur, const char *format, ...) {
-    char timestamp[16];
     char message[512];
     va_list args;
     
+    va_start(args, format);
+    if (deposer_texte(1, auteur, format, args) == 0) {
+        va_end(args);
+        return;
+    }
+    va_end(args);
+    
     /* Formater le message utilisateur */
     va_start(args, format);
     vsnprintf(message, sizeof(message), format, args);
     va_end(args);
     
-    /* Obtenir l'horodatage */
-    get_timestamp(timestamp, sizeof(timestamp));
-    
-    /* Prendre le mutex */
-    if (sem_id != -1) {
-        sem_P(SEM_MUTEX_LOG);
-    }
-    
-    /* Ecrire sur stderr */
-    fprintf(stderr, "[%s][%s][ERREUR] %s\n", timestamp, auteur, message);
-    fflush(stderr);
-    
-    /* Ecrire dans le fichier de log */
-    if (log_file != NULL) {
-        fprintf(log_file, "[%s][%s][ERREUR] %s\n", timestamp, auteur, message);
-        fflush(log_file);
-    }
-    
-    /* Liberer le mutex */
-    if (sem_id != -1) {
-        sem_V(SEM_MUTEX_LOG);
-    }
+    ecrire_directement(1, auteur, message);
 }
@@ -5,10 +5,20 @@
  * 
  * Ce module fournit des fonctions pour :
  *   - Ecrire des messages de log dans le terminal ET dans un fichier
- *   - Ajouter automatiquement un horodatage [HH:MM:SS]
- *   - Proteger les acces concurrents avec un mutex (semaphore)
+ *   - Ajouter automatiquement un horodatage [HH:MM:SS.nnnnnnnnn] (horloge
+ *     monotone, commune a tous les processus)
+ *   - Deposer les messages dans les journaux en memoire partagee, ecrits
+ *     par un processus journal (sinon : ecriture directe sous mutex)
+ *   - Enregistrer les evenements des acteurs en binaire (trace_t), relus
+ *     par ./logdump
  * 
- * Format des logs : [HH:MM:SS][AUTEUR] Message
+ * Format des logs : [HH:MM:SS.nnnnnnnnn][AUTEUR] Message
+ * 
+ * Chaque appel des acteurs passe par LOG_EVENEMENT / LOG_MESSAGE avec un
+ * niveau et une categorie : les appels sous NIVEAU_LOG_MIN, ou hors de
+ * CATEGORIES_LOG, disparaissent a la compilation (make NIVEAU_LOG=...).
+ * La sortie (terminal et/ou fichiers, ou aucune) se choisit a l'execution
+ * (option -l de main).
  * 
  * =============================================================================
  */
@@ -17,6 +27,101 @@
 #define LOG_H
 
 #include <stdarg.h>
+#include "ipc.h"
+
+/* Types d'evenements du journal binaire (trace_t.type) ; le texte de
+   chacun est dans message_trace (log.c) */
+#define TRACE_TEXTE             0   /* Message libre (log_message) */
+#define TRACE_HORLOGE           1   /* Debut d'execution du journal */
+/* Clients */
+#define TRACE_ENTREE            2   /* rayon */
+#define TRACE_CHOIX_VENDEUR     3   /* cible : vendeur */
+#define TRACE_VA_VENDEUR        4   /* cible : vendeur */
+#define TRACE_REDIRECTION       5   /* cible : vendeur (client ou vendeur) */
+#define TRACE_FILE_PLEINE       6   /* cible : vendeur */
+#define TRACE_VENDEURS_PLEINS   7
+#define TRACE_DISCUSSION        8
+#define TRACE_DISCUSSION_FIN    9
+#define TRACE_QUITTE            10
+#define TRACE_SANS_ACHAT        11
+#define TRACE_ACHAT             12
+#define TRACE_CAISSES_PLEINES   13
+#define TRACE_VA_CAISSIER       14  /* cible : caissier */
+#define TRACE_DOIT_PAYER        15  /* montant */
+#define TRACE_PAYE              16  /* montant */
+#define TRACE_PAIEMENT          17
+#define TRACE_SORTIE            18
+/* Vendeurs */
+#define TRACE_VENDEUR_PRET      19  /* rayon */
+#define TRACE_DEMANDE           20  /* client, rayon */
+#define TRACE_DISCUSSION_CLIENT 21  /* client */
+#define TRACE_VENTE             22  /* client, montant */
+#define TRACE_REFUS_ACHAT       23  /* client */
+#define TRACE_FIN_SERVICE       24
+/* Caissiers */
+#define TRACE_CAISSE_OUVERTE    25
+#define TRACE_ARRIVEE_CAISSE    26  /* client */
+#define TRACE_A_PAYER           27  /* client, montant */
+#define TRACE_ENCAISSE          28  /* client, montant */
+#define TRACE_CAISSE_FERMEE     29
+/* Processus initial */
+#define TRACE_DEMARRAGE         30
+#define TRACE_ATTENTE_CLIENTS   31
+#define TRACE_CLIENTS_TERMINES  32
+#define TRACE_ARRET_ACTEURS     33
+#define TRACE_SIGNAL            34  /* cible : numero du signal */
+#define TRACE_NETTOYAGE         35
+#define TRACE_FIN               36
+#define NB_TRACES               37
+
+/* Niveaux des logs, du plus bavard au plus grave */
+#define NIVEAU_DETAIL           0   /* Boucles d'attente ("Discussion en cours...") */
+#define NIVEAU_INFO             1   /* Etapes des acteurs */
+#define NIVEAU_BILAN            2   /* Configuration et bilans */
+#define NIVEAU_ERREUR           3   /* log_erreur (jamais retire) */
+
+/* Niveau minimal compile (-DNIVEAU_LOG_MIN=..., make NIVEAU_LOG=...) */
+#ifndef NIVEAU_LOG_MIN
+#define NIVEAU_LOG_MIN          NIVEAU_DETAIL
+#endif
+
+/* Categories (sous-systemes) */
+#define LOG_MAGASIN             0   /* Processus initial, moteur -E */
+#define LOG_CLIENTS             1
+#define LOG_VENDEURS            2
+#define LOG_CAISSES             3
+
+/* Categories compilees : masque de bits (1 << LOG_*), toutes par defaut */
+#ifndef CATEGORIES_LOG
+#define CATEGORIES_LOG          0xF
+#endif
+
+/* Vrai si un appel de ce niveau et de cette categorie est compile ; les
+   arguments etant constants, le test disparait (et l'appel avec lui) */
+#define LOG_COMPILE(niveau, categorie) \
+    ((niveau) >= NIVEAU_LOG_MIN && (CATEGORIES_LOG & (1 << (categorie))))
+
+#define LOG_EVENEMENT(niveau, categorie, type, client, cible, rayon, montant) \
+    do { \
+        if (LOG_COMPILE(niveau, categorie)) { \
+            log_evenement(niveau, type, client, cible, rayon, montant); \
+        } \
+    } while (0)
+
+#define LOG_MESSAGE(niveau, categorie, auteur, ...) \
+    do { \
+        if (LOG_COMPILE(niveau, categorie)) { \
+            log_message(niveau, auteur, __VA_ARGS__); \
+        } \
+    } while (0)
+
+/* Sorties des logs (option -l de main, shm->sortie_log) ; les erreurs
+   vont toujours sur stderr */
+#define SORTIE_TOUT             0   /* Terminal + magasin.log + magasin.evt */
+#define SORTIE_FICHIER          1   /* magasin.log + magasin.evt seuls */
+#define SORTIE_TERMINAL         2   /* stdout seul */
+#define SORTIE_AUCUNE           3   /* Bilans seuls, sur stdout (mesures) */
+#define NB_SORTIES              4
 
 /*
  * Fonction : log_init
@@ -31,15 +136,104 @@ int log_init(void);
  */
 void log_close(void);
 
+/*
+ * Fonction : log_sortie
+ * Description : Choisit la sortie des logs du processus ; une fois les IPC
+ *               creees, elle est publiee dans shm->sortie_log pour tous
+ *               les acteurs et le processus journal
+ * Parametre : sortie (SORTIE_*)
+ */
+void log_sortie(int sortie);
+
+/*
+ * Fonction : nom_sortie
+ * Description : Nom d'une sortie (option -l de main)
+ * Parametre : sortie
+ * Retour : "tout", "fichier", "terminal", "aucune" ; NULL si inconnue
+ */
+const char *nom_sortie(int sortie);
+
+/*
+ * Fonction : log_producteur
+ * Description : Choisit le journal des traces du thread appelant
+ *               (defaut : journal du processus initial)
+ * Parametres : role (ROLE_VENDEUR, ROLE_CAISSIER, ROLE_CLIENT), id
+ */
+void log_producteur(int role, int id);
+
+/*
+ * Fonction : lancer_journal
+ * Description : Lance le processus journal (IPC deja creees) ; ensuite
+ *               log_message depose les traces sans attendre
+ * Retour : 0 si succes, -1 si erreur (les logs restent directs)
+ */
+int lancer_journal(void);
+
+/*
+ * Fonction : arreter_journal
+ * Description : Fait vider les journaux et attend la fin du processus
+ *               journal (avant detacher_ipc)
+ */
+void arreter_journal(void);
+
+/*
+ * Fonction : log_evenement
+ * Description : Enregistre un evenement (acteur : celui de log_producteur)
+ *               sans formatage ; le texte est produit par le processus
+ *               journal ou par logdump
+ * Parametres : niveau (NIVEAU_* : sous NIVEAU_BILAN, rien avec
+ *              SORTIE_AUCUNE), type (TRACE_*), client, cible, rayon,
+ *              montant (-1 ou 0 si sans objet)
+ */
+void log_evenement(int niveau, int type, int client, int cible, int rayon, int montant);
+
+/*
+ * Fonction : nom_trace
+ * Description : Nom court d'un type d'evenement (colonne type du CSV)
+ * Parametre : type
+ * Retour : Nom, "?" si inconnu
+ */
+const char *nom_trace(int type);
+
+/*
+ * Fonction : auteur_trace / message_trace
+ * Description : Auteur ("CLIENT 12") et message d'un evenement, tels
+ *               qu'ecrits dans magasin.log
+ * Parametres : t, texte (charge utile de TRACE_TEXTE, sinon NULL),
+ *              buffer, taille
+ */
+void auteur_trace(const trace_t *t, const char *texte, char *buffer, size_t taille);
+void message_trace(const trace_t *t, const char *texte, char *buffer, size_t taille);
+
+/*
+ * Fonction : heure_seconde
+ * Description : "HH:MM:SS" d'un instant de l'horloge murale, reformate
+ *               seulement au changement de seconde (cache par thread)
+ * Parametre : ns
+ * Retour : Chaine valide jusqu'au prochain appel du thread
+ */
+const char *heure_seconde(long long ns);
+
+/*
+ * Fonction : formater_trace
+ * Description : Ligne "[HH:MM:SS.nnnnnnnnn][AUTEUR] message\n" d'un evenement
+ * Parametres : t, texte, decalage (horloge murale - horloge_ns, en ns),
+ *              ligne, taille
+ * Retour : Longueur de la ligne (tronquee a taille - 1)
+ */
+int formater_trace(const trace_t *t, const char *texte, long long decalage,
+                   char *ligne, size_t taille);
+
 /*
  * Fonction : log_message
  * Description : Ecrit un message de log formate
  * Parametres :
+ *   - niveau : NIVEAU_* (sous NIVEAU_BILAN, rien avec SORTIE_AUCUNE)
  *   - auteur : identifiant de l'auteur (ex: "CLIENT 1", "VENDEUR 0")
  *   - format : chaine de format (comme printf)
  *   - ... : arguments variables
  */
-void log_message(const char *auteur, const char *format, ...);
+void log_message(int niveau, const char *auteur, const char *format, ...);
 
 /*
  * Fonction : log_erreur
@@ -0,0 +1,121 @@
+/*
+ * =============================================================================
+ * Fichier     : logdump.c
+ * Description : Relit le fichier d'evenements binaires (magasin.evt) ecrit
+ *               par le processus journal
+ *
+ * Chaque evenement est un trace_t de taille fixe ; un TRACE_TEXTE est suivi
+ * de son texte ("auteur\0message") complete a un multiple de
+ * sizeof(trace_t). Un TRACE_HORLOGE ouvre chaque execution et donne
+ * l'ecart entre horloge murale et horloge_ns, pour retrouver les heures.
+ *
+ * Sorties :
+ *   - texte (defaut) : lignes "[HH:MM:SS.nnnnnnnnn][AUTEUR] message" de
+ *     magasin.log
+ *   - CSV (-c) : ns;heure;type;acteur;id;client;cible;rayon;montant;message
+ *
+ * Usage : ./logdump [-c] [fichier]     (defaut : magasin.evt)
+ * =============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#include "ipc.h"
+#include "log.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : ecrire_csv
+ * Description : Ligne CSV d'un evenement (separateur ';', message entre
+ *               guillemets, guillemets doubles)
+ * Parametres  : t, texte, decalage
+ * -----------------------------------------------------------------------------
+ */
+static void ecrire_csv(const trace_t *t, const char *texte, long long decalage) {
+    char auteur[32];
+    char message[TAILLE_TEXTE_TRACE + 64];
+    const char *p;
+
+    auteur_trace(t, texte, auteur, sizeof(auteur));
+    message_trace(t, texte, message, sizeof(message));
+
+    printf("%lld;%s;%s;%s;%d;%d;%d;%d;%d;\"", t->ns, heure_seconde(t->ns + decalage),
+           nom_trace(t->type), auteur, t->id, t->client, t->cible, t->rayon, t->montant);
+    for (p = message; *p != '\0'; p++) {
+        if (*p == '"') {
+            putchar('"');
+        }
+        putchar(*p);
+    }
+    printf("\"\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *chemin = FICHIER_EVENEMENTS;
+    int csv = 0;
+    int opt;
+    FILE *f;
+    trace_t t;
+    char texte[TAILLE_TEXTE_TRACE + sizeof(trace_t)];
+    char ligne[384];
+    long long decalage = 0;
+    size_t blocs;
+    long nb = 0;
+
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        if (opt == 'c') {
+            csv = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-c] [fichier]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) {
+        chemin = argv[optind];
+    }
+
+    f = fopen(chemin, "rb");
+    if (f == NULL) {
+        perror("[ERREUR] Ouverture du fichier d'evenements");
+        return EXIT_FAILURE;
+    }
+
+    if (csv) {
+        printf("ns;heure;type;acteur;id;client;cible;rayon;montant;message\n");
+    }
+    while (fread(&t, sizeof(t), 1, f) == 1) {
+        if (t.type == TRACE_HORLOGE) {
+            decalage = t.ns;
+            continue;
+        }
+
+        /* Texte d'un TRACE_TEXTE : blocs de sizeof(trace_t) octets */
+        texte[0] = '\0';
+        if (t.type == TRACE_TEXTE) {
+            if (t.montant <= 0 || t.montant > TAILLE_TEXTE_TRACE) {
+                fprintf(stderr, "[ERREUR] Evenement %ld : texte de %d octets\n", nb, t.montant);
+                break;
+            }
+            blocs = (t.montant + sizeof(trace_t) - 1) / sizeof(trace_t);
+            if (fread(texte, sizeof(trace_t), blocs, f) != blocs) {
+                break;
+            }
+            texte[TAILLE_TEXTE_TRACE - 1] = '\0';
+        }
+
+        if (csv) {
+            ecrire_csv(&t, t.type == TRACE_TEXTE ? texte : NULL, decalage);
+        } else {
+            formater_trace(&t, t.type == TRACE_TEXTE ? texte : NULL, decalage,
+                           ligne, sizeof(ligne));
+            fputs(ligne, stdout);
+        }
+        nb++;
+    }
+
+    fclose(f);
+    return EXIT_SUCCESS;
+}
@@ -5,23 +5,35 @@
  * 
  * Ce processus est responsable de :
  *   - Creer tous les IPC (memoire partagee, semaphores, files de messages)
- *   - Lancer les processus vendeurs, caissiers et clients
+ *   - Lancer les processus vendeurs, caissiers et clients (ou, en mode
+ *     threads, les faire tourner comme threads de ce processus)
  *   - Attendre la fin de tous les clients
  *   - Terminer proprement les vendeurs et caissiers
  *   - Nettoyer les IPC a la fin
  * 
  * Fonctions :
+ *   - nettoyer_et_quitter(): Detruit les IPC et termine (arret anticipe)
  *   - gestionnaireSignal() : Gestionnaire pour arret propre sur signal
  *   - usage()              : Affiche l'aide en cas d'erreur d'arguments
+ *   - travailleur_zygote() : Fils du mode zygote, enchaine les clients
+ *   - executer_processus() : Lance les acteurs (fork/exec ou zygote), attend
+ *                            les clients puis arrete vendeurs et caissiers
+ *   - executer_threads()   : Meme cycle avec des threads (clients en pool)
+ *   (le mode -E delegue tout a executer_evenements(), sans IPC)
  *   - main()               : Point d'entree principal
  * 
- * Usage : ./main <nb_vendeurs> <nb_caissiers> <nb_clients>
+ * Usage : ./main [-t sysv|anneau|files] [-p 1|2] [-z taille_pool] [-T]
+ *                [-E [-a inter_arrivee_ms]] [-m sysv|posix] [-n instance]
+ *                [-r redirection|direct|deux|ewma]
+ *                <nb_vendeurs> <nb_caissiers> <nb_clients>
  * =============================================================================
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <string.h>
@@ -32,6 +44,8 @@
 #include "ipc.h"
 #include "log.h"
 #include "utils.h"
+#include "roles.h"
+#include "evenements.h"
 
 /* ============== VARIABLES GLOBALES ============== */
 
@@ -41,20 +55,79 @@ pid_t *pids_clients;    /* Tableau des PIDs des clients */
 int nb_vendeurs_g;      /* Nombre de vendeurs (copie globale) */
 int nb_caissiers_g;     /* Nombre de caissiers (copie globale) */
 int nb_clients_g;       /* Nombre de clients (copie globale) */
+int nb_processus_clients;   /* Processus clients lances (ou travailleurs) */
+long long *t_creation_clients;  /* Mode threads : creation de chaque thread
+                                   client */
+int mode_threads_g;     /* Mode threads (gestionnaire de signaux) */
+volatile sig_atomic_t arret_threads = 0;    /* Mode threads : signal recu */
+sem_t reveil_principal; /* Mode threads : fin d'un thread client ou signal */
+
+/* Pile d'un thread acteur (mode threads) : les roles n'ont ni recursion
+   profonde ni gros tableaux locaux */
+#define TAILLE_PILE_THREAD  (256 * 1024)
+
+/* Mode threads sans -z : nombre de threads clients vivants en meme temps,
+   qui se partagent les clients comme les travailleurs zygote */
+#define THREADS_CLIENTS_DEFAUT  256
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : nettoyer_et_quitter
+ * Description : Fin du processus initial hors du chemin normal : vide les
+ *               journaux, attend les enfants restants, detruit les IPC et
+ *               termine
+ * Parametre   : code - code de sortie
+ * Retour      : Aucun (termine le programme)
+ * -----------------------------------------------------------------------------
+ */
+static void nettoyer_et_quitter(int code) {
+    /* Vider les journaux, puis attendre la terminaison des autres enfants */
+    arreter_journal();
+    while (wait(NULL) > 0);
+    
+    /* Nettoyer les IPC */
+    detacher_ipc();
+    detruire_ipc();
+    
+    /* Liberer la memoire */
+    free(pids_vendeurs);
+    free(pids_caissiers);
+    free(pids_clients);
+    
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL", "Nettoyage termine. Au revoir!");
+    log_close();
+    
+    exit(code);
+}
 
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : gestionnaireSignal
  * Description : Gestionnaire de signaux pour terminer proprement la simulation
- *               Envoie SIGINT a tous les processus fils puis nettoie les IPC
+ *               Envoie SIGINT a tous les processus fils puis nettoie les IPC.
+ *               En mode threads, les acteurs tournent dans ce processus :
+ *               le gestionnaire reveille seulement le thread principal, qui
+ *               arrete et attend les threads avant de detruire les IPC
+ *               (executer_threads) ; un second signal detruit les IPC et
+ *               termine sans attendre.
  * Parametre   : sig - numero du signal recu
- * Retour      : Aucun (termine le programme)
+ * Retour      : Aucun (termine le programme, sauf en mode threads)
  * -----------------------------------------------------------------------------
  */
 void gestionnaireSignal(int sig) {
     int i;
     
-    log_message("INITIAL", "Signal recu [%d], arret du programme...", sig);
+    LOG_EVENEMENT(NIVEAU_BILAN, LOG_MAGASIN, TRACE_SIGNAL, -1, sig, -1, 0);
+    
+    if (mode_threads_g) {
+        if (arret_threads) {
+            detruire_ipc();
+            _exit(EXIT_FAILURE);
+        }
+        arret_threads = 1;
+        sem_post(&reveil_principal);
+        return;
+    }
     
     /* Envoyer SIGINT a tous les vendeurs */
     for (i = 0; i < nb_vendeurs_g; i++) {
@@ -70,22 +143,7 @@ void gestionnaireSignal(int sig) {
         }
     }
     
-    /* Attendre la terminaison de tous les enfants */
-    while (wait(NULL) > 0);
-    
-    /* Nettoyer les IPC */
-    detacher_ipc();
-    detruire_ipc();
-    
-    /* Liberer la memoire */
-    free(pids_vendeurs);
-    free(pids_caissiers);
-    free(pids_clients);
-    
-    log_message("INITIAL", "Nettoyage termine. Au revoir!");
-    log_close();
-    
-    exit(EXIT_SUCCESS);
+    nettoyer_et_quitter(EXIT_SUCCESS);
 }
 
 /*
@@ -97,97 +155,98 @@ void gestionnaireSignal(int sig) {
  * -----------------------------------------------------------------------------
  */
 void usage(char *prog) {
-    fprintf(stderr, "Usage: %s <nb_vendeurs> <nb_caissiers> <nb_clients>\n", prog);
-    fprintf(stderr, "  nb_vendeurs  >= %d (un par rayon)\n", NB_RAYONS);
-    fprintf(stderr, "  nb_caissiers >= 1\n");
+    fprintf(stderr, "Usage: %s [-t sysv|anneau|files] [-p 1|2] [-z taille_pool] [-T]\n"
+                    "          [-E [-a inter_arrivee_ms]] [-m sysv|posix] [-n instance]\n"
+                    "          [-r redirection|direct|deux|ewma]\n"
+                    "          [-l tout|fichier|terminal|aucune]\n"
+                    "          <nb_vendeurs> <nb_caissiers> <nb_clients>\n", prog);
+    fprintf(stderr, "  -t transport des requetes : files System V partagees (defaut),\n");
+    fprintf(stderr, "     anneaux en memoire partagee ou une file par acteur\n");
+    fprintf(stderr, "  -p version du protocole de messages (defaut : 2)\n");
+    fprintf(stderr, "  -z mode zygote : taille_pool fils crees par fork sans exec,\n");
+    fprintf(stderr, "     recycles de client en client (defaut : fork + exec par client)\n");
+    fprintf(stderr, "  -T mode threads : un seul processus, un thread par acteur,\n");
+    fprintf(stderr, "     boites en memoire du processus (remplace -t) ; -z y fixe\n");
+    fprintf(stderr, "     le nombre de threads clients (defaut : %d)\n",
+            THREADS_CLIENTS_DEFAUT);
+    fprintf(stderr, "  -E moteur a evenements discrets : temps virtuel, ni processus\n");
+    fprintf(stderr, "     ni IPC ; -a intervalle moyen entre arrivees (defaut : 0,\n");
+    fprintf(stderr, "     tous les clients a l'ouverture)\n");
+    fprintf(stderr, "  -m memoire partagee System V (defaut) ou POSIX (shm_open + mmap,\n");
+    fprintf(stderr, "     pages enormes si disponibles, pages pre-chargees)\n");
+    fprintf(stderr, "  -n instance nommee : IPC distinctes, plusieurs simulations\n");
+    fprintf(stderr, "     en parallele (monitoring : MAGASIN_INSTANCE=instance)\n");
+    fprintf(stderr, "  -r routage des clients : vendeur le moins charge puis redirection\n");
+    fprintf(stderr, "     (defaut), vendeur competent le moins charge, meilleur de deux\n");
+    fprintf(stderr, "     vendeurs competents tires au hasard, ou attente prevue la\n");
+    fprintf(stderr, "     plus courte (duree moyenne des discussions)\n");
+    fprintf(stderr, "  -l sortie des logs : terminal et fichiers (defaut), fichiers\n");
+    fprintf(stderr, "     seuls (magasin.log, magasin.evt), terminal seul ou aucune\n");
+    fprintf(stderr, "     (bilans seuls sur stdout ; les erreurs restent sur stderr)\n");
+    fprintf(stderr, "  %d <= nb_vendeurs <= %d (au moins un par rayon)\n",
+            NB_RAYONS, MAX_VENDEURS);
+    fprintf(stderr, "  1 <= nb_caissiers <= %d\n", MAX_CAISSIERS);
     fprintf(stderr, "  nb_clients   >= 1\n");
     exit(EXIT_FAILURE);
 }
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : main
- * Description : Point d'entree principal du processus initial
- *               1. Parse les arguments
- *               2. Cree les IPC
- *               3. Lance les vendeurs, caissiers et clients
- *               4. Attend la fin des clients
- *               5. Arrete les vendeurs et caissiers
- *               6. Nettoie les IPC
- * Parametres  : argc, argv (nb_vendeurs, nb_caissiers, nb_clients)
- * Retour      : EXIT_SUCCESS ou EXIT_FAILURE
+ * Fonction    : travailleur_zygote
+ * Description : Corps d'un fils du mode zygote
+ *               Le fils herite du log et des IPC deja attaches par le
+ *               processus initial : il n'y a ni exec ni attacher_ipc. Il
+ *               prend les clients un par un (shm->prochain_client) jusqu'a
+ *               epuisement, puis se termine.
+ * Parametre   : t_fork - instant (horloge_ns) juste avant le fork
+ * Retour      : Aucun (termine le processus)
  * -----------------------------------------------------------------------------
  */
-int main(int argc, char *argv[]) {
-    int nb_vendeurs, nb_caissiers, nb_clients;
-    int i;
-    pid_t pid;
-    char id_str[16];
-    
-    /* Initialiser le generateur aleatoire */
-    srand(time(NULL));
-    
-    /* Verification des arguments */
-    if (argc != 4) {
-        usage(argv[0]);
-    }
-    
-    nb_vendeurs = atoi(argv[1]);
-    nb_caissiers = atoi(argv[2]);
-    nb_clients = atoi(argv[3]);
-    
-    /* Verifier les contraintes */
-    if (nb_vendeurs < NB_RAYONS || nb_caissiers < 1 || nb_clients < 1) {
-        usage(argv[0]);
-    }
+static void travailleur_zygote(long long t_fork) {
+    long long t_libre = t_fork;
+    int i, id;
     
-    /* Sauvegarder les valeurs en global pour le gestionnaire de signaux */
-    nb_vendeurs_g = nb_vendeurs;
-    nb_caissiers_g = nb_caissiers;
-    nb_clients_g = nb_clients;
-    
-    /* Initialiser le systeme de log */
-    log_init();
-    
-    log_message("INITIAL", "=== Demarrage de la simulation ===");
-    log_message("INITIAL", "Config: %d vendeurs, %d caissiers, %d clients", 
-                nb_vendeurs, nb_caissiers, nb_clients);
-    
-    /* Creer les IPC (memoire partagee, semaphores, files de messages) */
-    if (creer_ipc(nb_vendeurs, nb_caissiers, nb_clients) == -1) {
-        log_erreur("INITIAL", "Impossible de creer les IPC");
-        exit(EXIT_FAILURE);
-    }
-    
-    log_message("INITIAL", "IPC crees (SHM, Semaphores, Files de messages)");
-    
-    /* Assigner les rayons aux vendeurs */
-    /* Les 10 premiers vendeurs ont chacun un rayon different */
-    /* Les vendeurs supplementaires ont un rayon aleatoire */
-    for (i = 0; i < nb_vendeurs; i++) {
-        shm->vendeurs[i].rayon = (i < NB_RAYONS) ? i : (rand() % NB_RAYONS);
-        shm->vendeurs[i].file_attente = 0;
-        shm->vendeurs[i].occupe = 0;
-    }
-    
-    /* Allouer les tableaux de PIDs */
-    pids_vendeurs = malloc(nb_vendeurs * sizeof(pid_t));
-    pids_caissiers = malloc(nb_caissiers * sizeof(pid_t));
-    pids_clients = malloc(nb_clients * sizeof(pid_t));
-    
-    /* Installer les gestionnaires de signaux pour arret propre */
+    /* Le gestionnaire du processus initial detruirait les IPC :
+       un fils se contente de se terminer sur signal, comme un client */
     for (i = 1; i < 20; i++) {
         if (i != SIGCHLD && i != SIGKILL && i != SIGSTOP) {
-            signal(i, gestionnaireSignal);
+            signal(i, SIG_DFL);
         }
     }
     
-    /* Activer la simulation AVANT de creer les vendeurs */
-    shm->simulation_active = 1;
+    while ((id = __atomic_fetch_add(&shm->prochain_client, 1, __ATOMIC_RELAXED))
+           < nb_clients_g) {
+        /* Latence : depuis le fork, ou depuis la fin du client precedent */
+        compter_lancement(horloge_ns() - t_libre, 0);
+        executer_client(id);
+        t_libre = horloge_ns();
+    }
+    
+    _exit(EXIT_SUCCESS);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : executer_processus
+ * Description : Cycle de vie des acteurs en mode processus
+ *               1. Lance les vendeurs et caissiers (fork + exec)
+ *               2. Lance les clients (fork + exec, ou travailleurs zygote)
+ *               3. Attend la fin des clients
+ *               4. Arrete les vendeurs et caissiers
+ * Parametres  :
+ *   - taille_pool : nombre de travailleurs zygote (0 : fork + exec)
+ *   - fin         : instant de fin du dernier client (sortie)
+ * -----------------------------------------------------------------------------
+ */
+static void executer_processus(int taille_pool, struct timespec *fin) {
+    char id_str[16];
+    char t_str[32];
+    pid_t pid;
+    int i;
     
     /* ===== CREATION DES VENDEURS ===== */
-    log_message("INITIAL", "Creation des %d vendeurs...", nb_vendeurs);
-    for (i = 0; i < nb_vendeurs; i++) {
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL", "Creation des %d vendeurs...", nb_vendeurs_g);
+    for (i = 0; i < nb_vendeurs_g; i++) {
         pid = fork();
         if (pid == -1) {
             perror("fork vendeur");
@@ -201,12 +260,13 @@ int main(int argc, char *argv[]) {
             exit(EXIT_FAILURE);
         }
         pids_vendeurs[i] = pid;
-        shm->vendeurs[i].pid = pid;
+        shm_vendeurs[i].pid = pid;
     }
     
     /* ===== CREATION DES CAISSIERS ===== */
-    log_message("INITIAL", "Creation des %d caissiers...", nb_caissiers);
-    for (i = 0; i < nb_caissiers; i++) {
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                "Creation des %d caissiers...", nb_caissiers_g);
+    for (i = 0; i < nb_caissiers_g; i++) {
         pid = fork();
         if (pid == -1) {
             perror("fork caissier");
@@ -220,78 +280,592 @@ int main(int argc, char *argv[]) {
             exit(EXIT_FAILURE);
         }
         pids_caissiers[i] = pid;
-        shm->caissiers[i].pid = pid;
+        shm_caissiers[i].pid = pid;
     }
     
     /* ===== CREATION DES CLIENTS ===== */
-    log_message("INITIAL", "Creation des %d clients...", nb_clients);
-    for (i = 0; i < nb_clients; i++) {
+    if (taille_pool) {
+        LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                    "Creation des %d clients (zygote, %d travailleurs)...",
+                    nb_clients_g, taille_pool);
+    } else {
+        LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                    "Creation des %d clients...", nb_clients_g);
+    }
+    for (i = 0; i < nb_processus_clients; i++) {
         /* Delai aleatoire entre les clients pour simuler des arrivees echelonnees */
         /*sleep(rand() % 2);*/
         
+        long long t_fork = horloge_ns();
         pid = fork();
         if (pid == -1) {
             perror("fork client");
             continue;
         }
         if (pid == 0) {
+            if (taille_pool) {
+                /* Mode zygote : le fils est deja pret */
+                travailleur_zygote(t_fork);
+            }
             /* Processus enfant - devient un client */
             snprintf(id_str, sizeof(id_str), "%d", i);
-            execl("./client", "client", id_str, NULL);
+            snprintf(t_str, sizeof(t_str), "%lld", t_fork);
+            execl("./client", "client", id_str, t_str, NULL);
             perror("execl client");
             exit(EXIT_FAILURE);
         }
         pids_clients[i] = pid;
     }
     
-    log_message("INITIAL", "Tous les processus sont lances!");
-    log_message("INITIAL", "En attente de la fin des clients...");
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL", "Tous les processus sont lances!");
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_MAGASIN, TRACE_ATTENTE_CLIENTS, -1, -1, -1, 0);
     
     /* ===== ATTENTE DES CLIENTS ===== */
     /* Attendre que tous les clients aient termine */
-    for (i = 0; i < nb_clients; i++) {
-        waitpid(pids_clients[i], NULL, 0);
-        pids_clients[i] = 0;
+    for (i = 0; i < nb_processus_clients; i++) {
+        if (pids_clients[i] > 0) {
+            waitpid(pids_clients[i], NULL, 0);
+            pids_clients[i] = 0;
+        }
     }
     
-    log_message("INITIAL", "Tous les clients ont termine.");
-    log_message("INITIAL", "Arret des vendeurs et caissiers...");
+    clock_gettime(CLOCK_MONOTONIC, fin);
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_MAGASIN, TRACE_CLIENTS_TERMINES, -1, -1, -1, 0);
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_MAGASIN, TRACE_ARRET_ACTEURS, -1, -1, -1, 0);
     
     /* ===== ARRET DE LA SIMULATION ===== */
     /* Desactiver la simulation */
     shm->simulation_active = 0;
     
+    /* Debloquer les vendeurs et caissiers en attente de message */
+    envoyer_arret();
+    
     /* Envoyer SIGINT aux vendeurs pour les faire terminer */
-    for (i = 0; i < nb_vendeurs; i++) {
+    for (i = 0; i < nb_vendeurs_g; i++) {
         if (pids_vendeurs[i] > 0) {
             kill(pids_vendeurs[i], SIGINT);
         }
     }
     
     /* Envoyer SIGINT aux caissiers pour les faire terminer */
-    for (i = 0; i < nb_caissiers; i++) {
+    for (i = 0; i < nb_caissiers_g; i++) {
         if (pids_caissiers[i] > 0) {
             kill(pids_caissiers[i], SIGINT);
         }
     }
     
     /* Attendre la terminaison des vendeurs */
-    for (i = 0; i < nb_vendeurs; i++) {
+    for (i = 0; i < nb_vendeurs_g; i++) {
         if (pids_vendeurs[i] > 0) {
             waitpid(pids_vendeurs[i], NULL, 0);
         }
     }
     
     /* Attendre la terminaison des caissiers */
-    for (i = 0; i < nb_caissiers; i++) {
+    for (i = 0; i < nb_caissiers_g; i++) {
         if (pids_caissiers[i] > 0) {
             waitpid(pids_caissiers[i], NULL, 0);
         }
     }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : thread_vendeur / thread_caissier / thread_client
+ * Description : Points d'entree des threads acteurs (mode threads)
+ *               Le log et la memoire partagee sont ceux du processus
+ * Parametre   : arg - ID de l'acteur
+ * -----------------------------------------------------------------------------
+ */
+static void *thread_vendeur(void *arg) {
+    executer_vendeur((int)(long)arg);
+    return NULL;
+}
+
+static void *thread_caissier(void *arg) {
+    executer_caissier((int)(long)arg);
+    return NULL;
+}
+
+static void *thread_client(void *arg) {
+    long long t_libre = t_creation_clients[(int)(long)arg];
+    int id;
+    
+    /* Comme un travailleur zygote : clients pris un par un jusqu'a
+       epuisement ou arret */
+    while (shm->simulation_active &&
+           (id = __atomic_fetch_add(&shm->prochain_client, 1, __ATOMIC_RELAXED))
+           < nb_clients_g) {
+        compter_lancement(horloge_ns() - t_libre, 0);
+        executer_client(id);
+        t_libre = horloge_ns();
+    }
+    
+    sem_post(&reveil_principal);
+    return NULL;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : executer_threads
+ * Description : Cycle de vie des acteurs en mode threads
+ *               Meme logique que executer_processus, mais chaque acteur est
+ *               un thread de ce processus et les requetes passent par des
+ *               boites en memoire du processus (TRANSPORT_THREADS). L'etat
+ *               du magasin reste dans le segment partage : monitoring
+ *               fonctionne sans changement. Comme en mode zygote, au plus
+ *               nb_processus_clients threads clients vivent en meme temps
+ *               et se partagent les clients.
+ *               Les signaux sont bloques dans les threads acteurs : seul le
+ *               thread principal execute gestionnaireSignal, qui le reveille
+ *               (reveil_principal). Sur signal ou echec de creation d'un
+ *               vendeur, d'un caissier ou de tout thread client, la
+ *               simulation est arretee, les boites fermees et tous les
+ *               threads attendus avant de rendre la main ; s'il manque
+ *               seulement des threads clients, ceux crees servent tous les
+ *               clients.
+ * Parametre   : fin - instant de fin du dernier client (sortie)
+ * Retour      : 0 si tous les clients ont ete servis, 1 si arrete par un
+ *               signal, -1 si un acteur n'a pas pu etre cree
+ * -----------------------------------------------------------------------------
+ */
+static int executer_threads(struct timespec *fin) {
+    pthread_t *threads_vendeurs, *threads_caissiers, *threads_clients;
+    pthread_attr_t attr;
+    sigset_t tous, ancien;
+    int nb_v = 0, nb_k = 0, nb_c = 0;   /* Threads crees */
+    int echec = 0, termines = 0;
+    int i;
+    
+    threads_vendeurs = calloc(nb_vendeurs_g, sizeof(pthread_t));
+    threads_caissiers = calloc(nb_caissiers_g, sizeof(pthread_t));
+    threads_clients = calloc(nb_processus_clients, sizeof(pthread_t));
+    t_creation_clients = calloc(nb_processus_clients, sizeof(long long));
+    if (!threads_vendeurs || !threads_caissiers || !threads_clients ||
+        !t_creation_clients || sem_init(&reveil_principal, 0, 0) == -1) {
+        perror("[ERREUR] calloc threads");
+        free(threads_vendeurs);
+        free(threads_caissiers);
+        free(threads_clients);
+        free(t_creation_clients);
+        t_creation_clients = NULL;
+        return -1;
+    }
+    
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, TAILLE_PILE_THREAD);
+    
+    /* Les threads crees heritent du masque : tous les signaux bloques */
+    sigfillset(&tous);
+    pthread_sigmask(SIG_BLOCK, &tous, &ancien);
+    
+    /* ===== CREATION DES VENDEURS ===== */
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                "Creation des %d vendeurs (threads)...", nb_vendeurs_g);
+    for (i = 0; i < nb_vendeurs_g && !echec; i++) {
+        if (pthread_create(&threads_vendeurs[i], &attr, thread_vendeur,
+                           (void *)(long)i) != 0) {
+            perror("[ERREUR] pthread_create vendeur");
+            echec = 1;
+            break;
+        }
+        nb_v++;
+        shm_vendeurs[i].pid = getpid();
+    }
+    
+    /* ===== CREATION DES CAISSIERS ===== */
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                "Creation des %d caissiers (threads)...", nb_caissiers_g);
+    for (i = 0; i < nb_caissiers_g && !echec; i++) {
+        if (pthread_create(&threads_caissiers[i], &attr, thread_caissier,
+                           (void *)(long)i) != 0) {
+            perror("[ERREUR] pthread_create caissier");
+            echec = 1;
+            break;
+        }
+        nb_k++;
+        shm_caissiers[i].pid = getpid();
+    }
+    
+    /* ===== CREATION DES CLIENTS ===== */
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                "Creation de %d threads pour %d clients...",
+                nb_processus_clients, nb_clients_g);
+    for (i = 0; i < nb_processus_clients && !echec; i++) {
+        t_creation_clients[i] = horloge_ns();
+        if (pthread_create(&threads_clients[i], &attr, thread_client,
+                           (void *)(long)i) != 0) {
+            perror("[ERREUR] pthread_create client");
+            break;
+        }
+        nb_c++;
+    }
+    /* Les threads clients se partagent les clients : il en faut un */
+    if (!echec && nb_c == 0) {
+        echec = 1;
+    } else if (!echec && nb_c < nb_processus_clients) {
+        log_erreur("INITIAL", "Seulement %d threads clients sur %d",
+                   nb_c, nb_processus_clients);
+    }
+    
+    pthread_sigmask(SIG_SETMASK, &ancien, NULL);
+    pthread_attr_destroy(&attr);
+    
+    if (echec) {
+        log_erreur("INITIAL", "Threads acteurs non crees, arret de la simulation");
+    } else {
+        LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL", "Tous les threads sont lances!");
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_MAGASIN, TRACE_ATTENTE_CLIENTS, -1, -1, -1, 0);
+    }
+    
+    /* ===== ATTENTE DES CLIENTS ===== */
+    /* Chaque thread client qui se termine poste reveil_principal, le
+       gestionnaire de signaux aussi */
+    while (termines < nb_c) {
+        if ((echec || arret_threads) && shm->simulation_active) {
+            /* Plus de nouveaux clients, receptions en cours interrompues */
+            shm->simulation_active = 0;
+            fermer_boites_threads();
+        }
+        if (sem_wait(&reveil_principal) == -1) {
+            continue;       /* EINTR */
+        }
+        if (arret_threads && shm->simulation_active) {
+            continue;       /* Reveil du gestionnaire de signaux */
+        }
+        termines++;
+    }
+    for (i = 0; i < nb_c; i++) {
+        pthread_join(threads_clients[i], NULL);
+    }
+    
+    if (!echec && !arret_threads) {
+        clock_gettime(CLOCK_MONOTONIC, fin);
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_MAGASIN, TRACE_CLIENTS_TERMINES, -1, -1, -1, 0);
+    }
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_MAGASIN, TRACE_ARRET_ACTEURS, -1, -1, -1, 0);
+    
+    /* ===== ARRET DE LA SIMULATION ===== */
+    shm->simulation_active = 0;
+    envoyer_arret();
+    
+    for (i = 0; i < nb_v; i++) {
+        pthread_join(threads_vendeurs[i], NULL);
+    }
+    for (i = 0; i < nb_k; i++) {
+        pthread_join(threads_caissiers[i], NULL);
+    }
+    
+    detruire_boites_threads();
+    sem_destroy(&reveil_principal);
+    free(threads_vendeurs);
+    free(threads_caissiers);
+    free(threads_clients);
+    free(t_creation_clients);
+    t_creation_clients = NULL;
+    
+    return echec ? -1 : arret_threads ? 1 : 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : main
+ * Description : Point d'entree principal du processus initial
+ *               1. Parse les arguments
+ *               2. Cree les IPC
+ *               3. Lance les vendeurs, caissiers et clients
+ *               4. Attend la fin des clients
+ *               5. Arrete les vendeurs et caissiers
+ *               6. Nettoie les IPC
+ * Parametres  : argc, argv (nb_vendeurs, nb_caissiers, nb_clients)
+ * Retour      : EXIT_SUCCESS ou EXIT_FAILURE
+ * -----------------------------------------------------------------------------
+ */
+int main(int argc, char *argv[]) {
+    int nb_vendeurs, nb_caissiers, nb_clients;
+    int transport = TRANSPORT_SYSV;
+    int protocole = PROTOCOLE_V2;
+    int taille_pool = 0;
+    int mode_threads = 0;
+    int mode_evenements = 0;
+    long inter_arrivee_ms = 0;
+    int memoire_posix = 0;
+    int routage = ROUTAGE_REDIRECTION;
+    int sortie = SORTIE_TOUT;
+    const char *instance = NULL;
+    int i, opt, ret;
+    struct timespec debut, fin;
+    
+    /* Initialiser le generateur aleatoire */
+    init_random(0);
+    
+    /* Options */
+    while ((opt = getopt(argc, argv, "t:p:z:TEa:m:n:r:l:")) != -1) {
+        switch (opt) {
+        case 't':
+            if (strcmp(optarg, "sysv") == 0) {
+                transport = TRANSPORT_SYSV;
+            } else if (strcmp(optarg, "anneau") == 0) {
+                transport = TRANSPORT_ANNEAU;
+            } else if (strcmp(optarg, "files") == 0) {
+                transport = TRANSPORT_FILES;
+            } else {
+                usage(argv[0]);
+            }
+            break;
+        case 'p':
+            protocole = atoi(optarg);
+            if (protocole != PROTOCOLE_V1 && protocole != PROTOCOLE_V2) {
+                usage(argv[0]);
+            }
+            break;
+        case 'z':
+            taille_pool = atoi(optarg);
+            if (taille_pool < 1) {
+                usage(argv[0]);
+            }
+            break;
+        case 'T':
+            mode_threads = 1;
+            break;
+        case 'E':
+            mode_evenements = 1;
+            break;
+        case 'a':
+            inter_arrivee_ms = atol(optarg);
+            if (inter_arrivee_ms < 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'm':
+            if (strcmp(optarg, "sysv") == 0) {
+                memoire_posix = 0;
+            } else if (strcmp(optarg, "posix") == 0) {
+                memoire_posix = 1;
+            } else {
+                usage(argv[0]);
+            }
+            break;
+        case 'n':
+            instance = optarg;
+            break;
+        case 'r':
+            for (routage = 0; routage < NB_ROUTAGES; routage++) {
+                if (strcmp(optarg, nom_routage(routage)) == 0) {
+                    break;
+                }
+            }
+            if (routage == NB_ROUTAGES) {
+                usage(argv[0]);
+            }
+            break;
+        case 'l':
+            for (sortie = 0; sortie < NB_SORTIES; sortie++) {
+                if (strcmp(optarg, nom_sortie(sortie)) == 0) {
+                    break;
+                }
+            }
+            if (sortie == NB_SORTIES) {
+                usage(argv[0]);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    
+    /* Le mode threads a son propre transport et ne lance aucun processus ;
+       -z y fixe le nombre de threads clients */
+    if (mode_threads) {
+        transport = TRANSPORT_THREADS;
+        if (taille_pool == 0) {
+            taille_pool = THREADS_CLIENTS_DEFAUT;
+        }
+    }
+    
+    /* Verification des arguments */
+    if (argc - optind != 3) {
+        usage(argv[0]);
+    }
+    
+    nb_vendeurs = atoi(argv[optind]);
+    nb_caissiers = atoi(argv[optind + 1]);
+    nb_clients = atoi(argv[optind + 2]);
+    
+    /* Verifier les contraintes */
+    if (nb_vendeurs < NB_RAYONS || nb_vendeurs > MAX_VENDEURS ||
+        nb_caissiers < 1 || nb_caissiers > MAX_CAISSIERS || nb_clients < 1) {
+        usage(argv[0]);
+    }
+    
+    /* Sauvegarder les valeurs en global pour le gestionnaire de signaux */
+    nb_vendeurs_g = nb_vendeurs;
+    nb_caissiers_g = nb_caissiers;
+    nb_clients_g = nb_clients;
+    mode_threads_g = mode_threads;
+    if (taille_pool > nb_clients) {
+        taille_pool = nb_clients;
+    }
+    nb_processus_clients = taille_pool ? taille_pool : nb_clients;
+    
+    /* Initialiser le systeme de log */
+    log_sortie(sortie);
+    log_init();
+    
+    LOG_EVENEMENT(NIVEAU_BILAN, LOG_MAGASIN, TRACE_DEMARRAGE, -1, -1, -1, 0);
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Config: %d vendeurs, %d caissiers, %d clients", 
+                nb_vendeurs, nb_caissiers, nb_clients);
+    
+    /* Moteur a evenements : tout se passe dans ce processus, sans IPC */
+    if (mode_evenements) {
+        int ret = executer_evenements(nb_vendeurs, nb_caissiers, nb_clients,
+                                      protocole, routage, inter_arrivee_ms);
+        LOG_EVENEMENT(NIVEAU_BILAN, LOG_MAGASIN, TRACE_FIN, -1, -1, -1, 0);
+        log_close();
+        return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Creer les IPC (memoire partagee, semaphores, files de messages) */
+    choisir_instance(instance, memoire_posix);
+    if (creer_ipc(nb_vendeurs, nb_caissiers, nb_clients, transport) == -1) {
+        log_erreur("INITIAL", "Impossible de creer les IPC");
+        exit(EXIT_FAILURE);
+    }
+    
+    /* Processus journal : les acteurs ne font plus d'ecriture de log */
+    log_sortie(sortie);
+    if (lancer_journal() == -1) {
+        log_erreur("INITIAL", "Processus journal non lance, logs directs");
+    }
+    
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                "IPC crees (SHM %s de %zu octets%s, Semaphores, Files de messages)",
+                shm->memoire_posix ? "POSIX" : "System V", shm->taille_segment,
+                shm->pages_enormes ? ", pages enormes" : "");
+    if (instance != NULL) {
+        LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL", "Instance: %s", instance);
+    }
+    
+    /* Transport (fixe par creer_ipc) et protocole, lus par les acteurs
+       dans la memoire partagee */
+    shm->protocole = protocole;
+    shm->routage = routage;
+    if (transport == TRANSPORT_FILES && creer_files_acteurs() == -1) {
+        log_erreur("INITIAL", "Impossible de creer les files par acteur");
+        arreter_journal();
+        detacher_ipc();
+        detruire_ipc();
+        exit(EXIT_FAILURE);
+    }
+    if (transport == TRANSPORT_THREADS && creer_boites_threads() == -1) {
+        log_erreur("INITIAL", "Impossible de creer les boites du mode threads");
+        arreter_journal();
+        detacher_ipc();
+        detruire_ipc();
+        exit(EXIT_FAILURE);
+    }
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL", "Transport des requetes: %s",
+                transport == TRANSPORT_ANNEAU ? "anneaux en memoire partagee" :
+                transport == TRANSPORT_FILES ? "une file par acteur" :
+                transport == TRANSPORT_THREADS ? "boites en memoire (mode threads)" :
+                                               "files System V partagees");
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                "Protocole de messages: version %d", protocole);
+    LOG_MESSAGE(NIVEAU_INFO, LOG_MAGASIN, "INITIAL",
+                "Routage des clients: %s", nom_routage(routage));
+    
+    /* Assigner les rayons aux vendeurs */
+    /* Les 10 premiers vendeurs ont chacun un rayon different */
+    /* Les vendeurs supplementaires ont un rayon aleatoire */
+    for (i = 0; i < nb_vendeurs; i++) {
+        shm_vendeurs[i].rayon = (i < NB_RAYONS) ? i : (aleatoire() % NB_RAYONS);
+        shm_vendeurs[i].occupe = 0;
+        shm_vendeurs[i].service_ewma_ms = (TEMPS_DISCUSSION_MIN + TEMPS_DISCUSSION_MAX) * 500;
+    }
+    construire_annuaire();
+    
+    /* Allouer les tableaux de PIDs */
+    pids_vendeurs = calloc(nb_vendeurs, sizeof(pid_t));
+    pids_caissiers = calloc(nb_caissiers, sizeof(pid_t));
+    pids_clients = calloc(nb_processus_clients, sizeof(pid_t));
+    
+    /* Installer les gestionnaires de signaux pour arret propre */
+    for (i = 1; i < 20; i++) {
+        if (i != SIGCHLD && i != SIGKILL && i != SIGSTOP) {
+            signal(i, gestionnaireSignal);
+        }
+    }
+    
+    /* Activer la simulation AVANT de creer les vendeurs */
+    shm->simulation_active = 1;
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    
+    if (mode_threads) {
+        ret = executer_threads(&fin);
+        if (ret != 0) {
+            /* Threads tous termines : les IPC peuvent etre detruites */
+            nettoyer_et_quitter(ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+    } else {
+        executer_processus(taille_pool, &fin);
+    }
+    
+    /* ===== BILAN ===== */
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Duree de service des %d clients: %.3f s", nb_clients,
+                (fin.tv_sec - debut.tv_sec) + (fin.tv_nsec - debut.tv_nsec) / 1e9);
+    if (shm->lancements > 0) {
+        LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                    "Lancement des clients (%s): latence moyenne %.1f us, "
+                    "preparation moyenne %.1f us",
+                    mode_threads ? "threads" : taille_pool ? "zygote" : "fork + exec",
+                    shm->lancement_ns_total / 1000.0 / shm->lancements,
+                    shm->preparation_ns_total / 1000.0 / shm->lancements);
+    }
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Messages echanges: %ld (%.2f par client, protocole %d)",
+                shm->messages_envoyes, (double)shm->messages_envoyes / nb_clients,
+                shm->protocole);
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Routage %s: %.2f redirections par client, premier service "
+                "apres %.3f s en moyenne", nom_routage(shm->routage),
+                (double)shm->redirections / nb_clients,
+                shm->premiers_services ?
+                    shm->premier_service_ns_total / 1e9 / shm->premiers_services : 0.0);
+    for (i = ROLE_VENDEUR; i <= ROLE_CAISSIER; i++) {
+        equilibre_t *e = &shm->equilibre[i];
+        
+        if (e->reservations > 0) {
+            LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                        "Equilibre des files (%s, %ld reservations): ecart max-min "
+                        "%.2f en moyenne, %d au pire, %ld choix refaits, %ld refus (file pleine)",
+                        i == ROLE_VENDEUR ? "vendeurs" : "caissiers", e->reservations,
+                        (double)e->ecart_total / e->reservations, e->ecart_max,
+                        e->reprises, e->refus);
+        }
+    }
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                "Attente bloquante: %ld reveils au total, %ld reveils de polling evites",
+                shm->reveils_total, shm->reveils_evites_total);
+    for (i = 0; i < NB_ROLES; i++) {
+        memoire_role_t *m = &shm->memoire[i];
+        
+        if (m->attachements > 0) {
+            LOG_MESSAGE(NIVEAU_BILAN, LOG_MAGASIN, "INITIAL",
+                        "Attachement SHM (%s, %ld processus): %.1f us en moyenne, "
+                        "fautes de page %.1f a l'attachement, %.1f en service",
+                        i == ROLE_VENDEUR ? "vendeurs" : i == ROLE_CAISSIER ? "caissiers" : "clients",
+                        m->attachements, m->attache_ns / 1000.0 / m->attachements,
+                        (double)m->fautes_attache / m->attachements,
+                        (double)m->fautes_service / m->attachements);
+        }
+    }
     
     /* ===== NETTOYAGE ===== */
-    log_message("INITIAL", "Nettoyage des IPC...");
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_MAGASIN, TRACE_NETTOYAGE, -1, -1, -1, 0);
     
+    arreter_journal();
     detacher_ipc();
     detruire_ipc();
     
@@ -299,7 +873,7 @@ int main(int argc, char *argv[]) {
     free(pids_caissiers);
     free(pids_clients);
     
-    log_message("INITIAL", "=== Simulation terminee ===");
+    LOG_EVENEMENT(NIVEAU_BILAN, LOG_MAGASIN, TRACE_FIN, -1, -1, -1, 0);
     log_close();
     
     return EXIT_SUCCESS;
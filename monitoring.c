@@ -5,16 +5,53 @@
  *
  * Interface temps reel : colonnes a largeur fixe, couleurs, chiffre d'affaires.
  *
+ * Chaque ligne est une copie coherente de la fiche de l'acteur (seqlock,
+ * instantane_vendeur / instantane_caissier) : etat, longueur de file et
+ * clients listes concordent, sans prendre de verrou. Les compteurs du
+ * magasin sont lus une seule fois par rafraichissement.
+ *
+ * Vues : totaux par rayon, files les plus longues, utilisation des caisses
+ * et tableau detaille par pages de LIGNES_PAGE acteurs (touches n / p).
+ * Les agregats sont tenus a jour a chaque image a partir des seules fiches
+ * dont la sequence a change : la taille de l'affichage ne depend pas du
+ * nombre d'acteurs. Une image lit encore la sequence de chaque fiche (un
+ * mot par acteur, cout lineaire mais faible) ; seules les fiches modifiees
+ * sont recopiees et seules les lignes de la page courante sont formatees.
+ *
+ * Affichage : chaque image est composee hors ecran (une cellule par
+ * caractere) puis comparee a la precedente ; seules les cellules modifiees
+ * sont envoyees au terminal, en un seul write() par image.
+ *
+ * Exporteur (-e) : sans affichage, sert a chaque connexion les metriques
+ * au format texte Prometheus (files, occupation et clients servis de chaque
+ * vendeur et caissier, chiffre d'affaires), en HTTP sur 127.0.0.1:port ou
+ * sur une socket Unix.
+ *
+ * Usage : ./monitoring [-m sysv|posix] [-n instance] [-f images_par_s]
+ *                      [-e port|chemin_socket]
+ *         (memes options que ./main ; a defaut, MAGASIN_MEMOIRE et
+ *         MAGASIN_INSTANCE sont lus dans l'environnement)
+ *
  * =============================================================================
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "config.h"
 #include "ipc.h"
+#include "utils.h"
 
 DECLARE_NOMS_RAYONS;
 
@@ -31,151 +68,920 @@ DECLARE_NOMS_RAYONS;
 /* Largeur totale du cadre (visible) */
 #define W 78
 
+/* Lignes du tableau detaille par page, et de l'image entiere (fixe,
+   quel que soit le nombre d'acteurs) */
+#define LIGNES_PAGE 10
+#define LIGNES_MAX (LIGNES_PAGE + NB_RAYONS / 2 + 32)
+
+/* Nombre de files listees dans "FILES LES PLUS LONGUES" */
+#define TOP_FILES 6
+
+/* Taille maximale d'une reponse de l'exporteur (-e) */
+#define TAILLE_METRIQUES 65536
+
+/* Frequence de rafraichissement par defaut (images par seconde) */
+#define FREQUENCE_DEFAUT 20
+
+/* Couleurs d'une cellule (index dans COULEURS) */
+enum { NORMAL, GRAS, TERNE, ROUGE, VERT, JAUNE, BLEU, MAGENTA, CYAN };
+static const char *COULEURS[] = {
+    C_RESET, C_BOLD, C_DIM, C_RED, C_GREEN, C_YELLOW, C_BLUE, C_MAGENTA, C_CYAN
+};
+
+/* Une cellule de l'ecran : caractere et couleur */
+typedef struct {
+    char c;
+    unsigned char couleur;
+} cellule_t;
+
+/* Image en composition, et image deja envoyee au terminal */
+static cellule_t image[LIGNES_MAX][W];
+static cellule_t affichee[LIGNES_MAX][W];
+static int lignes_affichees = 0;
+
+/* Ligne et colonne d'ecriture dans l'image */
+static int ligne = 0, colonne = 0;
+
+/* 1 : effacer le terminal et tout renvoyer (premiere image, SIGWINCH) */
+static volatile sig_atomic_t tout_redessiner = 1;
+
+/* Bilan de l'affichage : images composees, write() faits, octets envoyes */
+static long images = 0, ecritures = 0, octets = 0;
+
+static int frequence = FREQUENCE_DEFAUT;
+
+/* Page courante du tableau detaille (touches n / p) */
+static int page = 0;
+
+/*
+ * Derniere copie de chaque fiche et agregats qui en sont deduits. Une fiche
+ * n'est recopiee que si sa sequence a change ; les agregats sont alors
+ * corriges de la difference entre l'ancienne et la nouvelle copie. Une
+ * copie perimee (ecrivain arrete en pleine modification) laisse les
+ * agregats et la ligne en l'etat, marquee PERIME.
+ * Tableaux dimensionnes d'apres la capacite du segment (capacite_*).
+ * par_longueur[g][L * mots[g] + i / 64] : bit i % 64 a 1 si l'acteur i du
+ * groupe g (0 : vendeurs, 1 : caissiers) a L clients en file.
+ */
+static struct {
+    int nb_vendeurs, nb_caissiers;
+    instantane_acteur_t *vendeurs;
+    instantane_acteur_t *caissiers;
+    int mots[2];                    /* Mots de 64 bits par longueur */
+    unsigned long long *par_longueur[2];
+    int personnel[NB_RAYONS], occupes[NB_RAYONS], file[NB_RAYONS];
+    int caisses_occupees, caisses_file;
+    long paiements, encaisse;
+    double occupation_ns;           /* Somme (caisses occupees x duree) */
+    long long debut_ns, precedent_ns;
+} vue;
+
 int continuer = 1;
 
 void handler_term(int sig) { (void)sig; continuer = 0; }
 
-void effacer_ecran(void) {
-    printf("\033[2J\033[H");
-    fflush(stdout);
+void handler_winch(int sig) { (void)sig; tout_redessiner = 1; }
+
+/* Ecrit du texte formate dans l'image a la position courante */
+static void poser(int couleur, const char *format, ...) {
+    char texte[W + 1];
+    va_list args;
+    int i;
+
+    if (ligne >= LIGNES_MAX) {
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(texte, sizeof(texte), format, args);
+    va_end(args);
+    for (i = 0; texte[i] != '\0' && colonne < W; i++, colonne++) {
+        image[ligne][colonne].c = texte[i];
+        image[ligne][colonne].couleur = couleur;
+    }
+}
+
+/* Ouvre une ligne du cadre :  "  |"  */
+static void debut_ligne(void) {
+    colonne = 0;
+    poser(NORMAL, "  |");
+}
+
+/* Ferme la ligne courante par "|" en derniere colonne */
+static void fin_ligne(void) {
+    colonne = W - 1;
+    poser(NORMAL, "|");
+    ligne++;
 }
 
 /* Trace une ligne du type  +----+----+  */
 static void sep(char c) {
-    putchar(' ');
-    putchar('+');
-    for (int i = 0; i < W - 2; i++) putchar(c);
-    putchar('+');
-    putchar('\n');
+    int i;
+
+    colonne = 0;
+    poser(NORMAL, "  +");
+    for (i = colonne; i < W - 1; i++) {
+        poser(NORMAL, "%c", c);
+    }
+    poser(NORMAL, "+");
+    ligne++;
 }
 
 /* Affiche une ligne de texte centree entre |  */
-static void ligne_centree(const char *s, const char *color) {
+static void ligne_centree(const char *s, int couleur) {
     int len = (int)strlen(s);
-    int gauche = (W - 4 - len) / 2;
-    int droite = W - 4 - len - gauche;
-    printf("  |");
-    for (int i = 0; i < gauche; i++) putchar(' ');
-    if (color) printf("%s%s%s", color, s, C_RESET);
-    else printf("%s", s);
-    for (int i = 0; i < droite; i++) putchar(' ');
-    printf("|\n");
+
+    debut_ligne();
+    colonne += (W - 4 - len) / 2;
+    poser(couleur, "%s", s);
+    fin_ligne();
+}
+
+/* Titre d'un bloc suivi d'un trait */
+static void titre_bloc(const char *titre, int couleur) {
+    debut_ligne();
+    poser(couleur, "  %s", titre);
+    fin_ligne();
+    debut_ligne();
+    while (colonne < W - 1) {
+        poser(NORMAL, "-");
+    }
+    fin_ligne();
+}
+
+/* Liste "C3 C7 ..." des premiers clients d'une file (5 au plus) */
+static void lister_clients(const instantane_acteur_t *copie, char *buf, size_t taille) {
+    char *p = buf;
+    int j;
+
+    if (copie->nb_clients == 0) {
+        snprintf(buf, taille, "-");
+        return;
+    }
+    buf[0] = '\0';
+    for (j = 0; j < copie->nb_clients && j < 5 && p - buf < (int)taille - 8; j++) {
+        p += snprintf(p, taille - (p - buf), "C%d ", copie->clients[j]);
+    }
+    if (copie->nb_clients > 5) snprintf(buf + strlen(buf), taille - strlen(buf), "...");
+}
+
+/* Ajoute une chaine au tampon de sortie */
+static size_t ajouter(char *sortie, size_t n, const char *s) {
+    size_t len = strlen(s);
+
+    memcpy(sortie + n, s, len);
+    return n + len;
+}
+
+/*
+ * Envoie au terminal les seules cellules qui ont change depuis l'image
+ * precedente : deplacement du curseur au debut de chaque suite de cellules
+ * modifiees, code couleur seulement quand elle change ; le tout en un
+ * seul write().
+ */
+static void envoyer_image(void) {
+    static char sortie[LIGNES_MAX * W * 16 + 64];
+    int lignes = (ligne > lignes_affichees) ? ligne : lignes_affichees;
+    int tout = tout_redessiner;
+    int couleur = -1;
+    int curseur_l = -1, curseur_c = -1;
+    size_t n = 0;
+    ssize_t ecrit;
+    char position[24];
+    int l, c;
+
+    tout_redessiner = 0;
+    if (tout) {
+        n = ajouter(sortie, n, "\033[2J");
+    }
+    for (l = 0; l < lignes; l++) {
+        for (c = 0; c < W; c++) {
+            cellule_t *nouvelle = &image[l][c];
+
+            if (!tout && nouvelle->c == affichee[l][c].c &&
+                nouvelle->couleur == affichee[l][c].couleur) {
+                continue;
+            }
+            if (l != curseur_l || c != curseur_c) {
+                snprintf(position, sizeof(position), "\033[%d;%dH", l + 1, c + 1);
+                n = ajouter(sortie, n, position);
+            }
+            if (nouvelle->couleur != couleur) {
+                n = ajouter(sortie, n, C_RESET);
+                if (nouvelle->couleur != NORMAL) {
+                    n = ajouter(sortie, n, COULEURS[nouvelle->couleur]);
+                }
+                couleur = nouvelle->couleur;
+            }
+            sortie[n++] = nouvelle->c;
+            affichee[l][c] = *nouvelle;
+            curseur_l = l;
+            curseur_c = c + 1;
+        }
+    }
+    lignes_affichees = ligne;
+    images++;
+    if (n == 0) {
+        return;
+    }
+
+    /* Curseur sous le cadre, couleurs par defaut */
+    snprintf(position, sizeof(position), C_RESET "\033[%d;1H", ligne + 1);
+    n = ajouter(sortie, n, position);
+    ecritures++;
+    octets += n;
+    for (size_t fait = 0; fait < n; fait += ecrit) {
+        ecrit = write(STDOUT_FILENO, sortie + fait, n - fait);
+        if (ecrit < 0) {
+            if (errno == EINTR) {
+                ecrit = 0;
+                continue;
+            }
+            return;
+        }
+    }
+}
+
+/*
+ * Vue agregee du magasin, tenue a jour a partir des seules fiches dont la
+ * sequence a change depuis l'image precedente : chaque changement retire
+ * l'ancienne contribution de la fiche et ajoute la nouvelle.
+ * Retourne 0, ou -1 si l'allocation echoue.
+ */
+static int vue_initialiser(void) {
+    int capacite[2] = {shm->capacite_vendeurs, shm->capacite_caissiers};
+    int g, i;
+
+    memset(&vue, 0, sizeof(vue));
+    vue.nb_vendeurs = shm->nb_vendeurs;
+    vue.nb_caissiers = shm->nb_caissiers;
+    vue.vendeurs = calloc(capacite[0], sizeof(instantane_acteur_t));
+    vue.caissiers = calloc(capacite[1], sizeof(instantane_acteur_t));
+    for (g = 0; g < 2; g++) {
+        vue.mots[g] = (capacite[g] + 63) / 64;
+        vue.par_longueur[g] = calloc((MAX_QUEUE + 1) * vue.mots[g],
+                                     sizeof(unsigned long long));
+    }
+    if (!vue.vendeurs || !vue.caissiers || !vue.par_longueur[0] || !vue.par_longueur[1]) {
+        perror("[ERREUR] calloc vue");
+        return -1;
+    }
+
+    for (i = 0; i < vue.nb_vendeurs; i++) {
+        vue.vendeurs[i].sequence = 1;       /* Impaire : jamais copiee */
+        vue.vendeurs[i].rayon = shm_vendeurs[i].rayon;
+        vue.personnel[shm_vendeurs[i].rayon]++;
+        vue.par_longueur[0][i / 64] |= 1ULL << (i % 64);
+    }
+    for (i = 0; i < vue.nb_caissiers; i++) {
+        vue.caissiers[i].sequence = 1;
+        vue.caissiers[i].rayon = -1;
+        vue.par_longueur[1][i / 64] |= 1ULL << (i % 64);
+    }
+    vue.debut_ns = vue.precedent_ns = horloge_ns();
+    return 0;
+}
+
+/* Deplace l'acteur i de son ancienne longueur de file a la nouvelle */
+static void vue_deplacer(int groupe, int i, int ancienne, int nouvelle) {
+    unsigned long long *niveaux = vue.par_longueur[groupe];
+    int mots = vue.mots[groupe];
+
+    niveaux[ancienne * mots + i / 64] &= ~(1ULL << (i % 64));
+    niveaux[nouvelle * mots + i / 64] |= 1ULL << (i % 64);
+}
+
+static void vue_actualiser(void) {
+    instantane_acteur_t copie, *ancienne;
+    long long maintenant = horloge_ns();
+    int i, r;
+
+    /* Caisses occupees depuis l'image precedente (integrale du temps) */
+    vue.occupation_ns += (double)vue.caisses_occupees * (maintenant - vue.precedent_ns);
+    vue.precedent_ns = maintenant;
+
+    for (i = 0; i < vue.nb_vendeurs; i++) {
+        ancienne = &vue.vendeurs[i];
+        if (__atomic_load_n(&shm_vendeurs[i].sequence, __ATOMIC_ACQUIRE) == ancienne->sequence) {
+            continue;
+        }
+        instantane_vendeur(i, &copie);
+        if (copie.perime) {
+            /* Agregats inchanges ; nouvel essai si la sequence bouge */
+            ancienne->sequence = copie.sequence;
+            ancienne->perime = 1;
+            continue;
+        }
+        r = copie.rayon;
+        vue.occupes[r] += copie.occupe - ancienne->occupe;
+        vue.file[r] += copie.longueur - ancienne->longueur;
+        vue_deplacer(0, i, ancienne->longueur, copie.longueur);
+        *ancienne = copie;
+    }
+    for (i = 0; i < vue.nb_caissiers; i++) {
+        ancienne = &vue.caissiers[i];
+        if (__atomic_load_n(&shm_caissiers[i].sequence, __ATOMIC_ACQUIRE) == ancienne->sequence) {
+            continue;
+        }
+        instantane_caissier(i, &copie);
+        if (copie.perime) {
+            ancienne->sequence = copie.sequence;
+            ancienne->perime = 1;
+            continue;
+        }
+        vue.caisses_occupees += copie.occupe - ancienne->occupe;
+        vue.caisses_file += copie.longueur - ancienne->longueur;
+        vue.paiements += copie.servis - ancienne->servis;
+        vue.encaisse += copie.encaisse - ancienne->encaisse;
+        vue_deplacer(1, i, ancienne->longueur, copie.longueur);
+        *ancienne = copie;
+    }
+}
+
+/* Ligne du tableau detaille : vendeur (i < nb_vendeurs) ou caissier */
+static void ligne_detail(int i) {
+    const instantane_acteur_t *copie;
+    char buf[64];
+
+    debut_ligne();
+    if (i < vue.nb_vendeurs) {
+        copie = &vue.vendeurs[i];
+        poser(NORMAL, " V%02d   %-18.18s ", i, NOMS_RAYONS[copie->rayon]);
+    } else {
+        copie = &vue.caissiers[i - vue.nb_vendeurs];
+        poser(NORMAL, " K%02d   %-18.18s ", i - vue.nb_vendeurs, "Caisse");
+    }
+    if (copie->perime) {
+        poser(ROUGE, "PERIME  ");
+    } else if (copie->occupe) {
+        poser(JAUNE, "OCCUPE  ");
+    } else {
+        poser(VERT, "LIBRE   ");
+    }
+    lister_clients(copie, buf, sizeof(buf));
+    poser(NORMAL, " %4d %6d %-20.20s", copie->longueur, copie->servis, buf);
+    fin_ligne();
 }
 
+/*
+ * Compose l'image de l'etat du magasin hors ecran, puis n'en envoie que
+ * les differences (envoyer_image). Seules les lignes de la page courante
+ * du tableau detaille sont formatees.
+ */
 void afficher_etat(void) {
-    int i, j;
+    int i, l, groupe, m, n;
     char buf[128];
+    int actif = __atomic_load_n(&shm->simulation_active, __ATOMIC_RELAXED);
+    int termines = __atomic_load_n(&shm->clients_termines, __ATOMIC_RELAXED);
+    long chiffre = __atomic_load_n(&shm->chiffre_affaires, __ATOMIC_RELAXED);
+    int acteurs = vue.nb_vendeurs + vue.nb_caissiers;
+    int nb_pages = (acteurs + LIGNES_PAGE - 1) / LIGNES_PAGE;
+    double duree;
+
+    vue_actualiser();
+    duree = (vue.precedent_ns - vue.debut_ns) / 1e9;
+    if (page >= nb_pages) {
+        page = nb_pages - 1;
+    }
 
-    effacer_ecran();
+    for (i = 0; i < LIGNES_MAX; i++) {
+        for (int c = 0; c < W; c++) {
+            image[i][c].c = ' ';
+            image[i][c].couleur = NORMAL;
+        }
+    }
+    ligne = 1;
 
     /* ----- En-tete ----- */
-    printf("\n  ");
     sep('=');
-    ligne_centree("MAGASIN DE BRICOLAGE - MONITORING", C_BOLD C_BLUE);
-    ligne_centree("Temps reel - Rafraichi toutes les 0,5 s", C_DIM);
+    ligne_centree("MAGASIN DE BRICOLAGE - MONITORING", BLEU);
+    snprintf(buf, sizeof(buf), "Temps reel - %d images par seconde", frequence);
+    ligne_centree(buf, TERNE);
     sep('=');
 
     /* ----- Bloc resume ----- */
-    printf("  |" C_BOLD "  RESUME" C_RESET);
-    for (int i = 8; i < W - 2; i++) putchar(' ');
-    printf("|\n  |");
-    for (int i = 0; i < W - 4; i++) putchar('-');
-    printf("|\n");
-
-    printf("  |  Etat:    ");
-    printf(shm->simulation_active ? C_GREEN "ACTIF " C_RESET : C_RED "INACTIF" C_RESET);
-    printf("  |  Clients:  %3d / %-3d  |  En cours: %3d",
-           shm->clients_termines, shm->nb_clients,
-           shm->nb_clients - shm->clients_termines);
-    /* Padding fixe : resume ~63 car visibles */
-    for (int i = 63; i < W - 2; i++) putchar(' ');
-    printf("|\n");
-
-    printf("  |  " C_BOLD C_MAGENTA "Chiffre d'affaires:" C_RESET "  " C_BOLD C_GREEN "%12ld EUR" C_RESET,
-           (long)shm->chiffre_affaires);
-    for (int i = 42; i < W - 2; i++) putchar(' ');
-    printf("|\n");
+    titre_bloc("RESUME", GRAS);
+
+    debut_ligne();
+    poser(NORMAL, "  Etat:    ");
+    if (actif) {
+        poser(VERT, "ACTIF  ");
+    } else {
+        poser(ROUGE, "INACTIF");
+    }
+    poser(NORMAL, "  |  Clients:  %3d / %-3d  |  En cours: %3d",
+          termines, shm->nb_clients, shm->nb_clients - termines);
+    fin_ligne();
+
+    debut_ligne();
+    poser(NORMAL, "  ");
+    poser(MAGENTA, "Chiffre d'affaires:");
+    poser(NORMAL, "  ");
+    poser(VERT, "%12ld EUR", chiffre);
+    fin_ligne();
 
     sep('=');
 
-    /* ----- Tableau vendeurs ----- */
-    printf("  |" C_BOLD C_CYAN "  VENDEURS" C_RESET);
-    for (int i = 11; i < W - 2; i++) putchar(' ');
-    printf("|\n  |");
-    for (int i = 0; i < W - 4; i++) putchar('-');
-    printf("|\n  | ");
-    printf("%-5s %-18s %-8s %4s %-20s", "Id", "Rayon", "Etat", "File", "Clients");
-    printf(" |\n  |");
-    for (int i = 0; i < W - 4; i++) putchar('-');
-    printf("|\n");
-
-    for (i = 0; i < shm->nb_vendeurs; i++) {
-        const char *etat = shm->vendeurs[i].occupe ? C_YELLOW "OCCUPE " C_RESET : C_GREEN "LIBRE  " C_RESET;
-        int nq = shm->vendeurs[i].file_attente;
-        buf[0] = '\0';
-        if (nq > 0) {
-            char *p = buf;
-            for (j = 0; j < nq && j < 8 && p - buf < (int)sizeof(buf) - 8; j++) {
-                p += snprintf(p, sizeof(buf) - (p - buf), "C%d ", shm->vendeurs[i].clients_queue[j]);
-            }
-            if (nq > 8) snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "...");
-        } else {
-            snprintf(buf, sizeof(buf), "-");
+    /* ----- Totaux par rayon, sur deux colonnes ----- */
+    titre_bloc("RAYONS (vendeurs / occupes / clients en file)", CYAN);
+    for (i = 0; i < (NB_RAYONS + 1) / 2; i++) {
+        debut_ligne();
+        for (int r = i; r < NB_RAYONS; r += (NB_RAYONS + 1) / 2) {
+            poser(NORMAL, " %-18.18s %2d ", NOMS_RAYONS[r], vue.personnel[r]);
+            poser(vue.occupes[r] ? JAUNE : NORMAL, "%2d", vue.occupes[r]);
+            poser(vue.file[r] ? GRAS : TERNE, " %3d   ", vue.file[r]);
         }
-        printf("  | V%02d  %-18.18s %s %3d %-20.20s |\n",
-               i, NOMS_RAYONS[shm->vendeurs[i].rayon], etat, nq, buf);
+        fin_ligne();
     }
 
     sep('=');
 
-    /* ----- Tableau caissiers ----- */
-    printf("  |" C_BOLD C_CYAN "  CAISSIERS" C_RESET);
-    for (int i = 12; i < W - 2; i++) putchar(' ');
-    printf("|\n  |");
-    for (int i = 0; i < W - 4; i++) putchar('-');
-    printf("|\n  | ");
-    printf("%-8s %-8s %4s %-20s", "Caisse", "Etat", "File", "Clients");
-    printf("      |\n  |");
-    for (int i = 0; i < W - 4; i++) putchar('-');
-    printf("|\n");
-
-    for (i = 0; i < shm->nb_caissiers; i++) {
-        const char *etat = shm->caissiers[i].occupe ? C_YELLOW "OCCUPEE" C_RESET : C_GREEN "LIBRE  " C_RESET;
-        int nq = shm->caissiers[i].file_attente;
-        buf[0] = '\0';
-        if (nq > 0) {
-            char *p = buf;
-            for (j = 0; j < nq && j < 8 && p - buf < (int)sizeof(buf) - 8; j++) {
-                p += snprintf(p, sizeof(buf) - (p - buf), "C%d ", shm->caissiers[i].clients_queue[j]);
+    /* ----- Files les plus longues : niveaux de longueur decroissante ----- */
+    titre_bloc("FILES LES PLUS LONGUES", CYAN);
+    debut_ligne();
+    n = 0;
+    for (l = MAX_QUEUE; l >= 1 && n < TOP_FILES; l--) {
+        for (groupe = 0; groupe < 2 && n < TOP_FILES; groupe++) {
+            for (m = 0; m < vue.mots[groupe] && n < TOP_FILES; m++) {
+                unsigned long long bits = vue.par_longueur[groupe][l * vue.mots[groupe] + m];
+
+                while (bits != 0 && n < TOP_FILES) {
+                    poser(NORMAL, "  %c%02d ", groupe == 0 ? 'V' : 'K',
+                          m * 64 + __builtin_ctzll(bits));
+                    poser(l >= MAX_QUEUE / 2 ? ROUGE : JAUNE, "%2d", l);
+                    poser(NORMAL, "  |");
+                    bits &= bits - 1;
+                    n++;
+                }
             }
-            if (nq > 8) snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "...");
+        }
+    }
+    if (n == 0) {
+        poser(TERNE, "  Aucun client en attente");
+    }
+    fin_ligne();
+
+    sep('=');
+
+    /* ----- Resume des caisses ----- */
+    titre_bloc("CAISSES", CYAN);
+    debut_ligne();
+    poser(NORMAL, "  Occupees: %2d / %-2d  |  Utilisation: %5.1f %%  |  File moyenne: %4.1f",
+          vue.caisses_occupees, vue.nb_caissiers,
+          duree > 0 ? 100.0 * vue.occupation_ns / 1e9 / (duree * vue.nb_caissiers) : 0.0,
+          (double)vue.caisses_file / vue.nb_caissiers);
+    fin_ligne();
+    debut_ligne();
+    poser(NORMAL, "  Paiements: %5ld  |  Encaisse: %9ld EUR  |  Debit: %5.2f client/s",
+          vue.paiements, vue.encaisse, duree > 0 ? vue.paiements / duree : 0.0);
+    fin_ligne();
+
+    sep('=');
+
+    /* ----- Tableau detaille, par pages ----- */
+    snprintf(buf, sizeof(buf), "DETAIL (page %d / %d)", page + 1, nb_pages);
+    titre_bloc(buf, CYAN);
+    debut_ligne();
+    poser(NORMAL, " %-5s %-18s %-8s %4s %6s %-20s", "Id", "Rayon", "Etat", "File", "Servis",
+          "Clients");
+    fin_ligne();
+    for (i = page * LIGNES_PAGE; i < (page + 1) * LIGNES_PAGE; i++) {
+        if (i < acteurs) {
+            ligne_detail(i);
         } else {
-            snprintf(buf, sizeof(buf), "-");
+            debut_ligne();
+            fin_ligne();
         }
-        printf("  | %-7d %s %3d %-20.20s      |\n", i, etat, nq, buf);
     }
 
     sep('=');
-    printf("  | " C_DIM "Ctrl+C pour quitter le monitoring" C_RESET);
-    for (int i = 35; i < W - 2; i++) putchar(' ');
-    printf("|\n");
+    debut_ligne();
+    poser(TERNE, " q ou Ctrl+C : quitter  |  n / p : page suivante / precedente");
+    fin_ligne();
     sep('=');
-    printf("\n");
+
+    envoyer_image();
+}
+
+/* Ajoute du texte formate a la reponse de l'exporteur */
+static void metrique(char *corps, size_t *n, size_t taille, const char *format, ...) {
+    va_list args;
+    int ecrit;
+
+    if (*n >= taille) {
+        return;
+    }
+    va_start(args, format);
+    ecrit = vsnprintf(corps + *n, taille - *n, format, args);
+    va_end(args);
+    *n += (ecrit > 0) ? (size_t)ecrit : 0;
+}
+
+/*
+ * Metriques au format texte Prometheus. Chaque fiche est lue par
+ * instantane_* : file, occupation et compteurs d'un acteur concordent ;
+ * un acteur dont la fiche n'a pas pu etre copiee (perimee) est omis.
+ * Retourne la longueur du texte (tronque a taille - 1).
+ */
+static size_t formater_metriques(char *corps, size_t taille) {
+    static instantane_acteur_t *vendeurs = NULL, *caissiers = NULL;
+    int nb_vendeurs = shm->nb_vendeurs, nb_caissiers = shm->nb_caissiers;
+    size_t n = 0;
+    int i;
+
+    /* Copies dimensionnees d'apres le segment, allouees une fois */
+    if (vendeurs == NULL) {
+        vendeurs = malloc(shm->capacite_vendeurs * sizeof(instantane_acteur_t));
+        caissiers = malloc(shm->capacite_caissiers * sizeof(instantane_acteur_t));
+        if (vendeurs == NULL || caissiers == NULL) {
+            perror("[ERREUR] malloc metriques");
+            free(vendeurs);
+            free(caissiers);
+            vendeurs = caissiers = NULL;
+            return 0;
+        }
+    }
+
+    for (i = 0; i < nb_vendeurs; i++) {
+        instantane_vendeur(i, &vendeurs[i]);
+    }
+    for (i = 0; i < nb_caissiers; i++) {
+        instantane_caissier(i, &caissiers[i]);
+    }
+
+    metrique(corps, &n, taille,
+             "# HELP magasin_actif 1 tant que la simulation est en cours\n"
+             "# TYPE magasin_actif gauge\n"
+             "magasin_actif %d\n"
+             "# HELP magasin_clients Clients prevus pour la simulation\n"
+             "# TYPE magasin_clients gauge\n"
+             "magasin_clients %d\n"
+             "# HELP magasin_clients_termines_total Clients sortis apres paiement\n"
+             "# TYPE magasin_clients_termines_total counter\n"
+             "magasin_clients_termines_total %d\n"
+             "# HELP magasin_chiffre_affaires_euros_total Chiffre d'affaires encaisse\n"
+             "# TYPE magasin_chiffre_affaires_euros_total counter\n"
+             "magasin_chiffre_affaires_euros_total %ld\n",
+             __atomic_load_n(&shm->simulation_active, __ATOMIC_RELAXED), shm->nb_clients,
+             __atomic_load_n(&shm->clients_termines, __ATOMIC_RELAXED),
+             __atomic_load_n(&shm->chiffre_affaires, __ATOMIC_RELAXED));
+
+    metrique(corps, &n, taille,
+             "# HELP magasin_vendeur_file Clients dans la file du vendeur\n"
+             "# TYPE magasin_vendeur_file gauge\n");
+    for (i = 0; i < nb_vendeurs; i++) {
+        if (vendeurs[i].perime) {
+            continue;
+        }
+        metrique(corps, &n, taille, "magasin_vendeur_file{vendeur=\"%d\",rayon=\"%s\"} %d\n",
+                 i, NOMS_RAYONS[vendeurs[i].rayon], vendeurs[i].longueur);
+    }
+    metrique(corps, &n, taille,
+             "# HELP magasin_vendeur_occupe 1 si le vendeur discute avec un client\n"
+             "# TYPE magasin_vendeur_occupe gauge\n");
+    for (i = 0; i < nb_vendeurs; i++) {
+        if (vendeurs[i].perime) {
+            continue;
+        }
+        metrique(corps, &n, taille, "magasin_vendeur_occupe{vendeur=\"%d\",rayon=\"%s\"} %d\n",
+                 i, NOMS_RAYONS[vendeurs[i].rayon], vendeurs[i].occupe);
+    }
+    metrique(corps, &n, taille,
+             "# HELP magasin_vendeur_servis_total Discussions terminees par le vendeur\n"
+             "# TYPE magasin_vendeur_servis_total counter\n");
+    for (i = 0; i < nb_vendeurs; i++) {
+        if (vendeurs[i].perime) {
+            continue;
+        }
+        metrique(corps, &n, taille,
+                 "magasin_vendeur_servis_total{vendeur=\"%d\",rayon=\"%s\"} %d\n",
+                 i, NOMS_RAYONS[vendeurs[i].rayon], vendeurs[i].servis);
+    }
+
+    metrique(corps, &n, taille,
+             "# HELP magasin_caissier_file Clients dans la file de la caisse\n"
+             "# TYPE magasin_caissier_file gauge\n");
+    for (i = 0; i < nb_caissiers; i++) {
+        if (caissiers[i].perime) {
+            continue;
+        }
+        metrique(corps, &n, taille, "magasin_caissier_file{caissier=\"%d\"} %d\n",
+                 i, caissiers[i].longueur);
+    }
+    metrique(corps, &n, taille,
+             "# HELP magasin_caissier_occupe 1 si la caisse encaisse un client\n"
+             "# TYPE magasin_caissier_occupe gauge\n");
+    for (i = 0; i < nb_caissiers; i++) {
+        if (caissiers[i].perime) {
+            continue;
+        }
+        metrique(corps, &n, taille, "magasin_caissier_occupe{caissier=\"%d\"} %d\n",
+                 i, caissiers[i].occupe);
+    }
+    metrique(corps, &n, taille,
+             "# HELP magasin_caissier_servis_total Paiements encaisses par la caisse\n"
+             "# TYPE magasin_caissier_servis_total counter\n");
+    for (i = 0; i < nb_caissiers; i++) {
+        if (caissiers[i].perime) {
+            continue;
+        }
+        metrique(corps, &n, taille, "magasin_caissier_servis_total{caissier=\"%d\"} %d\n",
+                 i, caissiers[i].servis);
+    }
+    metrique(corps, &n, taille,
+             "# HELP magasin_caissier_encaisse_euros_total Montant encaisse par la caisse\n"
+             "# TYPE magasin_caissier_encaisse_euros_total counter\n");
+    for (i = 0; i < nb_caissiers; i++) {
+        if (caissiers[i].perime) {
+            continue;
+        }
+        metrique(corps, &n, taille,
+                 "magasin_caissier_encaisse_euros_total{caissier=\"%d\"} %ld\n",
+                 i, caissiers[i].encaisse);
+    }
+
+    return (n < taille) ? n : taille - 1;
+}
+
+/* Vrai si l'adresse de l'exporteur est un numero de port */
+static int est_port(const char *adresse) {
+    return adresse[0] != '\0' && strspn(adresse, "0123456789") == strlen(adresse);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : ouvrir_exporteur
+ * Description : Socket d'ecoute de l'exporteur : port TCP sur 127.0.0.1 si
+ *               l'adresse est un nombre, socket Unix sinon (fichier
+ *               remplace s'il existe)
+ * Parametres  : adresse
+ * Retour      : Descripteur, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+static int ouvrir_exporteur(const char *adresse) {
+    struct sockaddr_in inet;
+    struct sockaddr_un local;
+    long port = atol(adresse);
+    int fd, oui = 1;
+
+    if (est_port(adresse)) {
+        if (port < 1 || port > 65535) {
+            fprintf(stderr, "[ERREUR] Port invalide : %s\n", adresse);
+            return -1;
+        }
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1) {
+            perror("[ERREUR] socket");
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &oui, sizeof(oui));
+        memset(&inet, 0, sizeof(inet));
+        inet.sin_family = AF_INET;
+        inet.sin_port = htons((unsigned short)port);
+        inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (struct sockaddr *)&inet, sizeof(inet)) == -1) {
+            perror("[ERREUR] bind");
+            close(fd);
+            return -1;
+        }
+    } else {
+        if (strlen(adresse) >= sizeof(local.sun_path)) {
+            fprintf(stderr, "[ERREUR] Chemin de socket trop long : %s\n", adresse);
+            return -1;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            perror("[ERREUR] socket");
+            return -1;
+        }
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        strcpy(local.sun_path, adresse);
+        unlink(adresse);
+        if (bind(fd, (struct sockaddr *)&local, sizeof(local)) == -1) {
+            perror("[ERREUR] bind");
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (listen(fd, 16) == -1) {
+        perror("[ERREUR] listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Envoie tout le tampon (reprend apres un envoi partiel ou un signal) ;
+   retourne 0, ou -1 si la connexion est perdue */
+static int envoyer_tout(int client, const char *tampon, size_t taille) {
+    ssize_t n;
+
+    while (taille > 0) {
+        n = send(client, tampon, taille, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        tampon += n;
+        taille -= n;
+    }
+    return 0;
+}
+
+/*
+ * Lit la requete jusqu'a la ligne vide qui termine les en-tetes (ou le
+ * tampon plein), sans attendre plus de 100 ms entre deux lectures : la
+ * requete est consommee avant la reponse. Retourne sa longueur.
+ */
+static size_t lire_requete(int client, char *requete, size_t taille) {
+    struct pollfd pfd = { .fd = client, .events = POLLIN };
+    size_t lu = 0;
+    ssize_t n;
+
+    requete[0] = '\0';
+    while (lu < taille - 1 && poll(&pfd, 1, 100) > 0) {
+        n = read(client, requete + lu, taille - 1 - lu);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        lu += n;
+        requete[lu] = '\0';
+        if (strstr(requete, "\r\n\r\n") != NULL || strstr(requete, "\n\n") != NULL) {
+            break;
+        }
+    }
+    return lu;
+}
+
+/*
+ * Repond a une connexion en HTTP/1.0 puis la ferme : GET ou HEAD de
+ * /metrics renvoie les metriques, un autre chemin 404, une autre methode
+ * 405, une requete illisible (ou absente) 400. En-tete et corps passent
+ * par la meme boucle d'envoi (envoyer_tout).
+ */
+static void servir_metriques(int client, char *corps, size_t taille) {
+    char requete[1024], methode[16], chemin[256];
+    char entete[192];
+    const char *statut = "200 OK";
+    const char *type = "text/plain; version=0.0.4";
+    const char *autorise = "";
+    size_t longueur;
+    int lg_entete, tete = 0;
+
+    lire_requete(client, requete, sizeof(requete));
+    if (sscanf(requete, "%15s %255s", methode, chemin) != 2) {
+        statut = "400 Bad Request";
+    } else if (strcmp(chemin, "/metrics") != 0 && strncmp(chemin, "/metrics?", 9) != 0) {
+        statut = "404 Not Found";
+    } else if (strcmp(methode, "HEAD") == 0) {
+        tete = 1;
+    } else if (strcmp(methode, "GET") != 0) {
+        statut = "405 Method Not Allowed";
+        autorise = "Allow: GET, HEAD\r\n";
+    }
+
+    longueur = (statut[0] == '2') ? formater_metriques(corps, taille) : 0;
+    if (statut[0] == '2' && longueur == 0) {
+        statut = "500 Internal Server Error";     /* Allocation impossible */
+    }
+    if (statut[0] != '2') {
+        type = "text/plain";
+        longueur = snprintf(corps, taille, "%s\n", statut);
+    }
+    lg_entete = snprintf(entete, sizeof(entete),
+                         "HTTP/1.0 %s\r\n"
+                         "Content-Type: %s\r\n"
+                         "%s"
+                         "Content-Length: %zu\r\n\r\n", statut, type, autorise, longueur);
+    if (envoyer_tout(client, entete, lg_entete) == 0 && !tete) {
+        envoyer_tout(client, corps, longueur);
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : exporter
+ * Description : Mode sans affichage (-e) : sert les metriques a chaque
+ *               connexion jusqu'a SIGINT / SIGTERM ou la fin de la
+ *               simulation (vue active puis inactive, ou deja terminee
+ *               au lancement, comme la boucle d'affichage)
+ * Parametres  : adresse (port ou chemin de socket Unix)
+ * Retour      : 0 si succes, -1 si erreur
+ * -----------------------------------------------------------------------------
+ */
+static int exporter(const char *adresse) {
+    static char corps[TAILLE_METRIQUES];
+    struct pollfd pfd;
+    long requetes = 0;
+    int client, actif, termines, vu_actif = 0;
+
+    pfd.fd = ouvrir_exporteur(adresse);
+    if (pfd.fd == -1) {
+        return -1;
+    }
+    pfd.events = POLLIN;
+    printf("Exporteur de metriques sur %s%s (Ctrl+C pour arreter).\n",
+           est_port(adresse) ? "http://127.0.0.1:" : "", adresse);
     fflush(stdout);
+
+    while (continuer) {
+        if (poll(&pfd, 1, 500) > 0) {
+            client = accept(pfd.fd, NULL, NULL);
+            if (client != -1) {
+                servir_metriques(client, corps, sizeof(corps));
+                close(client);
+                requetes++;
+            }
+        }
+        /* simulation_active retombe a 0 quand tous les clients sont partis */
+        actif = __atomic_load_n(&shm->simulation_active, __ATOMIC_RELAXED);
+        termines = __atomic_load_n(&shm->clients_termines, __ATOMIC_RELAXED);
+        if (!actif && (vu_actif || termines >= shm->nb_clients)) {
+            break;
+        }
+        vu_actif |= actif;
+    }
+
+    close(pfd.fd);
+    if (!est_port(adresse)) {
+        unlink(adresse);
+    }
+    printf("Arret de l'exporteur (%ld requetes servies).\n", requetes);
+    return 0;
+}
+
+/*
+ * Attend la prochaine image en traitant le clavier : n ou espace (page
+ * suivante), p (page precedente), q (quitter)
+ */
+static void attendre_touches(int delai_ms) {
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    char touche;
+
+    if (poll(&pfd, 1, delai_ms) <= 0 || read(STDIN_FILENO, &touche, 1) != 1) {
+        return;
+    }
+    if (touche == 'n' || touche == ' ') {
+        page++;
+    } else if (touche == 'p' && page > 0) {
+        page--;
+    } else if (touche == 'q') {
+        continuer = 0;
+    }
 }
 
-int main(void) {
+int main(int argc, char *argv[]) {
     struct sigaction sa;
+    struct rusage avant, apres;
+    struct termios ancien, brut;
+    int clavier = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &ancien) == 0;
+    const char *memoire = getenv(ENV_MEMOIRE);
+    const char *instance = getenv(ENV_INSTANCE);
+    int posix = (memoire != NULL && strcmp(memoire, "posix") == 0);
+    const char *adresse = NULL;
+    long long t0;
+    int opt, code;
+
+    while ((opt = getopt(argc, argv, "m:n:f:e:")) != -1) {
+        if (opt == 'm' && (strcmp(optarg, "sysv") == 0 || strcmp(optarg, "posix") == 0)) {
+            posix = (strcmp(optarg, "posix") == 0);
+        } else if (opt == 'n') {
+            instance = optarg;
+        } else if (opt == 'f' && atoi(optarg) >= 1 && atoi(optarg) <= 1000) {
+            frequence = atoi(optarg);
+        } else if (opt == 'e') {
+            adresse = optarg;
+        } else {
+            fprintf(stderr, "Usage: %s [-m sysv|posix] [-n instance] [-f images_par_s]"
+                    " [-e port|chemin_socket]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    choisir_instance(instance, posix);
 
     printf("Monitoring magasin de bricolage - Connexion IPC...\n");
 
+    getrusage(RUSAGE_SELF, &avant);
+    t0 = horloge_ns();
     if (attacher_ipc() != 0) {
         fprintf(stderr, "Erreur: impossible d'attacher les IPC (simulation en cours ?).\n");
         return EXIT_FAILURE;
     }
+    t0 = horloge_ns() - t0;
+    getrusage(RUSAGE_SELF, &apres);
 
-    printf(C_GREEN "OK." C_RESET " Demarrage dans 2 s...\n");
-    sleep(2);
+    printf(C_GREEN "OK." C_RESET " Segment %s de %zu octets%s (%d vendeurs, %d caissiers, %d clients).\n",
+           shm->memoire_posix ? "POSIX" : "System V", shm->taille_segment,
+           shm->pages_enormes ? ", pages enormes" : "",
+           shm->capacite_vendeurs, shm->capacite_caissiers, shm->capacite_clients);
+    printf("Attachement en %.1f us, %ld fautes de page.\n",
+           t0 / 1000.0, apres.ru_minflt - avant.ru_minflt);
 
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = handler_term;
@@ -183,9 +989,40 @@ int main(void) {
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
 
+    /* Mode sans affichage : metriques servies sur une socket */
+    if (adresse != NULL) {
+        code = exporter(adresse);
+        detacher_ipc();
+        return (code == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    printf("Demarrage dans 2 s...\n");
+    sleep(2);
+    if (vue_initialiser() == -1) {
+        detacher_ipc();
+        return EXIT_FAILURE;
+    }
+    sa.sa_handler = handler_winch;
+    sigaction(SIGWINCH, &sa, NULL);
+
+    /* Curseur masque pendant l'affichage ; touches lues sans attendre
+       Entree ni les afficher */
+    printf("\033[?25l");
+    fflush(stdout);
+    if (clavier) {
+        brut = ancien;
+        brut.c_lflag &= ~(ICANON | ECHO);
+        brut.c_cc[VMIN] = 1;
+        brut.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &brut);
+    }
     while (continuer) {
         afficher_etat();
-        usleep(500000);
+        if (clavier) {
+            attendre_touches(1000 / frequence);
+        } else {
+            usleep(1000000 / frequence);
+        }
         if (!shm->simulation_active && shm->clients_termines >= shm->nb_clients) {
             afficher_etat();
             printf("\n" C_YELLOW "Simulation terminee." C_RESET "\n");
@@ -193,7 +1030,12 @@ int main(void) {
         }
     }
 
-    printf("Arret du monitoring.\n");
+    if (clavier) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &ancien);
+    }
+    printf("\033[?25h");
+    printf("Arret du monitoring (%ld images, %ld envoyees, %.0f octets par envoi).\n",
+           images, ecritures, ecritures ? (double)octets / ecritures : 0.0);
     detacher_ipc();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,42 @@
+/*
+ * =============================================================================
+ * Fichier     : roles.h
+ * Description : Logique des acteurs utilisable sans exec
+ * 
+ * Les fichiers des acteurs (client.c, vendeur.c, caissier.c) compiles avec
+ * -DROLE_SANS_MAIN exposent leur boucle de travail sous forme de fonction.
+ * Le processus initial peut ainsi faire tourner un acteur dans un fils cree
+ * par fork, sans exec ni nouvel attachement des IPC, ou dans un thread
+ * (mode threads). L'etat propre a un acteur est en __thread.
+ * 
+ * =============================================================================
+ */
+
+#ifndef ROLES_H
+#define ROLES_H
+
+/*
+ * Fonction : executer_client
+ * Description : Parcours complet d'un client (IPC et log deja prets)
+ * Parametre : id - ID du client
+ * Retour : EXIT_SUCCESS
+ */
+int executer_client(int id);
+
+/*
+ * Fonction : executer_vendeur
+ * Description : Boucle de service d'un vendeur jusqu'au message d'arret
+ * Parametre : id - ID du vendeur
+ * Retour : EXIT_SUCCESS
+ */
+int executer_vendeur(int id);
+
+/*
+ * Fonction : executer_caissier
+ * Description : Boucle d'encaissement d'un caissier jusqu'au message d'arret
+ * Parametre : id - ID du caissier
+ * Retour : EXIT_SUCCESS
+ */
+int executer_caissier(int id);
+
+#endif /* ROLES_H */
@@ -4,10 +4,12 @@
  * Description : Implementation des fonctions utilitaires
  * 
  * Fonctions :
- *   - init_random()       : Initialise le generateur aleatoire
+ *   - init_random()       : Initialise le generateur aleatoire du thread
+ *   - aleatoire()         : Entier aleatoire (generateur du thread)
  *   - tirage_aleatoire()  : Genere un nombre dans un intervalle
  *   - attente_aleatoire() : Attend un temps aleatoire
  *   - probabilite()       : Decide selon une probabilite
+ *   - horloge_ns()        : Horloge monotone en nanosecondes
  * 
  * =============================================================================
  */
@@ -17,16 +19,40 @@
 #include <unistd.h>
 #include <time.h>
 
+/* Etat du generateur, propre a chaque thread (rand_r) : en mode threads,
+   un acteur qui demarre ne reinitialise pas les tirages des autres */
+static __thread unsigned int graine;
+static __thread int graine_initialisee = 0;
+
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : init_random
- * Description : Initialise le generateur de nombres aleatoires avec une graine
- *               unique basee sur le temps, le PID et un seed fourni
+ * Description : Initialise le generateur de nombres aleatoires du thread
+ *               appelant avec une graine unique basee sur le temps, le PID
+ *               et un seed fourni (dispersee : des seeds voisins donnent
+ *               des suites sans rapport)
  * Parametre   : seed - graine supplementaire
  * -----------------------------------------------------------------------------
  */
 void init_random(int seed) {
-    srand(time(NULL) + seed + getpid());
+    graine = ((unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16))
+             + (unsigned int)seed * 2654435761u;
+    graine_initialisee = 1;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : aleatoire
+ * Description : Entier aleatoire tire du generateur du thread ; un thread
+ *               qui n'a pas appele init_random recoit une graine propre
+ * Retour      : Valeur entre 0 et RAND_MAX
+ * -----------------------------------------------------------------------------
+ */
+int aleatoire(void) {
+    if (!graine_initialisee) {
+        init_random((int)(long)&graine);
+    }
+    return rand_r(&graine);
 }
 
 /*
@@ -44,7 +70,7 @@ int tirage_aleatoire(int min, int max) {
     if (min >= max) {
         return min;
     }
-    return min + rand() % (max - min + 1);
+    return min + aleatoire() % (max - min + 1);
 }
 
 /*
@@ -80,5 +106,20 @@ int probabilite(int pourcentage) {
     }
     
     /* Tirer un nombre entre 0 et 99, comparer au seuil */
-    return (rand() % 100) < pourcentage;
+    return (aleatoire() % 100) < pourcentage;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : horloge_ns
+ * Description : Lit l'horloge monotone du systeme (commune a tous les
+ *               processus) en nanosecondes
+ * Retour      : Instant courant en nanosecondes
+ * -----------------------------------------------------------------------------
+ */
+long long horloge_ns(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
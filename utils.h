@@ -7,6 +7,7 @@
  *   - Generer des nombres aleatoires dans un intervalle
  *   - Simuler des attentes aleatoires
  *   - Calculer des probabilites
+ *   - Lire une horloge monotone (mesures de duree)
  * 
  * =============================================================================
  */
@@ -16,11 +17,20 @@
 
 /*
  * Fonction : init_random
- * Description : Initialise le generateur de nombres aleatoires
+ * Description : Initialise le generateur de nombres aleatoires du thread
+ *               appelant (chaque thread a le sien)
  * Parametre : seed - graine de base (sera combinee avec le temps et le PID)
  */
 void init_random(int seed);
 
+/*
+ * Fonction : aleatoire
+ * Description : Entier aleatoire du generateur du thread (rand_r), a
+ *               utiliser a la place de rand()
+ * Retour : valeur entre 0 et RAND_MAX
+ */
+int aleatoire(void);
+
 /*
  * Fonction : tirage_aleatoire
  * Description : Tire un nombre aleatoire dans l'intervalle [min, max]
@@ -48,4 +58,12 @@ void attente_aleatoire(int min, int max);
  */
 int probabilite(int pourcentage);
 
+/*
+ * Fonction : horloge_ns
+ * Description : Horloge monotone (CLOCK_MONOTONIC) en nanosecondes,
+ *               comparable entre processus de la meme machine
+ * Retour : instant courant en nanosecondes
+ */
+long long horloge_ns(void);
+
 #endif /* UTILS_H */
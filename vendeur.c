@@ -12,8 +12,11 @@
  * 
  * Fonctions :
  *   - gestionnaireSignal() : Gestionnaire pour arret propre
- *   - main()               : Boucle principale du vendeur
+ *   - executer_vendeur()   : Boucle principale du vendeur
+ *   - main()               : Processus vendeur (fork + exec)
  * 
+ * Compile avec -DROLE_SANS_MAIN, ce fichier fournit executer_vendeur() au
+ * processus initial (mode threads : un thread par vendeur).
  * =============================================================================
  */
 
@@ -23,19 +26,19 @@
 #include <signal.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 #include "config.h"
 #include "ipc.h"
 #include "log.h"
 #include "utils.h"
-
-/* Declaration des noms de rayons */
-DECLARE_NOMS_RAYONS;
+#include "roles.h"
 
 /* ============== VARIABLES GLOBALES ============== */
 
-int vendeur_id;     /* ID de ce vendeur */
-int continuer = 1;  /* Flag pour la boucle principale */
+static __thread int vendeur_id;         /* ID de ce vendeur */
+static __thread int continuer = 1;      /* Flag pour la boucle principale */
 
+#ifndef ROLE_SANS_MAIN
 /*
  * -----------------------------------------------------------------------------
  * Fonction    : gestionnaireSignal
@@ -43,68 +46,53 @@ int continuer = 1;  /* Flag pour la boucle principale */
  * Parametre   : sig - numero du signal (ignore)
  * -----------------------------------------------------------------------------
  */
-void gestionnaireSignal(int sig) {
+static void gestionnaireSignal(int sig) {
     (void)sig;
     continuer = 0;
 }
+#endif
 
 /*
  * -----------------------------------------------------------------------------
- * Fonction    : main
- * Description : Point d'entree du processus vendeur
- *               1. Attache les IPC
- *               2. Boucle principale : attente et traitement des clients
- *               3. Termine proprement sur signal
- * Parametre   : argv[1] = ID du vendeur
+ * Fonction    : executer_vendeur
+ * Description : Boucle principale du vendeur (IPC et log deja prets)
+ *               Attend et traite les clients jusqu'a l'arret de la
+ *               simulation (message d'arret ou signal)
+ * Parametre   : id - ID du vendeur
  * Retour      : EXIT_SUCCESS
  * -----------------------------------------------------------------------------
  */
-int main(int argc, char *argv[]) {
+int executer_vendeur(int id) {
     msg_client_vendeur_t msg_client;
     msg_vendeur_client_t msg_reponse;
     char auteur[32];
     int mon_rayon;
-    int i;
     
-    /* Verifier les arguments */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <id>\n", argv[0]);
-        exit(EXIT_FAILURE);
-    }
-    
-    vendeur_id = atoi(argv[1]);
+    vendeur_id = id;
+    log_producteur(ROLE_VENDEUR, id);
     snprintf(auteur, sizeof(auteur), "VENDEUR %d", vendeur_id);
     
     /* Initialiser le generateur aleatoire */
-    srand(time(NULL) + vendeur_id);
-    log_init();
-    
-    /* Attacher les IPC */
-    if (attacher_ipc() == -1) {
-        log_erreur(auteur, "Impossible d'attacher les IPC");
-        exit(EXIT_FAILURE);
-    }
-    
-    /* Installer les gestionnaires de signaux */
-    for (i = 1; i < 20; i++) {
-        signal(i, gestionnaireSignal);
-    }
+    init_random(vendeur_id);
     
     /* Recuperer mon rayon d'expertise */
-    mon_rayon = shm->vendeurs[vendeur_id].rayon;
-    log_message(auteur, "Pret. Rayon: %s (%d)", NOMS_RAYONS[mon_rayon], mon_rayon);
+    mon_rayon = shm_vendeurs[vendeur_id].rayon;
+    LOG_EVENEMENT(NIVEAU_INFO, LOG_VENDEURS, TRACE_VENDEUR_PRET, -1, -1, mon_rayon, 0);
     
     /* ===== BOUCLE PRINCIPALE ===== */
     while (continuer && shm->simulation_active) {
         
-        /* Attendre un message d'un client (non bloquant) */
-        ssize_t ret = msgrcv(msg_vendeur_id, &msg_client,
-                            sizeof(msg_client) - sizeof(long),
-                            vendeur_id + 1, IPC_NOWAIT);
+        /* Attendre un message d'un client (bloquant) */
+        if (recevoir_requete_vendeur(vendeur_id, &msg_client) == -1) {
+            /* Signal recu (on reverifie continuer) ou file detruite */
+            if (errno != EINTR) {
+                break;
+            }
+            continue;
+        }
         
-        if (ret == -1) {
-            /* Pas de message, attendre un peu */
-            usleep(100000);
+        /* Message d'arret envoye par le processus initial */
+        if (msg_client.client_id < 0) {
             continue;
         }
         
@@ -112,16 +100,16 @@ int main(int argc, char *argv[]) {
         int client_id = msg_client.client_id;
         int rayon_voulu = msg_client.rayon_voulu;
         
-        log_message(auteur, "Client %d demande rayon %s", 
-                    client_id, NOMS_RAYONS[rayon_voulu]);
+        LOG_EVENEMENT(NIVEAU_INFO, LOG_VENDEURS, TRACE_DEMANDE, client_id, -1, rayon_voulu, 0);
         
-        /* Marquer le vendeur comme occupe */
-        sem_P(SEM_MUTEX_SHM);
-        shm->vendeurs[vendeur_id].occupe = 1;
-        sem_V(SEM_MUTEX_SHM);
+        /* Marquer le vendeur comme occupe (sequence : voir vendeur_info_t) */
+        verrou_prendre(&shm_vendeurs[vendeur_id].verrou);
+        sequence_ouvrir(&shm_vendeurs[vendeur_id].sequence);
+        shm_vendeurs[vendeur_id].occupe = 1;
+        sequence_fermer(&shm_vendeurs[vendeur_id].sequence);
+        verrou_rendre(&shm_vendeurs[vendeur_id].verrou);
         
         /* Preparer la reponse */
-        msg_reponse.mtype = client_id + 1000;
         msg_reponse.vendeur_id = vendeur_id;
         
         if (mon_rayon != rayon_voulu) {
@@ -129,94 +117,151 @@ int main(int argc, char *argv[]) {
             /* Trouver un vendeur competent et rediriger le client */
             
             int vendeur_ok = trouver_vendeur_pour_rayon(rayon_voulu);
-            log_message(auteur, "Redirection vers vendeur %d", vendeur_ok);
+            LOG_EVENEMENT(NIVEAU_INFO, LOG_VENDEURS, TRACE_REDIRECTION,
+                          client_id, vendeur_ok, rayon_voulu, 0);
             
             msg_reponse.est_competent = 0;
             msg_reponse.vendeur_recommande = vendeur_ok;
             msg_reponse.vente_terminee = 0;
             
             /* Envoyer la reponse de redirection */
-            msgsnd(msg_vendeur_id, &msg_reponse, 
-                   sizeof(msg_reponse) - sizeof(long), 0);
+            envoyer_reponse_vendeur(client_id, &msg_reponse);
             
             /* Liberer le vendeur */
-            sem_P(SEM_MUTEX_SHM);
-            shm->vendeurs[vendeur_id].occupe = 0;
-            sem_V(SEM_MUTEX_SHM);
+            verrou_prendre(&shm_vendeurs[vendeur_id].verrou);
+            sequence_ouvrir(&shm_vendeurs[vendeur_id].sequence);
+            shm_vendeurs[vendeur_id].occupe = 0;
+            sequence_fermer(&shm_vendeurs[vendeur_id].sequence);
+            verrou_rendre(&shm_vendeurs[vendeur_id].verrou);
             
         } else {
             /* ===== CAS 2 : COMPETENT ===== */
             /* Engager la discussion avec le client */
             
-            log_message(auteur, "Discussion avec client %d", client_id);
+            LOG_EVENEMENT(NIVEAU_INFO, LOG_VENDEURS, TRACE_DISCUSSION_CLIENT,
+                          client_id, -1, rayon_voulu, 0);
+            compter_premier_service(msg_client.entree_ns);
             
-            /* Envoyer confirmation de competence */
             msg_reponse.est_competent = 1;
             msg_reponse.vendeur_recommande = -1;
             msg_reponse.vente_terminee = 0;
-            msgsnd(msg_vendeur_id, &msg_reponse, 
-                   sizeof(msg_reponse) - sizeof(long), 0);
+            
+            /* Protocole 1 : confirmer la competence avant la discussion */
+            if (shm->protocole == PROTOCOLE_V1) {
+                envoyer_reponse_vendeur(client_id, &msg_reponse);
+            }
             
             /* Simuler le temps de discussion */
             int temps = tirage_aleatoire(TEMPS_DISCUSSION_MIN, TEMPS_DISCUSSION_MAX);
             sleep(temps);
+            noter_service_vendeur(vendeur_id, temps * 1000);
             
-            /* Signaler la fin de la discussion */
+            /* Signaler la fin de la discussion (seule reponse en protocole 2) */
             msg_reponse.vente_terminee = 1;
-            msgsnd(msg_vendeur_id, &msg_reponse, 
-                   sizeof(msg_reponse) - sizeof(long), 0);
+            envoyer_reponse_vendeur(client_id, &msg_reponse);
             
             /* Attendre la decision du client */
             msg_client_vendeur_t decision;
             int recu = 0;
             
+            /* La decision arrive sur le type propre a la session : attente
+               bloquante, sans toucher aux requetes des autres clients */
             while (!recu && continuer && shm->simulation_active) {
-                ret = msgrcv(msg_vendeur_id, &decision,
-                            sizeof(decision) - sizeof(long),
-                            vendeur_id + 1, IPC_NOWAIT);
-                            
-                if (ret == -1) {
-                    usleep(50000);
+                if (recevoir_decision(client_id, &decision) == -1) {
+                    if (errno != EINTR) {
+                        break;
+                    }
                     continue;
                 }
-                
-                /* Verifier si c'est une decision (type_requete = 1) */
-                if (decision.type_requete == 1) {
-                    recu = 1;
-                } else {
-                    /* Ce n'est pas une decision, remettre le message */
-                    msgsnd(msg_vendeur_id, &decision, 
-                           sizeof(decision) - sizeof(long), 0);
-                }
+                recu = 1;
             }
             
             if (recu && decision.decision_achat) {
                 /* Le client achete : generer le montant et l'enregistrer */
                 int montant = tirage_aleatoire(MONTANT_ACHAT_MIN, MONTANT_ACHAT_MAX);
-                log_message(auteur, "Vente conclue: %d euros", montant);
+                LOG_EVENEMENT(NIVEAU_INFO, LOG_VENDEURS, TRACE_VENTE,
+                              client_id, -1, rayon_voulu, montant);
                 
-                /* Enregistrer l'achat en memoire partagee pour le caissier */
-                sem_P(SEM_MUTEX_SHM);
-                shm->achats[client_id].client_id = client_id;
-                shm->achats[client_id].montant = montant;
-                shm->achats[client_id].valide = 1;
-                sem_V(SEM_MUTEX_SHM);
+                /* Enregistrer l'achat en memoire partagee pour le caissier :
+                   valide est publie en dernier (release) */
+                shm_achats[client_id].client_id = client_id;
+                shm_achats[client_id].montant = montant;
+                __atomic_store_n(&shm_achats[client_id].valide, 1, __ATOMIC_RELEASE);
                 
             } else if (recu) {
-                log_message(auteur, "Client %d n'achete pas", client_id);
+                LOG_EVENEMENT(NIVEAU_INFO, LOG_VENDEURS, TRACE_REFUS_ACHAT,
+                              client_id, -1, rayon_voulu, 0);
             }
             
-            /* Liberer le vendeur */
-            sem_P(SEM_MUTEX_SHM);
-            shm->vendeurs[vendeur_id].occupe = 0;
-            sem_V(SEM_MUTEX_SHM);
+            /* Liberer le vendeur, une discussion de plus */
+            verrou_prendre(&shm_vendeurs[vendeur_id].verrou);
+            sequence_ouvrir(&shm_vendeurs[vendeur_id].sequence);
+            shm_vendeurs[vendeur_id].occupe = 0;
+            shm_vendeurs[vendeur_id].servis++;
+            sequence_fermer(&shm_vendeurs[vendeur_id].sequence);
+            verrou_rendre(&shm_vendeurs[vendeur_id].verrou);
         }
     }
     
     /* ===== TERMINAISON ===== */
-    log_message(auteur, "Fin du service");
-    shmdt(shm);
+    long reveils, evites;
+    double cpu_ms;
+    bilan_attente(100000, &reveils, &evites, &cpu_ms);
+    LOG_MESSAGE(NIVEAU_BILAN, LOG_VENDEURS, auteur,
+                "Attente bloquante: %ld reveils, %ld reveils evites, CPU %.1f ms",
+                reveils, evites, cpu_ms);
+    LOG_EVENEMENT(NIVEAU_BILAN, LOG_VENDEURS, TRACE_FIN_SERVICE, -1, -1, mon_rayon, 0);
+    
+    return EXIT_SUCCESS;
+}
+
+#ifndef ROLE_SANS_MAIN
+/*
+ * -----------------------------------------------------------------------------
+ * Fonction    : main
+ * Description : Point d'entree du processus vendeur
+ *               1. Attache les IPC
+ *               2. Boucle principale : attente et traitement des clients
+ *               3. Termine proprement sur signal
+ * Parametre   : argv[1] = ID du vendeur
+ * Retour      : EXIT_SUCCESS
+ * -----------------------------------------------------------------------------
+ */
+int main(int argc, char *argv[]) {
+    struct sigaction sa;
+    char auteur[32];
+    int i;
+    
+    /* Verifier les arguments */
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <id>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    
+    snprintf(auteur, sizeof(auteur), "VENDEUR %s", argv[1]);
+    log_init();
+    
+    /* Attacher les IPC */
+    if (attacher_ipc() == -1) {
+        log_erreur(auteur, "Impossible d'attacher les IPC");
+        exit(EXIT_FAILURE);
+    }
+    
+    /* Installer les gestionnaires de signaux (sans SA_RESTART : un signal
+       doit interrompre l'attente d'une requete, msgrcv ou futex) */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = gestionnaireSignal;
+    sigemptyset(&sa.sa_mask);
+    for (i = 1; i < 20; i++) {
+        sigaction(i, &sa, NULL);
+    }
+    
+    executer_vendeur(atoi(argv[1]));
+    
+    bilan_memoire(ROLE_VENDEUR);
+    detacher_ipc();
     log_close();
     
     return EXIT_SUCCESS;
 }
+#endif /* ROLE_SANS_MAIN */